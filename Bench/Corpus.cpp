@@ -0,0 +1,147 @@
+//
+//  Corpus.cpp
+//  LDParse
+//
+//  Created by Thomas Dickerson on 2/3/16.
+//  Copyright © 2016 StickFigure Graphic Productions. All rights reserved.
+//
+
+#include "Corpus.hpp"
+
+#include <algorithm>
+#include <cstdio>
+
+namespace LDParse {
+	namespace Bench {
+		namespace {
+			// xorshift64*, rather than <random>, whose distributions differ between standard libraries
+			class Rng {
+				uint64_t mState;
+			public:
+				Rng(uint32_t seed) : mState(0x9E3779B97F4A7C15ull ^ seed) { if(!mState) mState = 1; }
+				uint64_t next(){
+					mState ^= mState >> 12;
+					mState ^= mState << 25;
+					mState ^= mState >> 27;
+					return mState * 0x2545F4914F6CDD1Dull;
+				}
+				size_t below(size_t n){ return n ? (size_t)(next() % n) : 0; }
+				int coord(){ return (int)below(8001) - 4000; } // In hundredths of an LDU
+			};
+
+			class Writer {
+				std::string &mOut;
+				size_t &mLines;
+				char mBuf[256];
+			public:
+				Writer(std::string &out, size_t &lines) : mOut(out), mLines(lines) {}
+				void line(const std::string &text){ mOut += text; mOut += "\n"; ++mLines; }
+				template<typename ...ArgTs> void linef(const char * fmt, ArgTs... args){
+					snprintf(mBuf, sizeof(mBuf), fmt, args...);
+					line(mBuf);
+				}
+				void point(Rng &rng){
+					snprintf(mBuf, sizeof(mBuf), " %.2f %.2f %.2f", rng.coord() / 100.0, rng.coord() / 100.0, rng.coord() / 100.0);
+					mOut += mBuf;
+				}
+				void begin(const char * prefix){ mOut += prefix; }
+				void end(){ mOut += "\n"; ++mLines; }
+			};
+
+			const char * const Colours[] = {"16", "16", "16", "4", "1", "14", "71", "72", "0", "15", "0x2FF8000"};
+			const size_t ColourCt = sizeof(Colours) / sizeof(Colours[0]);
+
+			// Identity, a quarter turn about y, and a mirror in x (which flips the winding of everything beneath it)
+			const char * const Rotations[] = {"1 0 0 0 1 0 0 0 1", "0 0 1 0 1 0 -1 0 0", "-1 0 0 0 1 0 0 0 1"};
+
+			void writeModel(Writer &w, Rng &rng, const CorpusOptions &options, const std::string &name,
+							const std::vector<std::string> &includable, bool mpd){
+				if(mpd) w.linef("0 FILE %s", name.c_str());
+				w.linef("0 Synthetic model %s", name.c_str());
+				w.linef("0 Name: %s", name.c_str());
+				w.line("0 Author: ldparse_bench");
+				if(options.mCertify) w.line("0 BFC CERTIFY CCW");
+
+				const size_t includeCt = includable.size() ? options.mIncludesPerModel : 0;
+				const size_t total = options.mPrimitivesPerModel + includeCt + options.mCommentsPerModel;
+				size_t prims = options.mPrimitivesPerModel, includes = includeCt, comments = options.mCommentsPerModel;
+				for(size_t i = 0; i < total; ++i){
+					// Interleave the three kinds of line, in proportion
+					size_t pick = rng.below(prims + includes + comments);
+					if(pick < prims){
+						--prims;
+						const size_t kind = rng.below(10);
+						const std::string colour = Colours[rng.below(ColourCt)];
+						if(kind < 1){
+							w.begin("2 24"); w.point(rng); w.point(rng); w.end();
+						} else if(kind < 5){
+							w.begin(("3 " + colour).c_str()); w.point(rng); w.point(rng); w.point(rng); w.end();
+						} else if(kind < 9){
+							w.begin(("4 " + colour).c_str()); w.point(rng); w.point(rng); w.point(rng); w.point(rng); w.end();
+						} else {
+							w.begin("5 24"); w.point(rng); w.point(rng); w.point(rng); w.point(rng); w.end();
+						}
+					} else if(pick < prims + includes){
+						--includes;
+						if(options.mCertify && !rng.below(8)) w.line("0 BFC INVERTNEXT");
+						w.linef("1 %s %d %d %d %s %s", Colours[rng.below(ColourCt)], rng.coord() / 10, rng.coord() / 10, rng.coord() / 10,
+								Rotations[rng.below(3)], includable[rng.below(includable.size())].c_str());
+					} else {
+						--comments;
+						if(rng.below(4)) w.linef("0 // Comment %u with some ordinary words in it", (unsigned)rng.below(100000));
+						else w.line("0 STEP");
+					}
+				}
+			}
+		}
+
+		Corpus generateCorpus(const CorpusOptions &options){
+			Corpus ret;
+			ret.mLineCount = 0;
+			Rng rng(options.mSeed);
+			Writer w(ret.mText, ret.mLineCount);
+
+			const bool mpd = options.mSubModels > 0;
+			const size_t depth = std::max<size_t>(1, std::min(options.mIncludeDepth, options.mSubModels));
+			std::vector<std::vector<std::string> > levels(depth + 1);
+			ret.mModelNames.push_back(mpd ? "main.ldr" : "model.ldr");
+			levels[0].push_back(ret.mModelNames[0]);
+			for(size_t i = 0; i < options.mSubModels; ++i){
+				char name[32];
+				snprintf(name, sizeof(name), "sub%03u.ldr", (unsigned)i);
+				ret.mModelNames.push_back(name);
+				levels[1 + i % depth].push_back(name);
+			}
+
+			const std::vector<std::string> none;
+			const size_t modelCt = ret.mModelNames.size();
+			const size_t noFileCt = mpd ? options.mNoFileSections : 0;
+			size_t written = 0;
+			for(size_t level = 0; level <= depth; ++level){
+				for(auto it = levels[level].begin(); it != levels[level].end(); ++it, ++written){
+					writeModel(w, rng, options, *it, (mpd && level < depth) ? levels[level + 1] : none, mpd);
+					// Spread the NOFILE sections out evenly after the models
+					for(size_t s = written * noFileCt / modelCt; s < (written + 1) * noFileCt / modelCt; ++s){
+						w.line("0 NOFILE");
+						for(size_t i = 0; i < options.mNoFileLines; ++i) w.linef("garbage %u ~!@#$%%^&*() not LDraw at all", (unsigned)(rng.below(100000)));
+					}
+				}
+			}
+			return ret;
+		}
+
+		std::vector<std::string> generateNames(size_t count, uint32_t seed){
+			static const char * const Prefixes[] = {"", "", "", "s\\", "p\\", "p\\48\\", "p\\8\\"};
+			std::vector<std::string> ret;
+			ret.reserve(count);
+			Rng rng(seed);
+			char name[64];
+			for(size_t i = 0; i < count; ++i){
+				// The index keeps them distinct; the rest gives them the long shared prefixes real names have
+				snprintf(name, sizeof(name), "%s%u%s%u.dat", Prefixes[rng.below(7)], (unsigned)(3000 + rng.below(64)), rng.below(2) ? "p0" : "s", (unsigned)i);
+				ret.push_back(name);
+			}
+			return ret;
+		}
+	}
+}
@@ -0,0 +1,52 @@
+//
+//  Corpus.hpp
+//  LDParse
+//
+//  Created by Thomas Dickerson on 2/3/16.
+//  Copyright © 2016 StickFigure Graphic Productions. All rights reserved.
+//
+
+#ifndef Corpus_h
+#define Corpus_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace LDParse {
+	namespace Bench {
+		/*
+		 * Shape of a synthetic file. Submodels are arranged in mIncludeDepth levels, and each model includes mIncludesPerModel
+		 * models from the level below it, so the deepest chain of includes is mIncludeDepth long. Everything is self-contained:
+		 * the only files included are the file's own submodels.
+		 */
+		struct CorpusOptions {
+			uint32_t mSeed;
+			size_t mSubModels; // 0 gives a plain LDR, with no 0 FILE lines
+			size_t mIncludeDepth;
+			size_t mIncludesPerModel;
+			size_t mPrimitivesPerModel; // Lines, triangles, quads and conditional lines, about 1:4:4:1
+			size_t mCommentsPerModel;
+			size_t mNoFileSections; // Garbage between 0 NOFILE and the next 0 FILE, as pasted-together MPDs often have
+			size_t mNoFileLines;
+			bool mCertify; // Start each model with 0 BFC CERTIFY CCW, and sprinkle in INVERTNEXTs
+
+			CorpusOptions() : mSeed(1), mSubModels(16), mIncludeDepth(4), mIncludesPerModel(4), mPrimitivesPerModel(256),
+			mCommentsPerModel(8), mNoFileSections(0), mNoFileLines(8), mCertify(true) {}
+		};
+
+		struct Corpus {
+			std::string mText;
+			std::vector<std::string> mModelNames; // Root first
+			size_t mLineCount;
+		};
+
+		// Same options, same bytes, on any platform
+		Corpus generateCorpus(const CorpusOptions &options);
+		// Distinct library-style file names (parts, subparts and primitives at each resolution), for exercising the caches
+		std::vector<std::string> generateNames(size_t count, uint32_t seed = 1);
+	}
+}
+
+#endif /* Corpus_h */
@@ -0,0 +1,200 @@
+//
+//  main.cpp
+//  ldparse_bench
+//
+//  Created by Thomas Dickerson on 2/3/16.
+//  Copyright © 2016 StickFigure Graphic Productions. All rights reserved.
+//
+
+#include "Corpus.hpp"
+
+#include <map>
+#include <sstream>
+#include <tuple>
+#include <benchmark/benchmark.h>
+#include <LDParse/Arena.hpp>
+#include <LDParse/Lex.hpp>
+#include <LDParse/Parse.hpp>
+#include <LDParse/Model.hpp>
+#include <LDParse/ModelBuilder.hpp>
+#include <LDParse/Stream.hpp>
+
+using namespace LDParse;
+
+/*
+ * One benchmark per stage, each over the same synthetic files, so a regression shows up in the stage that caused it.
+ * Throughput is reported as bytes_per_second and lines (per second); the cache benchmarks count names instead of lines.
+ */
+
+static size_t errorCt = 0;
+static void countErr(std::string msg, std::string tok, bool fatal) { ++errorCt; }
+static ErrF errF = &countErr;
+
+static const Bench::Corpus& corpus(size_t primitives, size_t subModels, size_t noFileSections){
+	static std::map<std::tuple<size_t, size_t, size_t>, Bench::Corpus> corpora;
+	const auto key = std::make_tuple(primitives, subModels, noFileSections);
+	auto it = corpora.find(key);
+	if(it == corpora.end()){
+		Bench::CorpusOptions options;
+		options.mPrimitivesPerModel = primitives;
+		options.mSubModels = subModels;
+		options.mNoFileSections = noFileSections;
+		it = corpora.insert(std::make_pair(key, Bench::generateCorpus(options))).first;
+	}
+	return it->second;
+}
+
+static void reportThroughput(benchmark::State &state, size_t bytes, size_t lines){
+	state.SetBytesProcessed((int64_t)(state.iterations() * bytes));
+	state.counters["lines"] = benchmark::Counter((double)(state.iterations() * lines), benchmark::Counter::kIsRate);
+}
+
+// Args: primitives per model, submodels, NOFILE sections
+static void corpusArgs(benchmark::internal::Benchmark *b){
+	b->Args({256, 0, 0})->Args({64, 64, 0})->Args({256, 16, 0})->Args({64, 64, 16});
+}
+
+static void BM_LexLine(benchmark::State &state){
+	const Bench::Corpus &c = corpus(state.range(0), state.range(1), state.range(2));
+	std::string lineT;
+	TokenStream tokens;
+	for(auto _ : state){
+		std::istringstream in(c.mText);
+		CallbackLexer lexer(in, errF);
+		while(lexer.lexLine(lineT, tokens)) benchmark::DoNotOptimize(tokens.data());
+	}
+	reportThroughput(state, c.mText.size(), c.mLineCount);
+}
+BENCHMARK(BM_LexLine)->Apply(corpusArgs);
+
+static void BM_LexModelBoundaries(benchmark::State &state){
+	const Bench::Corpus &c = corpus(state.range(0), state.range(1), state.range(2));
+	ModelStream models;
+	for(auto _ : state){
+		std::istringstream in(c.mText);
+		CallbackLexer lexer(in, errF);
+		std::string root = "bench.mpd";
+		benchmark::DoNotOptimize(lexer.lexModelBoundaries(models, root));
+	}
+	reportThroughput(state, c.mText.size(), c.mLineCount);
+}
+BENCHMARK(BM_LexModelBoundaries)->Apply(corpusArgs);
+
+static void BM_ParseModels(benchmark::State &state){
+	const Bench::Corpus &c = corpus(state.range(0), state.range(1), state.range(2));
+	ModelStream models;
+	std::istringstream in(c.mText);
+	CallbackLexer lexer(in, errF);
+	std::string root = "bench.mpd";
+	lexer.lexModelBoundaries(models, root);
+
+	using namespace DummyImpl;
+	CallbackParser parser(dummyMPD, dummyMeta, dummyIncl, dummyLine, dummyTri, dummyQuad, dummyOpt, dummyEOF, errF);
+	for(auto _ : state){
+		benchmark::DoNotOptimize(parser.parseModels(models));
+	}
+	reportThroughput(state, c.mText.size(), c.mLineCount);
+}
+BENCHMARK(BM_ParseModels)->Apply(corpusArgs);
+
+// Args: names, whether the cache nodes come from an Arena
+static void BM_CacheInsert(benchmark::State &state){
+	const std::vector<std::string> names = Bench::generateNames(state.range(0));
+	size_t bytes = 0;
+	for(auto it = names.begin(); it != names.end(); ++it) bytes += it->size();
+	for(auto _ : state){
+		Arena arena;
+		Arena * nodeArena = state.range(1) ? &arena : nullptr;
+		std::unique_ptr<Model::IndexType> root(Model::IndexType::makeRoot(nodeArena));
+		for(size_t i = 0; i < names.size(); ++i) root->insert(names[i], makeIn<const size_t>(nodeArena, i));
+		benchmark::DoNotOptimize(root.get());
+	}
+	state.SetBytesProcessed((int64_t)(state.iterations() * bytes));
+	state.counters["names"] = benchmark::Counter((double)(state.iterations() * names.size()), benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_CacheInsert)->Args({256, 0})->Args({256, 1})->Args({16384, 0})->Args({16384, 1});
+
+static void BM_CacheFind(benchmark::State &state){
+	const std::vector<std::string> names = Bench::generateNames(state.range(0));
+	std::unique_ptr<Model::IndexType> root(Model::IndexType::makeRoot());
+	size_t bytes = 0;
+	for(size_t i = 0; i < names.size(); ++i){
+		root->insert(names[i], std::unique_ptr<const size_t>(new size_t(i)));
+		bytes += names[i].size();
+	}
+	for(auto _ : state){
+		for(auto it = names.begin(); it != names.end(); ++it) benchmark::DoNotOptimize(root->find(*it));
+	}
+	state.SetBytesProcessed((int64_t)(state.iterations() * bytes));
+	state.counters["names"] = benchmark::Counter((double)(state.iterations() * names.size()), benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_CacheFind)->Arg(256)->Arg(16384);
+
+// Everything from the bytes to a finished Model. Each iteration's Models go in an Arena, which is destroyed inside the timing.
+static void BM_Construct(benchmark::State &state){
+	const Bench::Corpus &c = corpus(state.range(0), state.range(1), state.range(2));
+	ColorTable colors;
+	for(auto _ : state){
+		Arena arena;
+		std::istringstream in(c.mText);
+		ModelBuilder<ErrF> builder(errF);
+		builder.setArena(&arena);
+		benchmark::DoNotOptimize(builder.construct("bench.mpd", "bench.mpd", in, colors));
+	}
+	reportThroughput(state, c.mText.size(), c.mLineCount);
+}
+BENCHMARK(BM_Construct)->Apply(corpusArgs);
+
+// Args: vertices per chunk. Against the largest corpus, with a sink that only touches each chunk.
+static void BM_FlattenStreaming(benchmark::State &state){
+	const Bench::Corpus &c = corpus(256, 16, 0);
+	ColorTable colors;
+	Arena arena;
+	std::istringstream in(c.mText);
+	ModelBuilder<ErrF> builder(errF);
+	builder.setArena(&arena);
+	const Model * model = builder.construct("bench.mpd", "bench.mpd", in, colors);
+	StreamOptions options;
+	options.mChunkVertices = state.range(0);
+	options.mChunkIndices = 4 * state.range(0);
+	size_t vertices = 0;
+	for(auto _ : state){
+		vertices = flattenStreaming(*model, [](const MeshChunk &chunk){ benchmark::DoNotOptimize(chunk.mMesh.indices.data()); }, options).vertices;
+	}
+	state.counters["vertices"] = benchmark::Counter((double)(state.iterations() * vertices), benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_FlattenStreaming)->Arg(1 << 10)->Arg(1 << 16)->UseRealTime();
+
+// Args: 1 to go through the structure-of-arrays kernels (GeomKernels.hpp), 0 to transform one tuple at a time.
+// Tight bounds of every placed instance in the largest corpus, as getExactBounds and the glTF exporter find them.
+static void BM_TransformedBounds(benchmark::State &state){
+	const Bench::Corpus &c = corpus(256, 16, 0);
+	ColorTable colors;
+	Arena arena;
+	std::istringstream in(c.mText);
+	ModelBuilder<ErrF> builder(errF);
+	builder.setArena(&arena);
+	const Model * model = builder.construct("bench.mpd", "bench.mpd", in, colors);
+	std::vector<Instance> instances;
+	size_t vertices = 0;
+	model->visitInstances([&](const Instance &instance){
+		instances.push_back(instance);
+		vertices += instance.model->getPositionArrays().size(); // Made once per Model, outside the timing
+	});
+	for(auto _ : state){
+		AABB box;
+		for(auto it = instances.begin(); it != instances.end(); ++it){
+			if(state.range(0)){
+				extendTransformed(box, it->transform, it->model->getPositionArrays());
+			} else {
+				const std::vector<Position> &positions = std::get<0>(it->model->getMesh().attributes);
+				for(auto pIt = positions.begin(); pIt != positions.end(); ++pIt) box.extend(applyTransform(it->transform, *pIt));
+			}
+		}
+		benchmark::DoNotOptimize(box.lo);
+	}
+	state.counters["vertices"] = benchmark::Counter((double)(state.iterations() * vertices), benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_TransformedBounds)->Arg(0)->Arg(1);
+
+BENCHMARK_MAIN();
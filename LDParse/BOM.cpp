@@ -0,0 +1,75 @@
+//
+//  BOM.cpp
+//  LDParse
+//
+//  Created by Thomas Dickerson on 2/9/16.
+//  Copyright © 2016 StickFigure Graphic Productions. All rights reserved.
+//
+
+#include <LDParse/BOM.hpp>
+
+#include <algorithm>
+
+namespace LDParse {
+	static bool isPart(const Model &model){
+		return model.getSrcType() == PartT;
+	}
+
+	const BillOfMaterials& BOMCounter::tally(const Model &model){
+		auto it = mTallies.find(&model);
+		if(it != mTallies.end()) return it->second;
+		BillOfMaterials &ret = mTallies[&model]; // Empty until it's done, which also stops a model that includes itself
+		Counts counts;
+		addChildren(counts, model, MainColour, nullptr, 0);
+		ret = sorted(counts);
+		return ret;
+	}
+
+	// Without steps, everything model places; with them, only what's placed by the steps done so far
+	void BOMCounter::addChildren(Counts &into, const Model &model, uint32_t colour, const StepIndex * steps, size_t step){
+		const std::vector<Model::ChildType> &children = model.getChildren();
+		const size_t end = steps ? steps->visible(model, step).children.second : children.size();
+		const Palette &palette = model.getPalette();
+		for(size_t i = 0; i < end; ++i){
+			const Model * child = std::get<3>(children[i]);
+			if(child == nullptr) continue;
+			const uint32_t childColour = palette.resolve((uint32_t)std::get<0>(children[i]), colour);
+			if(isPart(*child)){
+				++into[Key(child, childColour)];
+			} else if(steps && steps->localStepsDone(*child, step) < child->getStepEnds().size()){
+				addChildren(into, *child, childColour, steps, step); // Part way through, so this can't come from the tally
+			} else {
+				const Palette &childPalette = child->getPalette();
+				const BillOfMaterials &lines = tally(*child);
+				for(auto it = lines.begin(); it != lines.end(); ++it){
+					into[Key(it->mPart, childPalette.resolve(it->mColour, childColour))] += it->mCount;
+				}
+			}
+		}
+	}
+
+	BillOfMaterials BOMCounter::sorted(const Counts &counts){
+		BillOfMaterials ret;
+		ret.reserve(counts.size());
+		for(auto it = counts.begin(); it != counts.end(); ++it) ret.push_back({it->first.first, it->first.second, it->second});
+		std::sort(ret.begin(), ret.end(), [](const BOMLine &a, const BOMLine &b){
+			const int byName = a.mPart->getName().compare(b.mPart->getName());
+			return byName ? byName < 0 : (a.mPart != b.mPart ? a.mPart < b.mPart : a.mColour < b.mColour);
+		});
+		return ret;
+	}
+
+	BillOfMaterials BOMCounter::count(const Model &root, uint32_t colour){
+		Counts counts;
+		if(isPart(root)) ++counts[Key(&root, colour)];
+		else addChildren(counts, root, colour, nullptr, 0);
+		return sorted(counts);
+	}
+
+	BillOfMaterials BOMCounter::count(const Model &root, const StepIndex &steps, size_t step, uint32_t colour){
+		Counts counts;
+		if(isPart(root)) ++counts[Key(&root, colour)];
+		else addChildren(counts, root, colour, &steps, step);
+		return sorted(counts);
+	}
+}
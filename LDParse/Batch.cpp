@@ -0,0 +1,61 @@
+//
+//  Batch.cpp
+//  LDParse
+//
+//  Created by Thomas Dickerson on 2/1/16.
+//  Copyright © 2016 StickFigure Graphic Productions. All rights reserved.
+//
+
+#include <LDParse/Batch.hpp>
+#include <LDParse/ModelBuilder.hpp>
+#include <LDParse/Parallel.hpp>
+
+#include <atomic>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+
+namespace LDParse {
+	std::vector<BatchResult> buildBatch(const std::vector<BatchSource> &sources, ColorTable &colorTable, Library * library,
+										const BatchOptions &options, WeldStats * weldStats){
+		std::vector<BatchResult> ret(sources.size());
+		const size_t threads = options.mThreads ? options.mThreads : Parallel::defaultThreadCount();
+		std::atomic<size_t> nextSource(0);
+		std::mutex statsLock;
+
+		// One chunk per worker; the sources themselves are handed out one at a time
+		Parallel::forChunks(threads, 1, [&](size_t, size_t){
+			DiagnosticCollector collector;
+			ModelBuilder<DiagnosticCollector> builder(collector);
+			builder.setLibrary(library);
+			builder.setLODPolicy(options.mLODPolicy);
+			builder.setWeldEpsilon(options.mWeldEpsilon);
+			builder.setInterning(options.mInterning);
+			builder.setWeldThreads(1); // We're already using every thread we were given
+
+			size_t i;
+			while((i = nextSource++) < sources.size()){
+				const BatchSource &source = sources[i];
+				BatchResult &result = ret[i];
+				collector.retarget(&result.mDiagnostics);
+
+				std::unique_ptr<std::istream> input;
+				if(source.mContents) input.reset(new std::istringstream(*source.mContents));
+				else input.reset(new std::ifstream(source.mPath));
+				if(*input){
+					result.mModel.reset(builder.construct(source.mPath, source.mName, *input, colorTable, source.mSrcType));
+				} else {
+					collector("Couldn't open file", source.mPath, true);
+				}
+			}
+			collector.retarget(nullptr);
+
+			if(weldStats){
+				std::lock_guard<std::mutex> lock(statsLock);
+				*weldStats += builder.getWeldStats();
+			}
+		}, threads);
+
+		return ret;
+	}
+}
@@ -8,38 +8,85 @@
 
 #include <LDParse/Color.hpp>
 
-#include <limits>
+#include <algorithm>
 
 namespace LDParse {
-	ColorTable::ColorTable() : mNextFree(512), mColors(mNextFree, 0), mComplements(mNextFree, 0) { }
-	
-	boost::optional<uint32_t> ColorTable::getColour(uint16_t code) const{
+	LocalColours::LocalColours() : mSize(0) {
+		for(size_t i = 0; i < MaxChunks; ++i) mChunks[i].store(nullptr, std::memory_order_relaxed);
+	}
+
+	LocalColours::~LocalColours(){
+		for(size_t i = 0; i < MaxChunks; ++i) delete [] mChunks[i].load(std::memory_order_relaxed);
+	}
+
+	boost::optional<uint32_t> LocalColours::intern(uint32_t rgba, uint32_t complement){
+		boost::optional<uint32_t> ret = boost::none;
+		const uint64_t key = ((uint64_t)rgba << 32) | complement;
+		std::lock_guard<std::mutex> lock(mInternLock);
+		auto indexIt = mIndex.find(key);
+		if(indexIt != mIndex.end()){
+			ret = indexIt->second;
+		} else {
+			const uint32_t i = mSize.load(std::memory_order_relaxed);
+			if(i < MaxChunks * ChunkSize){
+				Entry *chunk = mChunks[i >> ChunkBits].load(std::memory_order_relaxed);
+				if(chunk == nullptr){
+					chunk = new Entry[ChunkSize];
+					mChunks[i >> ChunkBits].store(chunk, std::memory_order_release);
+				}
+				chunk[i & (ChunkSize - 1)] = {rgba, complement};
+				mSize.store(i + 1, std::memory_order_release);
+				ret = PaletteSize + i;
+				mIndex[key] = *ret;
+			}
+		}
+		return ret;
+	}
+
+	Palette::Palette(const std::shared_ptr<LocalColours> &locals) : mLocals(locals) {
+		std::fill(mColors, mColors + PaletteSize, 0);
+		std::fill(mComplements, mComplements + PaletteSize, 0);
+	}
+
+	boost::optional<uint32_t> Palette::getColour(uint32_t code) const{
 		boost::optional<uint32_t> ret = boost::none;
-		if(code < mNextFree) ret = mColors[code];
+		if(code < PaletteSize) ret = mColors[code];
+		else if(code - PaletteSize < mLocals->size()) ret = mLocals->get(code).mRGBA;
 		return ret;
 	}
-	
+
+	uint32_t Palette::getComplement(uint32_t code) const{
+		uint32_t ret = EdgeColour;
+		if(code < PaletteSize) ret = mComplements[code];
+		else if(code - PaletteSize < mLocals->size()) ret = mLocals->get(code).mComplement;
+		return ret;
+	}
+
+	ColorTable::ColorTable() : mLocals(std::make_shared<LocalColours>()), mStaging(new Palette(mLocals)) { }
+
 	bool ColorTable::setColour(uint16_t code, uint32_t color){
 		bool ret = true;
-		if(code < mNextFree) mColors[code] = color;
-		else ret = false;
+		if(code < PaletteSize){
+			std::lock_guard<std::mutex> lock(mSnapshotLock);
+			mStaging->mColors[code] = color;
+			mSnapshot.reset();
+		} else ret = false;
 		return ret;
 	}
-	
-	bool ColorTable::setComplement(uint16_t code, uint16_t cCode){
+
+	bool ColorTable::setComplement(uint16_t code, uint32_t cCode){
 		bool ret = true;
-		if(code < mNextFree) mComplements[code] = cCode;
-		else ret = false;
+		if(code < PaletteSize){
+			std::lock_guard<std::mutex> lock(mSnapshotLock);
+			mStaging->mComplements[code] = cCode;
+			mSnapshot.reset();
+		} else ret = false;
 		return ret;
 	}
-	
-	boost::optional<uint16_t> ColorTable::addLocalColour(uint32_t color){
-		boost::optional<uint16_t> ret = boost::none;
-		if(mNextFree < std::numeric_limits<uint16_t>::max()){
-			mColors.push_back(color);
-			mComplements.push_back(0);
-			ret = mNextFree++;
-		}
-		return ret;
+
+	std::shared_ptr<const Palette> ColorTable::snapshot(){
+		std::lock_guard<std::mutex> lock(mSnapshotLock);
+		if(!mSnapshot) mSnapshot = std::shared_ptr<const Palette>(new Palette(*mStaging));
+		return mSnapshot;
 	}
 }
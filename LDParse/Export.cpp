@@ -0,0 +1,585 @@
+//
+//  Export.cpp
+//  LDParse
+//
+//  Created by Thomas Dickerson on 1/29/16.
+//  Copyright © 2016 StickFigure Graphic Productions. All rights reserved.
+//
+
+#include <LDParse/Export.hpp>
+
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <map>
+#include <sstream>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace LDParse {
+	ChunkWriter::ChunkWriter(int fd) : mFd(fd), mOwned(false), mOk(fd >= 0), mWritten(0) { mCurrent.reserve(ExportChunkSize); }
+
+	ChunkWriter::ChunkWriter(const std::string &path)
+	: mFd(open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644)), mOwned(true), mOk(mFd >= 0), mWritten(0) { mCurrent.reserve(ExportChunkSize); }
+
+	ChunkWriter::~ChunkWriter(){
+		flush();
+		if(mOwned && mFd >= 0) close(mFd);
+	}
+
+	void ChunkWriter::write(const void *data, size_t size){
+		const char *src = static_cast<const char*>(data);
+		while(size){
+			const size_t n = std::min(size, ExportChunkSize - mCurrent.size());
+			mCurrent.insert(mCurrent.end(), src, src + n);
+			src += n;
+			size -= n;
+			if(mCurrent.size() == ExportChunkSize) submit();
+		}
+	}
+
+	void ChunkWriter::fill(char c, size_t count){
+		while(count){
+			const size_t n = std::min(count, ExportChunkSize - mCurrent.size());
+			mCurrent.insert(mCurrent.end(), n, c);
+			count -= n;
+			if(mCurrent.size() == ExportChunkSize) submit();
+		}
+	}
+
+	void ChunkWriter::flush(){
+		if(mCurrent.size()) submit();
+		drain();
+	}
+
+	void ChunkWriter::submit(){
+		mWritten += mCurrent.size();
+		mPending.push_back(std::move(mCurrent));
+		if(mSpare.size()){
+			mCurrent = std::move(mSpare.back());
+			mSpare.pop_back();
+		} else {
+			mCurrent = std::vector<char>();
+			mCurrent.reserve(ExportChunkSize);
+		}
+		if(mPending.size() >= ExportMaxPending) drain();
+	}
+
+	void ChunkWriter::drain(){
+		std::vector<struct iovec> iov(mPending.size());
+		for(size_t i = 0; i < mPending.size(); ++i){
+			iov[i].iov_base = mPending[i].data();
+			iov[i].iov_len = mPending[i].size();
+		}
+		size_t first = 0;
+		while(mOk && first < iov.size()){
+			const ssize_t n = writev(mFd, &iov[first], (int)std::min(iov.size() - first, (size_t)IOV_MAX));
+			if(n < 0){
+				if(errno != EINTR) mOk = false;
+				continue;
+			}
+			// Short writes leave us part way through a buffer
+			size_t done = (size_t)n;
+			for(; first < iov.size() && done >= iov[first].iov_len; ++first) done -= iov[first].iov_len;
+			if(done){
+				iov[first].iov_base = static_cast<char*>(iov[first].iov_base) + done;
+				iov[first].iov_len -= done;
+			}
+		}
+		for(auto it = mPending.begin(); it != mPending.end(); ++it){
+			it->clear();
+			mSpare.push_back(std::move(*it));
+		}
+		mPending.clear();
+	}
+
+	namespace {
+		bool hostLittleEndian(){
+			const uint16_t probe = 1;
+			uint8_t first;
+			memcpy(&first, &probe, 1);
+			return first == 1;
+		}
+
+		size_t triangleCount(const LDMesh &mesh, bool cull){
+			return (mesh.indices.size() + (cull ? mesh.bfIndices.size() : mesh.indices.size())) / 3;
+		}
+
+		// Calls f(a, b, c) for each of the instance's triangles, back faces included, wound the way flatten would wind them
+		template<typename F> void forTriangles(const Instance &instance, F f){
+			const LDMesh &mesh = instance.model->getMesh();
+			const std::vector<uint32_t> &indices = mesh.indices;
+			for(size_t i = 0; i + 2 < indices.size(); i += 3){
+				if(instance.invert) f(indices[i], indices[i + 2], indices[i + 1]);
+				else f(indices[i], indices[i + 1], indices[i + 2]);
+			}
+			const std::vector<uint32_t> &back = instance.cull ? mesh.bfIndices : mesh.indices;
+			const bool reverse = instance.invert != !instance.cull;
+			for(size_t i = 0; i + 2 < back.size(); i += 3){
+				if(reverse) f(back[i], back[i + 2], back[i + 1]);
+				else f(back[i], back[i + 1], back[i + 2]);
+			}
+		}
+
+		// Each block of vertices is transformed into scratch, then handed to f(positions, first, count)
+		template<typename F> void forPositionBlocks(const Instance &instance, std::vector<Position> &scratch, F f){
+			const std::vector<Position> &positions = std::get<0>(instance.model->getMesh().attributes);
+			scratch.resize(ExportBlockVertices);
+			for(size_t begin = 0; begin < positions.size(); begin += ExportBlockVertices){
+				const size_t n = std::min(ExportBlockVertices, positions.size() - begin);
+				transformPositions(instance.transform, positions.data() + begin, n, scratch.data());
+				f(scratch.data(), begin, n);
+			}
+		}
+
+		// As RGBA. Codes the table knows nothing about come out mid grey, rather than transparent black.
+		uint32_t exportColour(const Palette &palette, uint32_t code){
+			boost::optional<uint32_t> rgba = palette.getColour(code);
+			return (rgba && *rgba) ? *rgba : 0x808080ff;
+		}
+
+		uint32_t vertexColour(const Instance &instance, size_t i){
+			const Palette &palette = instance.model->getPalette();
+			return exportColour(palette, palette.resolve(std::get<2>(instance.model->getMesh().attributes)[i], instance.colour));
+		}
+
+		uint32_t lineColour(const Instance &instance, size_t line){
+			const Palette &palette = instance.model->getPalette();
+			return exportColour(palette, palette.resolve(instance.model->getMesh().lineColours[line], instance.colour));
+		}
+
+		void putFloats(ChunkWriter &out, const Position &p){
+			const float f[] = {std::get<0>(p), std::get<1>(p), std::get<2>(p)};
+			out.write(f, sizeof(f));
+		}
+
+		void putRGBA(ChunkWriter &out, uint32_t rgba){
+			const uint8_t c[] = {(uint8_t)(rgba >> 24), (uint8_t)(rgba >> 16), (uint8_t)(rgba >> 8), (uint8_t)rgba};
+			out.write(c, sizeof(c));
+		}
+	}
+
+	ExportCounts countGeometry(const Model &model, const ExportOptions &options){
+		ExportCounts ret = {0, 0, 0};
+		model.visitInstances([&](const Instance &instance){
+			const LDMesh &mesh = instance.model->getMesh();
+			ret.vertices += mesh.vertexCount();
+			ret.triangles += triangleCount(mesh, instance.cull);
+			if(options.mLines) ret.lines += mesh.lineIndices.size() / 2;
+		}, options.mColour);
+		return ret;
+	}
+
+	bool writePLY(const Model &model, ChunkWriter &out, const ExportOptions &options){
+		const ExportCounts counts = countGeometry(model, options);
+		std::ostringstream header;
+		header << "ply" << std::endl
+		<< "format " << (hostLittleEndian() ? "binary_little_endian" : "binary_big_endian") << " 1.0" << std::endl
+		<< "comment " << model.getName() << std::endl
+		<< "element vertex " << counts.vertices << std::endl
+		<< "property float x" << std::endl << "property float y" << std::endl << "property float z" << std::endl;
+		if(options.mNormals) header << "property float nx" << std::endl << "property float ny" << std::endl << "property float nz" << std::endl;
+		header << "property uchar red" << std::endl << "property uchar green" << std::endl
+		<< "property uchar blue" << std::endl << "property uchar alpha" << std::endl
+		<< "element face " << counts.triangles << std::endl
+		<< "property list uchar uint vertex_indices" << std::endl;
+		if(options.mLines){
+			header << "element edge " << counts.lines << std::endl
+			<< "property uint vertex1" << std::endl << "property uint vertex2" << std::endl
+			<< "property uchar red" << std::endl << "property uchar green" << std::endl
+			<< "property uchar blue" << std::endl << "property uchar alpha" << std::endl;
+		}
+		header << "end_header" << std::endl;
+		const std::string headerText = header.str();
+		out.write(headerText.data(), headerText.size());
+
+		// PLY wants every vertex before any face, so we walk the tree once per element
+		std::vector<Position> scratch;
+		model.visitInstances([&](const Instance &instance){
+			const std::vector<Position> &normals = std::get<1>(instance.model->getMesh().attributes);
+			forPositionBlocks(instance, scratch, [&](const Position *positions, size_t first, size_t n){
+				for(size_t i = 0; i < n; ++i){
+					putFloats(out, positions[i]);
+					if(options.mNormals) putFloats(out, transformNormal(instance.transform, normals[first + i]));
+					putRGBA(out, vertexColour(instance, first + i));
+				}
+			});
+		}, options.mColour);
+
+		uint32_t base = 0;
+		model.visitInstances([&](const Instance &instance){
+			forTriangles(instance, [&](uint32_t a, uint32_t b, uint32_t c){
+				const uint8_t ct = 3;
+				const uint32_t tri[] = {base + a, base + b, base + c};
+				out.put(ct);
+				out.write(tri, sizeof(tri));
+			});
+			base += (uint32_t)instance.model->getMesh().vertexCount();
+		}, options.mColour);
+
+		if(options.mLines){
+			base = 0;
+			model.visitInstances([&](const Instance &instance){
+				const std::vector<uint32_t> &lineIndices = instance.model->getMesh().lineIndices;
+				for(size_t i = 0; i + 1 < lineIndices.size(); i += 2){
+					const uint32_t line[] = {base + lineIndices[i], base + lineIndices[i + 1]};
+					out.write(line, sizeof(line));
+					putRGBA(out, lineColour(instance, i / 2));
+				}
+				base += (uint32_t)instance.model->getMesh().vertexCount();
+			}, options.mColour);
+		}
+		out.flush();
+		return out.ok();
+	}
+
+	// OBJ indices are global but needn't come after every vertex, so one walk does it
+	bool writeOBJ(const Model &model, ChunkWriter &out, const ExportOptions &options){
+		char buf[128];
+		int len = snprintf(buf, sizeof(buf), "# %s\n", model.getName().c_str());
+		out.write(buf, std::min((size_t)len, sizeof(buf) - 1));
+
+		std::vector<Position> scratch;
+		size_t base = 1;
+		model.visitInstances([&](const Instance &instance){
+			const LDMesh &mesh = instance.model->getMesh();
+			const std::vector<Position> &normals = std::get<1>(mesh.attributes);
+			forPositionBlocks(instance, scratch, [&](const Position *positions, size_t first, size_t n){
+				for(size_t i = 0; i < n; ++i){
+					const uint32_t rgba = vertexColour(instance, first + i);
+					len = snprintf(buf, sizeof(buf), "v %g %g %g %g %g %g\n", std::get<0>(positions[i]), std::get<1>(positions[i]), std::get<2>(positions[i]),
+								   ((rgba >> 24) & 0xff) / 255.0, ((rgba >> 16) & 0xff) / 255.0, ((rgba >> 8) & 0xff) / 255.0);
+					out.write(buf, len);
+				}
+			});
+			if(options.mNormals){
+				for(size_t i = 0; i < normals.size(); ++i){
+					const Position n = transformNormal(instance.transform, normals[i]);
+					len = snprintf(buf, sizeof(buf), "vn %g %g %g\n", std::get<0>(n), std::get<1>(n), std::get<2>(n));
+					out.write(buf, len);
+				}
+			}
+			forTriangles(instance, [&](uint32_t a, uint32_t b, uint32_t c){
+				if(options.mNormals) len = snprintf(buf, sizeof(buf), "f %zu//%zu %zu//%zu %zu//%zu\n", base + a, base + a, base + b, base + b, base + c, base + c);
+				else len = snprintf(buf, sizeof(buf), "f %zu %zu %zu\n", base + a, base + b, base + c);
+				out.write(buf, len);
+			});
+			if(options.mLines){
+				for(size_t i = 0; i + 1 < mesh.lineIndices.size(); i += 2){
+					len = snprintf(buf, sizeof(buf), "l %zu %zu\n", base + mesh.lineIndices[i], base + mesh.lineIndices[i + 1]);
+					out.write(buf, len);
+				}
+			}
+			base += mesh.vertexCount();
+		}, options.mColour);
+		out.flush();
+		return out.ok();
+	}
+
+	namespace {
+		enum {
+			GLFloat = 5126, GLUnsignedByte = 5121, GLUnsignedInt = 5125,
+			GLArrayBuffer = 34962, GLElementArrayBuffer = 34963
+		};
+
+		// Everything that will share one glTF mesh. Without instancing, that's the whole model, and root is used.
+		struct GLBMesh {
+			const Model * model;
+			uint32_t colour;
+			bool invert;
+			bool cull;
+			ExportCounts counts;
+			AABB vertexBounds, lineBounds;
+			std::vector<TransMatrix> trs; // Placements for EXT_mesh_gpu_instancing
+			std::vector<TransMatrix> matrices; // Placements it can't express, each of which gets its own node
+		};
+
+		// Splits a transformation into translation, rotation (as x, y, z, w) and scale, if it is free of shear and mirroring
+		bool decomposeTRS(const TransMatrix &t, float trs[10]){
+			float s[3];
+			for(size_t j = 0; j < 3; ++j){
+				s[j] = std::sqrt(t(0, j) * t(0, j) + t(1, j) * t(1, j) + t(2, j) * t(2, j));
+				if(!(s[j] > 0.f)) return false;
+			}
+			for(size_t j = 0; j < 3; ++j){
+				for(size_t k = j + 1; k < 3; ++k){
+					const float dot = t(0, j) * t(0, k) + t(1, j) * t(1, k) + t(2, j) * t(2, k);
+					if(std::fabs(dot) > 1e-4f * s[j] * s[k]) return false;
+				}
+			}
+			if(!(determinant(t) > 0.f)) return false;
+			float r[3][3];
+			for(size_t i = 0; i < 3; ++i) for(size_t j = 0; j < 3; ++j) r[i][j] = t(i, j) / s[j];
+
+			float q[4]; // x, y, z, w
+			const float trace = r[0][0] + r[1][1] + r[2][2];
+			if(trace > 0.f){
+				const float k = 2.f * std::sqrt(trace + 1.f);
+				q[3] = 0.25f * k; q[0] = (r[2][1] - r[1][2]) / k; q[1] = (r[0][2] - r[2][0]) / k; q[2] = (r[1][0] - r[0][1]) / k;
+			} else if(r[0][0] > r[1][1] && r[0][0] > r[2][2]){
+				const float k = 2.f * std::sqrt(1.f + r[0][0] - r[1][1] - r[2][2]);
+				q[3] = (r[2][1] - r[1][2]) / k; q[0] = 0.25f * k; q[1] = (r[0][1] + r[1][0]) / k; q[2] = (r[0][2] + r[2][0]) / k;
+			} else if(r[1][1] > r[2][2]){
+				const float k = 2.f * std::sqrt(1.f + r[1][1] - r[0][0] - r[2][2]);
+				q[3] = (r[0][2] - r[2][0]) / k; q[0] = (r[0][1] + r[1][0]) / k; q[1] = 0.25f * k; q[2] = (r[1][2] + r[2][1]) / k;
+			} else {
+				const float k = 2.f * std::sqrt(1.f + r[2][2] - r[0][0] - r[1][1]);
+				q[3] = (r[1][0] - r[0][1]) / k; q[0] = (r[0][2] + r[2][0]) / k; q[1] = (r[1][2] + r[2][1]) / k; q[2] = 0.25f * k;
+			}
+			const float qn = 1.f / std::sqrt(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+			trs[0] = t(0, 3); trs[1] = t(1, 3); trs[2] = t(2, 3);
+			for(size_t i = 0; i < 4; ++i) trs[3 + i] = q[i] * qn;
+			trs[7] = s[0]; trs[8] = s[1]; trs[9] = s[2];
+			return true;
+		}
+
+		void extendBounds(const Instance &instance, AABB &vertexBounds, AABB &lineBounds, bool lines){
+			const LDMesh &mesh = instance.model->getMesh();
+			const std::vector<Position> &positions = std::get<0>(mesh.attributes);
+			extendTransformed(vertexBounds, instance.transform, instance.model->getPositionArrays());
+			if(lines){
+				for(auto it = mesh.lineIndices.begin(); it != mesh.lineIndices.end(); ++it) lineBounds.extend(applyTransform(instance.transform, positions[*it]));
+			}
+		}
+
+		// Accumulates bufferViews and accessors in the order their data will be written to the BIN chunk
+		class GLBLayout {
+			std::ostringstream mViews, mAccessors;
+			size_t mViewCt, mAccessorCt, mByteLength;
+		public:
+			GLBLayout() : mViewCt(0), mAccessorCt(0), mByteLength(0) { mAccessors.precision(9); } // Enough to round-trip the bounds
+
+			size_t byteLength() const { return mByteLength; }
+			std::string views() const { return mViews.str(); }
+			std::string accessors() const { return mAccessors.str(); }
+
+			// Returns the accessor's index. Every element size we use is a multiple of 4, so views never need padding.
+			size_t add(size_t count, int componentType, const char *type, size_t elementSize, int target, bool normalized = false, const AABB *bounds = nullptr){
+				mViews << (mViewCt ? "," : "") << "{\"buffer\":0,\"byteOffset\":" << mByteLength << ",\"byteLength\":" << count * elementSize;
+				if(target) mViews << ",\"target\":" << target;
+				mViews << "}";
+				mByteLength += count * elementSize;
+
+				mAccessors << (mAccessorCt ? "," : "") << "{\"bufferView\":" << mViewCt << ",\"componentType\":" << componentType
+				<< ",\"count\":" << count << ",\"type\":\"" << type << "\"";
+				if(normalized) mAccessors << ",\"normalized\":true";
+				if(bounds){
+					mAccessors << ",\"min\":[" << bounds->lo[0] << "," << bounds->lo[1] << "," << bounds->lo[2] << "]"
+					<< ",\"max\":[" << bounds->hi[0] << "," << bounds->hi[1] << "," << bounds->hi[2] << "]";
+				}
+				mAccessors << "}";
+				++mViewCt;
+				return mAccessorCt++;
+			}
+		};
+
+		// Writes the sections of one GLBMesh, in the order describeMesh laid them out, by walking instances with f
+		template<typename VisitF> void writeMeshData(ChunkWriter &out, const GLBMesh &mesh, const ExportOptions &options, VisitF visit){
+			std::vector<Position> scratch;
+			if(mesh.counts.triangles){
+				visit([&](const Instance &instance){
+					forPositionBlocks(instance, scratch, [&](const Position *positions, size_t, size_t n){
+						for(size_t i = 0; i < n; ++i) putFloats(out, positions[i]);
+					});
+				});
+				if(options.mNormals){
+					visit([&](const Instance &instance){
+						const std::vector<Position> &normals = std::get<1>(instance.model->getMesh().attributes);
+						for(auto it = normals.begin(); it != normals.end(); ++it) putFloats(out, transformNormal(instance.transform, *it));
+					});
+				}
+				visit([&](const Instance &instance){
+					const size_t n = instance.model->getMesh().vertexCount();
+					for(size_t i = 0; i < n; ++i) putRGBA(out, vertexColour(instance, i));
+				});
+				uint32_t base = 0;
+				visit([&](const Instance &instance){
+					forTriangles(instance, [&](uint32_t a, uint32_t b, uint32_t c){
+						const uint32_t tri[] = {base + a, base + b, base + c};
+						out.write(tri, sizeof(tri));
+					});
+					base += (uint32_t)instance.model->getMesh().vertexCount();
+				});
+			}
+			if(mesh.counts.lines){
+				// Lines carry their own colours, so their ends are written out separately from the faces' vertices
+				visit([&](const Instance &instance){
+					const LDMesh &data = instance.model->getMesh();
+					const std::vector<Position> &positions = std::get<0>(data.attributes);
+					for(auto it = data.lineIndices.begin(); it != data.lineIndices.end(); ++it) putFloats(out, applyTransform(instance.transform, positions[*it]));
+				});
+				visit([&](const Instance &instance){
+					const size_t n = instance.model->getMesh().lineColours.size();
+					for(size_t i = 0; i < n; ++i){
+						const uint32_t rgba = lineColour(instance, i);
+						putRGBA(out, rgba);
+						putRGBA(out, rgba);
+					}
+				});
+			}
+		}
+
+		// Returns the mesh's JSON, or nothing if it has nothing to draw
+		std::string describeMesh(GLBLayout &layout, const GLBMesh &mesh, const ExportOptions &options){
+			std::ostringstream ret;
+			if(mesh.counts.triangles){
+				const size_t position = layout.add(mesh.counts.vertices, GLFloat, "VEC3", 12, GLArrayBuffer, false, &mesh.vertexBounds);
+				const size_t normal = options.mNormals ? layout.add(mesh.counts.vertices, GLFloat, "VEC3", 12, GLArrayBuffer) : 0;
+				const size_t colour = layout.add(mesh.counts.vertices, GLUnsignedByte, "VEC4", 4, GLArrayBuffer, true);
+				const size_t indices = layout.add(3 * mesh.counts.triangles, GLUnsignedInt, "SCALAR", 4, GLElementArrayBuffer);
+				ret << "{\"attributes\":{\"POSITION\":" << position;
+				if(options.mNormals) ret << ",\"NORMAL\":" << normal;
+				ret << ",\"COLOR_0\":" << colour << "},\"indices\":" << indices << ",\"mode\":4}";
+			}
+			if(mesh.counts.lines){
+				const size_t position = layout.add(2 * mesh.counts.lines, GLFloat, "VEC3", 12, GLArrayBuffer, false, &mesh.lineBounds);
+				const size_t colour = layout.add(2 * mesh.counts.lines, GLUnsignedByte, "VEC4", 4, GLArrayBuffer, true);
+				ret << (mesh.counts.triangles ? "," : "") << "{\"attributes\":{\"POSITION\":" << position << ",\"COLOR_0\":" << colour << "},\"mode\":1}";
+			}
+			const std::string primitives = ret.str();
+			return primitives.empty() ? primitives : "{\"primitives\":[" + primitives + "]}";
+		}
+	}
+
+	/*
+	 * Coordinates are written as they are, in LDU with -Y up. glTF flips the winding of anything placed by a mirroring
+	 * transformation by itself, so instanced meshes are keyed on their winding with the determinant's sign taken back out.
+	 * The extension can't express mirroring or shear, so placements with either get a node (and matrix) of their own.
+	 */
+	bool writeGLB(const Model &model, ChunkWriter &out, const ExportOptions &options){
+		if(!hostLittleEndian()) return false; // The BIN chunk is written straight from memory
+
+		std::vector<GLBMesh> meshes;
+		if(options.mInstancing){
+			std::map<std::tuple<const Model*, uint32_t, bool, bool>, size_t> groups;
+			model.visitInstances([&](const Instance &instance){
+				const LDMesh &data = instance.model->getMesh();
+				if(!triangleCount(data, instance.cull) && !(options.mLines && data.lineIndices.size())) return;
+				const bool invert = instance.invert != (determinant(instance.transform) < 0.f);
+				auto key = std::make_tuple(instance.model, instance.colour, invert, instance.cull);
+				auto groupIt = groups.find(key);
+				if(groupIt == groups.end()){
+					groupIt = groups.insert(std::make_pair(key, meshes.size())).first;
+					GLBMesh mesh;
+					mesh.model = instance.model;
+					mesh.colour = instance.colour;
+					mesh.invert = invert;
+					mesh.cull = instance.cull;
+					mesh.counts = {data.vertexCount(), triangleCount(data, instance.cull), options.mLines ? data.lineIndices.size() / 2 : 0};
+					extendBounds(Instance{instance.model, identityTransform(), instance.colour, invert, instance.cull}, mesh.vertexBounds, mesh.lineBounds, options.mLines);
+					meshes.push_back(mesh);
+				}
+				float trs[10];
+				GLBMesh &mesh = meshes[groupIt->second];
+				(decomposeTRS(instance.transform, trs) ? mesh.trs : mesh.matrices).push_back(instance.transform);
+			}, options.mColour);
+		} else {
+			GLBMesh mesh;
+			mesh.model = &model;
+			mesh.colour = options.mColour;
+			mesh.invert = false;
+			mesh.cull = true;
+			mesh.counts = countGeometry(model, options);
+			model.visitInstances([&](const Instance &instance){ extendBounds(instance, mesh.vertexBounds, mesh.lineBounds, options.mLines); }, options.mColour);
+			mesh.matrices.push_back(identityTransform());
+			meshes.push_back(mesh);
+		}
+
+		GLBLayout layout;
+		std::ostringstream meshJSON, nodeJSON, sceneJSON;
+		nodeJSON.precision(9);
+		size_t meshCt = 0, nodeCt = 0;
+		bool instanced = false;
+		for(auto it = meshes.begin(); it != meshes.end(); ++it){
+			const std::string description = describeMesh(layout, *it, options);
+			if(description.empty()) continue;
+			meshJSON << (meshCt ? "," : "") << description;
+			if(it->trs.size()){
+				const size_t n = it->trs.size();
+				const size_t translation = layout.add(n, GLFloat, "VEC3", 12, 0);
+				const size_t rotation = layout.add(n, GLFloat, "VEC4", 16, 0);
+				const size_t scale = layout.add(n, GLFloat, "VEC3", 12, 0);
+				nodeJSON << (nodeCt ? "," : "") << "{\"mesh\":" << meshCt << ",\"extensions\":{\"EXT_mesh_gpu_instancing\":{\"attributes\":{"
+				<< "\"TRANSLATION\":" << translation << ",\"ROTATION\":" << rotation << ",\"SCALE\":" << scale << "}}}}";
+				sceneJSON << (nodeCt ? "," : "") << nodeCt;
+				++nodeCt;
+				instanced = true;
+			}
+			for(auto mIt = it->matrices.begin(); mIt != it->matrices.end(); ++mIt){
+				const TransMatrix &t = *mIt;
+				nodeJSON << (nodeCt ? "," : "") << "{\"mesh\":" << meshCt;
+				if(t != identityTransform()){
+					nodeJSON << ",\"matrix\":[" << t(0, 0) << "," << t(1, 0) << "," << t(2, 0) << ",0," << t(0, 1) << "," << t(1, 1) << "," << t(2, 1) << ",0,"
+					<< t(0, 2) << "," << t(1, 2) << "," << t(2, 2) << ",0," << t(0, 3) << "," << t(1, 3) << "," << t(2, 3) << ",1]";
+				}
+				nodeJSON << "}";
+				sceneJSON << (nodeCt ? "," : "") << nodeCt;
+				++nodeCt;
+			}
+			++meshCt;
+		}
+
+		std::ostringstream json;
+		json << "{\"asset\":{\"version\":\"2.0\",\"generator\":\"LDParse\"}";
+		if(instanced) json << ",\"extensionsUsed\":[\"EXT_mesh_gpu_instancing\"],\"extensionsRequired\":[\"EXT_mesh_gpu_instancing\"]";
+		json << ",\"scene\":0,\"scenes\":[{\"nodes\":[" << sceneJSON.str() << "]}]";
+		if(meshCt){
+			json << ",\"nodes\":[" << nodeJSON.str() << "],\"meshes\":[" << meshJSON.str() << "]"
+			<< ",\"buffers\":[{\"byteLength\":" << layout.byteLength() << "}]"
+			<< ",\"bufferViews\":[" << layout.views() << "],\"accessors\":[" << layout.accessors() << "]";
+		}
+		json << "}";
+		const std::string jsonText = json.str();
+		const uint32_t jsonPadded = (uint32_t)((jsonText.size() + 3) & ~(size_t)3);
+		const uint32_t binLength = (uint32_t)layout.byteLength();
+
+		const uint32_t header[] = {0x46546C67, 2, 12 + 8 + jsonPadded + (binLength ? 8 + binLength : 0)}; // "glTF"
+		const uint32_t jsonHeader[] = {jsonPadded, 0x4E4F534A}; // "JSON"
+		out.write(header, sizeof(header));
+		out.write(jsonHeader, sizeof(jsonHeader));
+		out.write(jsonText.data(), jsonText.size());
+		out.fill(' ', jsonPadded - jsonText.size());
+		if(binLength){
+			const uint32_t binHeader[] = {binLength, 0x004E4942}; // "BIN"
+			out.write(binHeader, sizeof(binHeader));
+			for(auto it = meshes.begin(); it != meshes.end(); ++it){
+				const GLBMesh &mesh = *it;
+				if(!mesh.counts.triangles && !mesh.counts.lines) continue;
+				if(options.mInstancing){
+					const Instance local = {mesh.model, identityTransform(), mesh.colour, mesh.invert, mesh.cull};
+					writeMeshData(out, mesh, options, [&](const std::function<void(const Instance&)> &f){ f(local); });
+					float trs[10];
+					for(size_t part = 0; part < 3 && mesh.trs.size(); ++part){
+						const size_t begin = (part == 0) ? 0 : (part == 1) ? 3 : 7, end = (part == 0) ? 3 : (part == 1) ? 7 : 10;
+						for(auto tIt = mesh.trs.begin(); tIt != mesh.trs.end(); ++tIt){
+							decomposeTRS(*tIt, trs);
+							out.write(trs + begin, (end - begin) * sizeof(float));
+						}
+					}
+				} else {
+					writeMeshData(out, mesh, options, [&](const std::function<void(const Instance&)> &f){ model.visitInstances(f, options.mColour); });
+				}
+			}
+		}
+		out.flush();
+		return out.ok();
+	}
+
+	bool writePLY(const Model &model, const std::string &path, const ExportOptions &options){
+		ChunkWriter out(path);
+		return out.ok() && writePLY(model, out, options);
+	}
+
+	bool writeOBJ(const Model &model, const std::string &path, const ExportOptions &options){
+		ChunkWriter out(path);
+		return out.ok() && writeOBJ(model, out, options);
+	}
+
+	bool writeGLB(const Model &model, const std::string &path, const ExportOptions &options){
+		ChunkWriter out(path);
+		return out.ok() && writeGLB(model, out, options);
+	}
+}
@@ -0,0 +1,296 @@
+//
+//  FileLoader.cpp
+//  LDParse
+//
+//  Created by Thomas Dickerson on 2/5/16.
+//  Copyright © 2016 StickFigure Graphic Productions. All rights reserved.
+//
+
+#include <LDParse/FileLoader.hpp>
+#include <LDParse/Parallel.hpp>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <atomic>
+#include <cctype>
+
+#ifdef LDPARSE_WITH_IO_URING
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include <cstring>
+#endif
+
+namespace LDParse {
+	FileContents BufferPool::acquire(size_t capacity){
+		std::unique_ptr<std::vector<char> > buffer;
+		{
+			std::lock_guard<std::mutex> lock(mLock);
+			if(mFree.size()){
+				buffer = std::move(mFree.back());
+				mFree.pop_back();
+			}
+		}
+		if(!buffer) buffer.reset(new std::vector<char>());
+		buffer->clear();
+		buffer->reserve(capacity);
+		std::weak_ptr<BufferPool> pool = shared_from_this();
+		return FileContents(buffer.release(), [pool](std::vector<char> * b){
+			std::shared_ptr<BufferPool> owner = pool.lock();
+			if(owner) owner->release(b);
+			else delete b;
+		});
+	}
+
+	void BufferPool::release(std::vector<char> * buffer){
+		std::lock_guard<std::mutex> lock(mLock);
+		if(mFree.size() < mMaxFree) mFree.push_back(std::unique_ptr<std::vector<char> >(buffer));
+		else delete buffer;
+	}
+
+	FileLoader::FileLoader(size_t queueDepth, size_t threads)
+	: mPool(std::make_shared<BufferPool>(queueDepth)), mQueueDepth(queueDepth ? queueDepth : 1), mThreads(threads),
+#ifdef LDPARSE_WITH_IO_URING
+	mUseRing(true)
+#else
+	mUseRing(false)
+#endif
+	{ }
+
+	void FileLoader::load(const std::vector<std::string> &paths, const DoneF &done){
+		size_t begin = 0;
+#ifdef LDPARSE_WITH_IO_URING
+		if(mUseRing && !loadWithRing(paths, begin, done)) mUseRing = false; // Not allowed here (e.g. seccomp), or too old a kernel
+#endif
+		if(begin < paths.size()) loadWithThreads(paths, begin, done);
+	}
+
+	void FileLoader::loadWithThreads(const std::vector<std::string> &paths, size_t begin, const DoneF &done){
+		Parallel::forChunks(paths.size() - begin, 1, [&](size_t first, size_t last){
+			for(size_t i = begin + first; i < begin + last; ++i){
+				const int fd = open(paths[i].c_str(), O_RDONLY | O_CLOEXEC);
+				struct stat st;
+				if(fd < 0 || fstat(fd, &st)){
+					const int error = errno;
+					if(fd >= 0) close(fd);
+					done(i, paths[i], nullptr, error);
+					continue;
+				}
+				FileContents contents = mPool->acquire(st.st_size);
+				contents->resize(st.st_size);
+				size_t have = 0;
+				int error = 0;
+				while(have < contents->size()){
+					const ssize_t got = pread(fd, contents->data() + have, contents->size() - have, have);
+					if(got < 0 && errno == EINTR) continue;
+					if(got <= 0){
+						if(got < 0) error = errno;
+						break;
+					}
+					have += got;
+				}
+				close(fd);
+				contents->resize(have);
+				done(i, paths[i], error ? nullptr : contents, error);
+			}
+		}, mThreads);
+	}
+
+#ifdef LDPARSE_WITH_IO_URING
+	namespace {
+		// Just enough of an io_uring for batches of open/read/close, without liburing
+		class Ring {
+			int mFd;
+			void * mSqMap;
+			void * mCqMap;
+			size_t mSqMapSize, mCqMapSize;
+			io_uring_sqe * mSqes;
+			size_t mSqesSize;
+			unsigned *mSqHead, *mSqTail, *mSqMask, *mSqArray;
+			unsigned *mCqHead, *mCqTail, *mCqMask;
+			io_uring_cqe * mCqes;
+			unsigned mPending;
+		public:
+			Ring() : mFd(-1), mSqMap(MAP_FAILED), mCqMap(MAP_FAILED), mSqes((io_uring_sqe *)MAP_FAILED), mPending(0) {}
+			~Ring(){
+				if(mSqes != MAP_FAILED) munmap(mSqes, mSqesSize);
+				if(mCqMap != MAP_FAILED && mCqMap != mSqMap) munmap(mCqMap, mCqMapSize);
+				if(mSqMap != MAP_FAILED) munmap(mSqMap, mSqMapSize);
+				if(mFd >= 0) close(mFd);
+			}
+
+			bool init(unsigned entries){
+				io_uring_params params;
+				memset(&params, 0, sizeof(params));
+				mFd = (int)syscall(__NR_io_uring_setup, entries, &params);
+				if(mFd < 0) return false;
+				mSqMapSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+				mCqMapSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+				const bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+				if(single) mSqMapSize = mCqMapSize = std::max(mSqMapSize, mCqMapSize);
+				mSqMap = mmap(nullptr, mSqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, mFd, IORING_OFF_SQ_RING);
+				if(mSqMap == MAP_FAILED) return false;
+				mCqMap = single ? mSqMap : mmap(nullptr, mCqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, mFd, IORING_OFF_CQ_RING);
+				if(mCqMap == MAP_FAILED) return false;
+				mSqesSize = params.sq_entries * sizeof(io_uring_sqe);
+				mSqes = (io_uring_sqe *)mmap(nullptr, mSqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, mFd, IORING_OFF_SQES);
+				if(mSqes == MAP_FAILED) return false;
+
+				char * sq = (char *)mSqMap, * cq = (char *)mCqMap;
+				mSqHead = (unsigned *)(sq + params.sq_off.head);
+				mSqTail = (unsigned *)(sq + params.sq_off.tail);
+				mSqMask = (unsigned *)(sq + params.sq_off.ring_mask);
+				mSqArray = (unsigned *)(sq + params.sq_off.array);
+				mCqHead = (unsigned *)(cq + params.cq_off.head);
+				mCqTail = (unsigned *)(cq + params.cq_off.tail);
+				mCqMask = (unsigned *)(cq + params.cq_off.ring_mask);
+				mCqes = (io_uring_cqe *)(cq + params.cq_off.cqes);
+				return true;
+			}
+
+			io_uring_sqe& push(uint8_t opcode, int fd, uint64_t userData){
+				// The kernel only sees it once run() moves the tail past it
+				const unsigned index = (*mSqTail + mPending++) & *mSqMask;
+				io_uring_sqe &sqe = mSqes[index];
+				memset(&sqe, 0, sizeof(sqe));
+				sqe.opcode = opcode;
+				sqe.fd = fd;
+				sqe.user_data = userData;
+				mSqArray[index] = index;
+				return sqe;
+			}
+
+			// Submits everything pushed, and waits for all of it to complete
+			template<typename F> bool run(F f){
+				unsigned submitted = 0;
+				const unsigned wanted = mPending;
+				__atomic_store_n(mSqTail, *mSqTail + wanted, __ATOMIC_RELEASE);
+				while(submitted < wanted){
+					const int ret = (int)syscall(__NR_io_uring_enter, mFd, wanted - submitted, wanted - submitted, IORING_ENTER_GETEVENTS, nullptr, 0);
+					if(ret < 0){
+						if(errno == EINTR) continue;
+						return false;
+					}
+					submitted += ret;
+				}
+				mPending = 0;
+				unsigned reaped = 0;
+				while(reaped < wanted){
+					unsigned head = *mCqHead;
+					const unsigned tail = __atomic_load_n(mCqTail, __ATOMIC_ACQUIRE);
+					if(head == tail){
+						if(syscall(__NR_io_uring_enter, mFd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0 && errno != EINTR) return false;
+						continue;
+					}
+					for(; head != tail; ++head, ++reaped){
+						const io_uring_cqe &cqe = mCqes[head & *mCqMask];
+						f(cqe.user_data, cqe.res);
+					}
+					__atomic_store_n(mCqHead, head, __ATOMIC_RELEASE);
+				}
+				return true;
+			}
+		};
+	}
+
+	// Each batch takes three rounds through the ring (open, read, close), plus a read round for any file that outgrew its buffer
+	bool FileLoader::loadWithRing(const std::vector<std::string> &paths, size_t &begin, const DoneF &done){
+		Ring ring;
+		if(!ring.init((unsigned)mQueueDepth)) return false;
+
+		while(begin < paths.size()){
+			const size_t batch = std::min(mQueueDepth, paths.size() - begin);
+			std::vector<int> fds(batch, -1), errors(batch, 0);
+			std::vector<FileContents> contents(batch);
+			std::vector<size_t> have(batch, 0);
+			// If the ring gives out before the close round, whatever it opened is closed here, and the threads retry the batch
+			const auto abandon = [&](){
+				for(size_t i = 0; i < batch; ++i) if(fds[i] >= 0) close(fds[i]);
+				return false;
+			};
+
+			for(size_t i = 0; i < batch; ++i){
+				io_uring_sqe &sqe = ring.push(IORING_OP_OPENAT, AT_FDCWD, i);
+				sqe.addr = (uint64_t)(uintptr_t)paths[begin + i].c_str();
+				sqe.open_flags = O_RDONLY | O_CLOEXEC;
+			}
+			bool unsupported = false;
+			if(!ring.run([&](uint64_t i, int res){
+				if(res >= 0) fds[i] = res;
+				else if(res == -EINVAL || res == -EOPNOTSUPP) unsupported = true;
+				else errors[i] = -res;
+			}) || unsupported) return abandon();
+
+			std::vector<size_t> reading;
+			for(size_t i = 0; i < batch; ++i){
+				if(fds[i] < 0) continue;
+				contents[i] = mPool->acquire(InitialLoadBufferSize);
+				contents[i]->resize(std::max(contents[i]->capacity(), InitialLoadBufferSize));
+				reading.push_back(i);
+			}
+			while(reading.size()){
+				for(auto it = reading.begin(); it != reading.end(); ++it){
+					io_uring_sqe &sqe = ring.push(IORING_OP_READ, fds[*it], *it);
+					sqe.addr = (uint64_t)(uintptr_t)(contents[*it]->data() + have[*it]);
+					sqe.len = (unsigned)(contents[*it]->size() - have[*it]);
+					sqe.off = have[*it];
+				}
+				std::vector<size_t> again;
+				if(!ring.run([&](uint64_t i, int res){
+					if(res < 0){
+						if(res == -EINTR || res == -EAGAIN) again.push_back(i);
+						else errors[i] = -res;
+					} else if(res > 0){
+						have[i] += res;
+						// Filled it, so there may be more; anything less was the end of the file
+						if(have[i] == contents[i]->size()){
+							contents[i]->resize(2 * have[i]);
+							again.push_back(i);
+						}
+					}
+				})) return abandon();
+				reading.swap(again);
+			}
+
+			for(size_t i = 0; i < batch; ++i) if(fds[i] >= 0) ring.push(IORING_OP_CLOSE, fds[i], i);
+			// Not abandon(): a close the ring didn't report may still have happened, and closing again could hit a reused fd
+			if(!ring.run([](uint64_t, int){})) return false;
+
+			for(size_t i = 0; i < batch; ++i){
+				if(contents[i]) contents[i]->resize(have[i]);
+				const bool ok = fds[i] >= 0 && !errors[i];
+				done(begin + i, paths[begin + i], ok ? contents[i] : nullptr, errors[i]);
+			}
+			begin += batch;
+		}
+		return true;
+	}
+#endif
+
+	void scanIncludes(const char * data, size_t size, std::vector<std::string> &names){
+		const char * const end = data + size;
+		const char * line = data;
+		while(line < end){
+			const char * eol = line;
+			while(eol < end && *eol != '\n' && *eol != '\r') ++eol;
+
+			// A type 1 line is "1 colour x y z a b c d e f g h i name", where the name may contain spaces
+			const char * it = line;
+			while(it < eol && std::isspace((unsigned char)*it)) ++it;
+			if(it + 1 < eol && *it == '1' && std::isspace((unsigned char)it[1])){
+				size_t field = 0;
+				while(it < eol && field < 14){
+					while(it < eol && !std::isspace((unsigned char)*it)) ++it;
+					while(it < eol && std::isspace((unsigned char)*it)) ++it;
+					++field;
+				}
+				const char * nameEnd = eol;
+				while(nameEnd > it && std::isspace((unsigned char)nameEnd[-1])) --nameEnd;
+				if(field == 14 && it < nameEnd) names.push_back(std::string(it, nameEnd));
+			}
+			line = eol + 1;
+		}
+	}
+}
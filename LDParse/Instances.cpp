@@ -0,0 +1,104 @@
+//
+//  Instances.cpp
+//  LDParse
+//
+//  Created by Thomas Dickerson on 2/10/16.
+//  Copyright © 2016 StickFigure Graphic Productions. All rights reserved.
+//
+
+#include <LDParse/Instances.hpp>
+#include <LDParse/Parallel.hpp>
+
+#include <unordered_map>
+
+namespace LDParse {
+	namespace {
+		// Instances in model's subtree, itself included. Shared submodels are only counted once.
+		size_t subtreeSize(const Model &model, std::unordered_map<const Model *, size_t> &sizes){
+			auto it = sizes.find(&model);
+			if(it != sizes.end()) return it->second;
+			size_t ret = 1;
+			const std::vector<Model::ChildType> &children = model.getChildren();
+			for(auto cIt = children.begin(); cIt != children.end(); ++cIt){
+				if(std::get<3>(*cIt)) ret += subtreeSize(*std::get<3>(*cIt), sizes);
+			}
+			sizes[&model] = ret;
+			return ret;
+		}
+
+		int8_t sign(float f){ return (f > 0) - (f < 0); }
+	}
+
+	InstanceTable::InstanceTable(const Model &root, uint32_t colour, size_t threads){
+		std::unordered_map<const Model *, size_t> sizes;
+		const size_t total = subtreeSize(root, sizes);
+		mModels.resize(total);
+		mParents.resize(total);
+		mEnds.resize(total);
+		mColours.resize(total);
+		mLocal.resize(total);
+		mWorld.resize(total);
+		mSigns.resize(total);
+
+		mModels[0] = &root;
+		mParents[0] = NoParent;
+		mEnds[0] = (uint32_t)total;
+		mColours[0] = colour;
+		mLocal[0] = identityTransform();
+		compose(0);
+
+		// Each of the root's children knows where its subtree starts before any of them are filled, so they can be filled in any order
+		const std::vector<Model::ChildType> &children = root.getChildren();
+		std::vector<uint32_t> offsets(children.size());
+		uint32_t next = 1;
+		for(size_t k = 0; k < children.size(); ++k){
+			offsets[k] = next;
+			if(std::get<3>(children[k])) next += (uint32_t)sizes[std::get<3>(children[k])];
+		}
+		const Palette &palette = root.getPalette();
+		auto fillChildren = [&](size_t begin, size_t end){
+			for(size_t k = begin; k < end; ++k){
+				const Model * child = std::get<3>(children[k]);
+				if(child) fill(*child, offsets[k], 0, std::get<2>(children[k]), palette.resolve((uint32_t)std::get<0>(children[k]), colour));
+			}
+		};
+		if(total < SerialInstanceLimit) fillChildren(0, children.size());
+		else Parallel::forChunks(children.size(), 1, fillChildren, threads);
+	}
+
+	uint32_t InstanceTable::fill(const Model &model, uint32_t index, uint32_t parent, const TransMatrix &local, uint32_t colour){
+		mModels[index] = &model;
+		mParents[index] = parent;
+		mColours[index] = colour;
+		mLocal[index] = local;
+		compose(index);
+
+		uint32_t next = index + 1;
+		const std::vector<Model::ChildType> &children = model.getChildren();
+		const Palette &palette = model.getPalette();
+		for(auto it = children.begin(); it != children.end(); ++it){
+			const Model * child = std::get<3>(*it);
+			if(child) next = fill(*child, next, index, std::get<2>(*it), palette.resolve((uint32_t)std::get<0>(*it), colour));
+		}
+		mEnds[index] = next;
+		return next;
+	}
+
+	void InstanceTable::compose(uint32_t index){
+		const uint32_t parent = mParents[index];
+		const int8_t localSign = sign(determinant(mLocal[index]));
+		if(parent == NoParent){
+			mWorld[index] = mLocal[index];
+			mSigns[index] = localSign;
+		} else {
+			mWorld[index] = composeTransforms(mWorld[parent], mLocal[index]);
+			mSigns[index] = mSigns[parent] * localSign;
+		}
+	}
+
+	void InstanceTable::setLocal(size_t index, const TransMatrix &local){
+		mLocal[index] = local;
+		// Parents come before their children, so one pass in order sees every parent already recomposed
+		for(size_t i = index; i < mEnds[index]; ++i) compose((uint32_t)i);
+	}
+}
@@ -0,0 +1,212 @@
+//
+//  Interference.cpp
+//  LDParse
+//
+//  Created by Thomas Dickerson on 1/30/16.
+//  Copyright © 2016 StickFigure Graphic Productions. All rights reserved.
+//
+
+#include <LDParse/Interference.hpp>
+#include <LDParse/Parallel.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+
+namespace LDParse {
+	namespace {
+		// Parts embedded in an MPD look like any other submodel, so anything that includes nothing counts as well
+		bool isPart(const Model &model){
+			return model.getSrcType() < ModelT || model.getChildren().empty();
+		}
+
+		void collectFrom(const Model &model, const TransMatrix &transform, std::vector<PartInstance> &out){
+			if(isPart(model)){
+				out.push_back({&model, transform, model.getExactBounds().transformed(transform)});
+				return;
+			}
+			const std::vector<Model::ChildType> &children = model.getChildren();
+			for(auto it = children.begin(); it != children.end(); ++it){
+				const Model * child = std::get<3>(*it);
+				if(child != nullptr) collectFrom(*child, composeTransforms(transform, std::get<2>(*it)), out);
+			}
+		}
+
+		// A part's front faces, flattened once into its own frame
+		struct PartMesh {
+			PositionArrays positions;
+			std::vector<uint32_t> indices;
+		};
+
+		struct Vec { float x, y, z; };
+		inline Vec vec(const Position &p){ return {std::get<0>(p), std::get<1>(p), std::get<2>(p)}; }
+		inline Vec sub(const Vec &a, const Vec &b){ return {a.x - b.x, a.y - b.y, a.z - b.z}; }
+		inline Vec cross(const Vec &a, const Vec &b){ return {a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x}; }
+		inline float dot(const Vec &a, const Vec &b){ return a.x * b.x + a.y * b.y + a.z * b.z; }
+
+		// Signed distances of t's corners from the plane through p, snapped to 0 within tolerance.
+		// Returns false unless some corner lies clearly on each side.
+		bool straddles(const Vec p[3], const Vec t[3], float tolerance, float d[3]){
+			Vec n = cross(sub(p[1], p[0]), sub(p[2], p[0]));
+			const float len = std::sqrt(dot(n, n));
+			if(!(len > 0.f)) return false; // Degenerate
+			n = {n.x / len, n.y / len, n.z / len};
+			bool above = false, below = false;
+			for(size_t i = 0; i < 3; ++i){
+				d[i] = dot(n, sub(t[i], p[0]));
+				if(std::fabs(d[i]) <= tolerance) d[i] = 0.f;
+				above |= d[i] > 0.f;
+				below |= d[i] < 0.f;
+			}
+			return above && below;
+		}
+
+		// Where the triangle crosses its neighbour's plane, as an interval along axis
+		void crossing(const Vec t[3], const float d[3], const Vec &axis, float &lo, float &hi){
+			lo = std::numeric_limits<float>::infinity();
+			hi = -lo;
+			for(size_t i = 0; i < 3; ++i){
+				const size_t j = (i + 1) % 3;
+				float s;
+				if(d[i] == 0.f) s = dot(axis, t[i]);
+				else if((d[i] < 0.f) != (d[j] < 0.f) && d[j] != 0.f) s = dot(axis, t[i]) + (dot(axis, t[j]) - dot(axis, t[i])) * d[i] / (d[i] - d[j]);
+				else continue;
+				lo = std::min(lo, s);
+				hi = std::max(hi, s);
+			}
+		}
+
+		AABB triangleBounds(const PositionArrays &positions, const uint32_t *tri){
+			AABB ret;
+			ret.extend(positions[tri[0]]).extend(positions[tri[1]]).extend(positions[tri[2]]);
+			return ret;
+		}
+
+		// Transforms the part into scratch, and lists the triangles that reach into region
+		void gatherTriangles(const PartMesh &mesh, const TransMatrix &transform, const AABB &region,
+							 PositionArrays &scratch, std::vector<uint32_t> &triangles, std::vector<AABB> &bounds){
+			transformPositions(transform, mesh.positions, scratch);
+			triangles.clear();
+			bounds.clear();
+			for(size_t i = 0; i + 2 < mesh.indices.size(); i += 3){
+				const AABB b = triangleBounds(scratch, &mesh.indices[i]);
+				if(b.overlaps(region)){
+					triangles.push_back((uint32_t)i);
+					bounds.push_back(b);
+				}
+			}
+		}
+
+		struct Scratch {
+			PositionArrays positions[2];
+			std::vector<uint32_t> triangles[2];
+			std::vector<AABB> bounds[2];
+		};
+
+		bool instancesInterfere(const PartInstance &a, const PartInstance &b, const PartMesh &meshA, const PartMesh &meshB, float tolerance, Scratch &s){
+			if(a.part == b.part && a.transform == b.transform) return true; // A duplicate, which no face test will find
+			AABB region;
+			for(size_t axis = 0; axis < 3; ++axis){
+				region.lo[axis] = std::max(a.bounds.lo[axis], b.bounds.lo[axis]);
+				region.hi[axis] = std::min(a.bounds.hi[axis], b.bounds.hi[axis]);
+			}
+			gatherTriangles(meshA, a.transform, region, s.positions[0], s.triangles[0], s.bounds[0]);
+			if(s.triangles[0].empty()) return false;
+			gatherTriangles(meshB, b.transform, region, s.positions[1], s.triangles[1], s.bounds[1]);
+
+			for(size_t i = 0; i < s.triangles[0].size(); ++i){
+				const uint32_t *ta = &meshA.indices[s.triangles[0][i]];
+				const Position pa[] = {s.positions[0][ta[0]], s.positions[0][ta[1]], s.positions[0][ta[2]]};
+				for(size_t j = 0; j < s.triangles[1].size(); ++j){
+					if(!s.bounds[0][i].overlaps(s.bounds[1][j])) continue;
+					const uint32_t *tb = &meshB.indices[s.triangles[1][j]];
+					const Position pb[] = {s.positions[1][tb[0]], s.positions[1][tb[1]], s.positions[1][tb[2]]};
+					if(trianglesInterfere(pa, pb, tolerance)) return true;
+				}
+			}
+			return false;
+		}
+	}
+
+	std::vector<PartInstance> collectPartInstances(const Model &root){
+		std::vector<PartInstance> ret;
+		collectFrom(root, identityTransform(), ret);
+		return ret;
+	}
+
+	// After Möller's interval test: both triangles must straddle the other's plane, and their crossings must overlap along the line the planes share
+	bool trianglesInterfere(const Position a[3], const Position b[3], float tolerance){
+		const Vec va[] = {vec(a[0]), vec(a[1]), vec(a[2])};
+		const Vec vb[] = {vec(b[0]), vec(b[1]), vec(b[2])};
+		float da[3], db[3];
+		if(!straddles(vb, va, tolerance, da) || !straddles(va, vb, tolerance, db)) return false;
+
+		Vec axis = cross(cross(sub(va[1], va[0]), sub(va[2], va[0])), cross(sub(vb[1], vb[0]), sub(vb[2], vb[0])));
+		const float len = std::sqrt(dot(axis, axis));
+		if(!(len > 0.f)) return false;
+		axis = {axis.x / len, axis.y / len, axis.z / len};
+
+		float aLo, aHi, bLo, bHi;
+		crossing(va, da, axis, aLo, aHi);
+		crossing(vb, db, axis, bLo, bHi);
+		return std::min(aHi, bHi) - std::max(aLo, bLo) > tolerance;
+	}
+
+	std::vector<InstancePair> findInterference(const std::vector<PartInstance> &instances, float tolerance, size_t threads){
+		const size_t n = instances.size();
+
+		// Every part is flattened once, whatever the number of its instances
+		std::unordered_map<const Model*, size_t> partIndex;
+		std::vector<const Model*> parts;
+		for(auto it = instances.begin(); it != instances.end(); ++it){
+			if(partIndex.emplace(it->part, parts.size()).second) parts.push_back(it->part);
+		}
+		std::vector<PartMesh> meshes(parts.size());
+		Parallel::forChunks(parts.size(), 1, [&](size_t begin, size_t end){
+			for(size_t i = begin; i < end; ++i){
+				LDMesh flat;
+				parts[i]->flatten(flat);
+				meshes[i].positions.assign(std::get<0>(flat.attributes));
+				meshes[i].indices.swap(flat.indices);
+			}
+		}, threads);
+
+		// Broad phase. Boxes can't apply the tolerance (a thin part can pass deep into another while its box barely overlaps), so
+		// touching neighbours all become candidates, and it's left to the triangle test to throw them out.
+		std::vector<uint32_t> order(n);
+		for(size_t i = 0; i < n; ++i) order[i] = (uint32_t)i;
+		std::sort(order.begin(), order.end(), [&](uint32_t x, uint32_t y){ return instances[x].bounds.lo[0] < instances[y].bounds.lo[0]; });
+
+		const size_t chunkCt = (n + InterferenceChunkSize - 1) / InterferenceChunkSize;
+		std::vector<std::vector<InstancePair> > candidates(chunkCt);
+		Parallel::forChunks(n, InterferenceChunkSize, [&](size_t begin, size_t end){
+			std::vector<InstancePair> &out = candidates[begin / InterferenceChunkSize];
+			for(size_t i = begin; i < end; ++i){
+				const AABB &a = instances[order[i]].bounds;
+				for(size_t j = i + 1; j < n && instances[order[j]].bounds.lo[0] <= a.hi[0]; ++j){
+					if(a.overlaps(instances[order[j]].bounds)){
+						out.push_back(std::make_pair(std::min(order[i], order[j]), std::max(order[i], order[j])));
+					}
+				}
+			}
+		}, threads);
+		std::vector<InstancePair> pairs;
+		for(auto it = candidates.begin(); it != candidates.end(); ++it) pairs.insert(pairs.end(), it->begin(), it->end());
+		candidates.clear();
+
+		// Narrow phase. Pairs cost wildly different amounts, so they're handed out in small chunks.
+		std::vector<char> hit(pairs.size(), 0);
+		Parallel::forChunks(pairs.size(), 16, [&](size_t begin, size_t end){
+			Scratch scratch;
+			for(size_t p = begin; p < end; ++p){
+				const PartInstance &a = instances[pairs[p].first], &b = instances[pairs[p].second];
+				hit[p] = instancesInterfere(a, b, meshes[partIndex.at(a.part)], meshes[partIndex.at(b.part)], tolerance, scratch);
+			}
+		}, threads);
+
+		std::vector<InstancePair> ret;
+		for(size_t p = 0; p < pairs.size(); ++p) if(hit[p]) ret.push_back(pairs[p]);
+		std::sort(ret.begin(), ret.end());
+		return ret;
+	}
+}
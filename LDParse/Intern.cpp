@@ -0,0 +1,138 @@
+//
+//  Intern.cpp
+//  LDParse
+//
+//  Created by Thomas Dickerson on 2/7/16.
+//  Copyright © 2016 StickFigure Graphic Productions. All rights reserved.
+//
+
+#include <LDParse/Intern.hpp>
+#include <LDParse/Library.hpp>
+
+#include <cmath>
+#include <cstring>
+#include <locale>
+
+namespace LDParse {
+	void FingerprintHasher::add(const void * data, size_t size){
+		const unsigned char * bytes = static_cast<const unsigned char *>(data);
+		for(size_t i = 0; i < size; ++i){
+			mHigh = (mHigh ^ bytes[i]) * 0x100000001b3ull;
+			mLow = (mLow ^ bytes[i]) * 0xff51afd7ed558ccdull;
+			mLow ^= mLow >> 29;
+		}
+	}
+
+	Fingerprint FingerprintHasher::result() const {
+		// Finish each lane with a full avalanche, so the last few bytes reach every bit
+		uint64_t lanes[] = {mHigh, mLow};
+		for(size_t i = 0; i < 2; ++i){
+			uint64_t &x = lanes[i];
+			x ^= x >> 33;
+			x *= 0xff51afd7ed558ccdull;
+			x ^= x >> 33;
+			x *= 0xc4ceb9fe1a85ec53ull;
+			x ^= x >> 33;
+		}
+		return Fingerprint{lanes[0], lanes[1]};
+	}
+
+	namespace {
+		enum : uint64_t { LineTag = 0x4c, NumberTag = 0x4e, FloatTag = 0x46, HexTag = 0x48, IncludeTag = 0x49, SubModelTag = 0x53 };
+
+		void addToken(FingerprintHasher &hash, const Token &token){
+			switch(token.k){
+				case Zero...Five:
+				case DecInt:
+					hash.add((uint64_t)NumberTag);
+					hash.add((uint64_t)(int64_t)boost::get<int32_t>(token.v));
+					return;
+				case HexInt:
+					// Not a number like the others: as a colour, it's a direct colour rather than a code (see resolveColour)
+					hash.add((uint64_t)HexTag);
+					hash.add((uint64_t)(int64_t)boost::get<int32_t>(token.v));
+					return;
+				case Float: {
+					float f = boost::get<float>(token.v);
+					if(std::floor(f) == f && std::fabs(f) < 2147483648.f){
+						hash.add((uint64_t)NumberTag);
+						hash.add((uint64_t)(int64_t)f);
+					} else {
+						uint32_t bits;
+						memcpy(&bits, &f, sizeof(bits));
+						hash.add((uint64_t)FloatTag);
+						hash.add((uint64_t)bits);
+					}
+					return;
+				}
+				default:
+					hash.add((uint64_t)(int64_t)token.k);
+					hash.add(token.textRepr());
+			}
+		}
+
+		class ModelFingerprinter {
+			typedef enum : uint8_t { Unvisited, InProgress, Done } State;
+
+			const ModelStream &mModels;
+			const Cache::CacheNode<const size_t> * mNames;
+			std::vector<boost::optional<Fingerprint> > &mOut;
+			std::vector<State> mStates;
+
+			// True if the line was hashed in full; false if it names a model without a fingerprint
+			bool addLine(FingerprintHasher &hash, const std::string &lineT, const TokenStream &line){
+				static std::locale mfLocale;
+				hash.add((uint64_t)LineTag);
+				if(line[0].k != One || line.size() < 15){
+					for(auto it = line.begin(); it != line.end(); ++it) addToken(hash, *it);
+					return true;
+				}
+
+				// Colour and matrix, then the name, exactly as the parser reads it
+				for(size_t i = 0; i < 14; ++i) addToken(hash, line[i]);
+				std::string name = lineT.substr(line[14].c);
+				boost::trim_right(name, mfLocale);
+				boost::optional<const size_t&> index = mNames ? mNames->find(name) : boost::none;
+				if(index){
+					const boost::optional<Fingerprint> &child = visit(*index);
+					if(!child) return false;
+					hash.add((uint64_t)SubModelTag);
+					hash.add(*child);
+				} else {
+					hash.add((uint64_t)IncludeTag);
+					hash.add(Library::normalizeName(name));
+				}
+				return true;
+			}
+		public:
+			ModelFingerprinter(const ModelStream &models, const Cache::CacheNode<const size_t> * names, std::vector<boost::optional<Fingerprint> > &out)
+			: mModels(models), mNames(names), mOut(out), mStates(models.size(), Unvisited) {
+				mOut.assign(models.size(), boost::none);
+			}
+
+			const boost::optional<Fingerprint>& visit(size_t i){
+				if(mStates[i] != Unvisited) return mOut[i]; // Still none if it's in progress, which breaks the cycle
+				mStates[i] = InProgress;
+				FingerprintHasher hash;
+				bool ok = true;
+				const LineStream &lines = mModels[i].second;
+				for(auto it = lines.begin(); ok && it != lines.end(); ++it){
+					const TokenStream &line = it->second;
+					if(line.empty()) continue;
+					// Of the meta-commands, only these change what gets built
+					if(line[0].k == Zero && (line.size() < 2 || (line[1].k != Colour && line[1].k != Step && line[1].k != BFC))) continue;
+					ok = addLine(hash, it->first, line);
+				}
+				if(ok) mOut[i] = hash.result();
+				mStates[i] = Done;
+				return mOut[i];
+			}
+		};
+	}
+
+	void fingerprintModels(const ModelStream &models, const Cache::CacheNode<const size_t> * subModelNames,
+						   std::vector<boost::optional<Fingerprint> > &out){
+		ModelFingerprinter fingerprinter(models, subModelNames, out);
+		for(size_t i = 0; i < models.size(); ++i) fingerprinter.visit(i);
+	}
+}
@@ -0,0 +1,414 @@
+//
+//  Library.cpp
+//  LDParse
+//
+//  Created by Thomas Dickerson on 1/26/16.
+//  Copyright © 2016 StickFigure Graphic Productions. All rights reserved.
+//
+
+#include <LDParse/Library.hpp>
+
+#include <algorithm>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unordered_set>
+
+namespace LDParse {
+	Library::Library(ColorTable &colorTable) : mColorTable(colorTable), mRanks(0), mModels(CacheType::makeRoot(&mArena)), mInternLookups(0), mInternHits(0) { mIndex.clear(); }
+
+	std::string Library::normalizeName(const std::string &name){
+		static std::locale nnLocale;
+		std::string ret = name;
+		for(size_t i = 0; i < ret.size(); ++i){
+			ret[i] = (ret[i] == '/') ? '\\' : std::tolower(ret[i], nnLocale);
+		}
+		return ret;
+	}
+
+	std::string Library::cacheKey(const std::string &name, LODLevel level, bool includesOnly){
+		std::string ret = normalizeName(name);
+		if(includesOnly){
+			ret += "@refs";
+		} else if(level != StandardRes){
+			ret += "@";
+			ret += (level == LowRes) ? "low" : "high";
+		}
+		return ret;
+	}
+
+	void Library::indexDirectory(const std::string &dir, const std::string &prefix, SrcType srcType, size_t rank, std::vector<std::string> * added){
+		DIR *d = opendir(dir.c_str());
+		if(d == nullptr) return;
+		mDirectories.push_back({dir, normalizeName(prefix), srcType, rank});
+		struct dirent *ent;
+		while((ent = readdir(d)) != nullptr){
+			const std::string entName = ent->d_name;
+			if(entName == "." || entName == "..") continue;
+			const std::string path = dir + "/" + entName;
+			struct stat st;
+			if(stat(path.c_str(), &st)) continue;
+			if(S_ISDIR(st.st_mode)){
+				indexDirectory(path, prefix + entName + "\\", srcType, rank, added);
+			} else {
+				const std::string name = normalizeName(prefix + entName);
+				auto it = mIndex.find(name);
+				if(it != mIndex.end() && it->second.mRank > rank) continue; // Shadowed
+				mIndex[name] = {path, srcType, rank};
+				if(added) added->push_back(name);
+			}
+		}
+		closedir(d);
+	}
+
+	void Library::addRoot(const std::string &ldrawDir){
+		std::lock_guard<std::mutex> lock(mIndexLock);
+		indexDirectory(ldrawDir + "/models", "", ModelT, mRanks++);
+		indexDirectory(ldrawDir + "/p", "", PrimitiveT, mRanks++);
+		indexDirectory(ldrawDir + "/parts", "", PartT, mRanks++);
+	}
+
+	void Library::addSearchDirectory(const std::string &dir, SrcType srcType){
+		std::lock_guard<std::mutex> lock(mIndexLock);
+		indexDirectory(dir, "", srcType, mRanks++);
+	}
+
+	boost::optional<Library::Entry> Library::locate(const std::string &name) const {
+		const std::string normal = normalizeName(name);
+		std::lock_guard<std::mutex> lock(mIndexLock);
+		auto it = mIndex.find(normal);
+		return (it == mIndex.end()) ? boost::none : boost::optional<Entry>(it->second);
+	}
+
+	std::vector<Library::IndexedDirectory> Library::getDirectories() const {
+		std::lock_guard<std::mutex> lock(mIndexLock);
+		return mDirectories;
+	}
+
+	std::string Library::variantFor(const std::string &name, LODLevel level, const LODPolicy &policy) const {
+		const std::string normal = normalizeName(name);
+		auto subIt = policy.mSubstitutes[level].find(normal);
+		if(subIt != policy.mSubstitutes[level].end()) return normalizeName(subIt->second);
+		if(level != StandardRes){
+			const std::string resolution = (level == LowRes) ? "8\\" : "48\\";
+			std::lock_guard<std::mutex> lock(mIndexLock);
+			auto entryIt = mIndex.find(resolution + normal);
+			if(entryIt != mIndex.end() && entryIt->second.mSrcType == PrimitiveT) return entryIt->first;
+		}
+		return normal;
+	}
+
+	boost::optional<const Model&> Library::find(const std::string &key) const {
+		std::lock_guard<std::mutex> lock(mModelsLock);
+		return mModels->find(key);
+	}
+
+	std::string Library::keyName(const std::string &key, LODLevel &level, bool * includesOnly){
+		level = StandardRes;
+		if(includesOnly) *includesOnly = false;
+		const size_t at = key.rfind('@');
+		if(at == std::string::npos) return key;
+		const std::string suffix = key.substr(at + 1);
+		if(suffix == "low") level = LowRes;
+		else if(suffix == "high") level = HighRes;
+		else if(suffix == "refs" && includesOnly) *includesOnly = true;
+		else return key;
+		return key.substr(0, at);
+	}
+
+	// Calls f with the keys of the nearest cached Models below model, looking through anything uncached (i.e. submodels) on the way
+	template<typename F> void Library::forCachedBeneath(const Model &model, F f) const {
+		std::unordered_set<const Model *> seen;
+		std::vector<const Model *> stack(1, &model);
+		while(stack.size()){
+			const Model * next = stack.back();
+			stack.pop_back();
+			const std::vector<Model::ChildType> &children = next->getChildren();
+			for(auto it = children.begin(); it != children.end(); ++it){
+				const Model * child = std::get<3>(*it);
+				if(!seen.insert(child).second) continue;
+				auto keys = mKeysOfModel.find(child);
+				if(keys == mKeysOfModel.end()) stack.push_back(child);
+				else for(auto kIt = keys->second.begin(); kIt != keys->second.end(); ++kIt) f(*kIt);
+			}
+		}
+	}
+
+	const Model& Library::insert(const std::string &key, ArenaPtr<const Model> model, const std::string &path){
+		std::lock_guard<std::mutex> lock(mModelsLock);
+		boost::optional<const Model&> existing = mModels->find(key);
+		if(existing) return *existing;
+		const Model &ret = *model;
+		mModels->insert(key, std::move(model));
+		if(path.size()){
+			mPathOfKey[key] = path;
+			mKeysOfPath[path].insert(key);
+			mStaged.erase(path); // If it was built without what was staged for it, nothing else will take that now
+		}
+		forCachedBeneath(ret, [&](const std::string &included){
+			mIncludes[key].insert(included);
+			mDependents[included].insert(key);
+		});
+		mKeysOfModel[&ret].push_back(key);
+		return ret;
+	}
+
+	boost::optional<const Model&> Library::findInterned(const Fingerprint &key){
+		std::lock_guard<std::mutex> lock(mModelsLock);
+		++mInternLookups;
+		auto it = mInterned.find(key);
+		if(it == mInterned.end()) return boost::none;
+		++mInternHits;
+		return *it->second;
+	}
+
+	const Model& Library::intern(const Fingerprint &key, const Model &model){
+		std::lock_guard<std::mutex> lock(mModelsLock);
+		auto inserted = mInterned.insert(std::make_pair(key, &model));
+		if(inserted.second){
+			mFingerprintOf[&model] = key;
+			forCachedBeneath(model, [&](const std::string &included){ mInternDependents[included].push_back(key); });
+		}
+		return *inserted.first->second;
+	}
+
+	std::vector<std::string> Library::invalidateKeys(const std::vector<std::string> &seeds, const std::vector<std::string> &paths){
+		std::lock_guard<std::mutex> lock(mModelsLock);
+		std::vector<std::string> ret;
+		std::unordered_set<std::string> seen;
+		auto visit = [&](const std::string &key){
+			if(mModels->find(key) && seen.insert(key).second) ret.push_back(key);
+		};
+		for(auto it = seeds.begin(); it != seeds.end(); ++it) visit(*it);
+		for(auto it = paths.begin(); it != paths.end(); ++it){
+			mStaged.erase(*it);
+			auto keys = mKeysOfPath.find(*it);
+			if(keys != mKeysOfPath.end()) for(auto kIt = keys->second.begin(); kIt != keys->second.end(); ++kIt) visit(*kIt);
+		}
+		// Everything that includes what's going, however indirectly, goes too
+		for(size_t i = 0; i < ret.size(); ++i){
+			auto dependents = mDependents.find(ret[i]);
+			if(dependents == mDependents.end()) continue;
+			for(auto it = dependents->second.begin(); it != dependents->second.end(); ++it) visit(*it);
+		}
+
+		auto unintern = [&](const Model * model){
+			auto fingerprint = mFingerprintOf.find(model);
+			if(fingerprint == mFingerprintOf.end()) return;
+			mInterned.erase(fingerprint->second);
+			mFingerprintOf.erase(fingerprint);
+		};
+		for(auto it = ret.begin(); it != ret.end(); ++it){
+			const std::string &key = *it;
+			const Model * model = &*mModels->find(key);
+			mModels->erase(key);
+
+			auto keys = mKeysOfModel.find(model);
+			keys->second.erase(std::find(keys->second.begin(), keys->second.end(), key));
+			if(keys->second.empty()){
+				mKeysOfModel.erase(keys);
+				unintern(model);
+			}
+			auto path = mPathOfKey.find(key);
+			if(path != mPathOfKey.end()){
+				auto pathKeys = mKeysOfPath.find(path->second);
+				pathKeys->second.erase(key);
+				if(pathKeys->second.empty()) mKeysOfPath.erase(pathKeys);
+				mPathOfKey.erase(path);
+			}
+
+			// Interned submodels that included it can't be shared any more; whatever they were shared into is already in ret
+			auto internDependents = mInternDependents.find(key);
+			if(internDependents != mInternDependents.end()){
+				for(auto fIt = internDependents->second.begin(); fIt != internDependents->second.end(); ++fIt){
+					auto interned = mInterned.find(*fIt);
+					if(interned != mInterned.end()) unintern(interned->second);
+				}
+				mInternDependents.erase(internDependents);
+			}
+
+			auto includes = mIncludes.find(key);
+			if(includes != mIncludes.end()){
+				for(auto iIt = includes->second.begin(); iIt != includes->second.end(); ++iIt){
+					auto dependents = mDependents.find(*iIt);
+					if(dependents == mDependents.end()) continue;
+					dependents->second.erase(key);
+					if(dependents->second.empty()) mDependents.erase(dependents);
+				}
+				mIncludes.erase(includes);
+			}
+			mDependents.erase(key);
+		}
+		return ret;
+	}
+
+	std::vector<std::string> Library::invalidate(const std::string &path){
+		return invalidateKeys(std::vector<std::string>(), std::vector<std::string>(1, path));
+	}
+
+	namespace {
+		// Every key name could have been cached under, by itself or as the p/8 or p/48 variant of something else
+		void keysFor(const std::string &name, std::vector<std::string> &keys){
+			const LODLevel levels[] = {LowRes, StandardRes, HighRes};
+			for(size_t i = 0; i < 3; ++i) keys.push_back(Library::cacheKey(name, levels[i]));
+			keys.push_back(Library::cacheKey(name, StandardRes, true));
+			if(!name.compare(0, 2, "8\\")) keys.push_back(Library::cacheKey(name.substr(2), LowRes));
+			if(!name.compare(0, 3, "48\\")) keys.push_back(Library::cacheKey(name.substr(3), HighRes));
+		}
+	}
+
+	std::vector<std::string> Library::refresh(const IndexedDirectory &dir, const std::string &fileName){
+		const std::string name = normalizeName(dir.mPrefix + fileName);
+		const std::string path = dir.mPath + "/" + fileName;
+		std::vector<std::string> paths(1, path), keys;
+		bool changed = false;
+		{
+			std::lock_guard<std::mutex> lock(mIndexLock);
+			auto it = mIndex.find(name);
+			const boost::optional<Entry> before = (it == mIndex.end()) ? boost::none : boost::optional<Entry>(it->second);
+			struct stat st;
+			if(!stat(path.c_str(), &st) && !S_ISDIR(st.st_mode)){
+				if(!before || before->mRank <= dir.mRank) mIndex[name] = {path, dir.mSrcType, dir.mRank};
+			} else if(before && before->mPath == path){
+				// Gone: whatever it was shadowing shows through again, if anything was
+				mIndex.erase(it);
+				boost::optional<IndexedDirectory> best;
+				for(auto dIt = mDirectories.begin(); dIt != mDirectories.end(); ++dIt){
+					if(dIt->mPrefix != dir.mPrefix || dIt->mPath == dir.mPath || (best && best->mRank > dIt->mRank)) continue;
+					if(!stat((dIt->mPath + "/" + fileName).c_str(), &st) && !S_ISDIR(st.st_mode)) best = *dIt;
+				}
+				if(best) mIndex[name] = {best->mPath + "/" + fileName, best->mSrcType, best->mRank};
+			}
+			it = mIndex.find(name);
+			changed = (bool)before != (it != mIndex.end()) || (before && before->mPath != it->second.mPath);
+			if(before && changed) paths.push_back(before->mPath);
+		}
+		// A name that resolves somewhere new changes everything that includes it, whether or not it was built from path
+		if(changed) keysFor(name, keys);
+		return invalidateKeys(keys, paths);
+	}
+
+	std::vector<std::string> Library::refreshDirectory(const IndexedDirectory &dir, const std::string &name){
+		std::vector<std::string> added, keys;
+		{
+			std::lock_guard<std::mutex> lock(mIndexLock);
+			indexDirectory(dir.mPath + "/" + name, dir.mPrefix + name + "\\", dir.mSrcType, dir.mRank, &added);
+		}
+		for(auto it = added.begin(); it != added.end(); ++it) keysFor(*it, keys);
+		return invalidateKeys(keys, std::vector<std::string>());
+	}
+
+	std::vector<std::string> Library::removeDirectory(const IndexedDirectory &dir, const std::string &name){
+		const std::string gone = dir.mPath + "/" + name;
+		const std::string goneSlash = gone + "/";
+		std::vector<std::string> paths, keys;
+		{
+			std::lock_guard<std::mutex> lock(mIndexLock);
+			mDirectories.erase(std::remove_if(mDirectories.begin(), mDirectories.end(), [&](const IndexedDirectory &d){
+				return d.mPath == gone || !d.mPath.compare(0, goneSlash.size(), goneSlash);
+			}), mDirectories.end());
+			std::vector<std::pair<std::string, std::string> > removed; // Name, and path relative to the directory that's gone
+			for(auto it = mIndex.begin(); it != mIndex.end();){
+				if(it->second.mPath.compare(0, goneSlash.size(), goneSlash)){
+					++it;
+					continue;
+				}
+				paths.push_back(it->second.mPath);
+				removed.push_back(std::make_pair(it->first, it->second.mPath.substr(goneSlash.size())));
+				it = mIndex.erase(it);
+			}
+			// As in refresh, whatever they were shadowing shows through again
+			for(auto it = removed.begin(); it != removed.end(); ++it){
+				const size_t slash = it->second.rfind('/');
+				const std::string fileName = (slash == std::string::npos) ? it->second : it->second.substr(slash + 1);
+				const std::string prefix = normalizeName(dir.mPrefix + name + "\\" + it->second.substr(0, slash + 1));
+				boost::optional<IndexedDirectory> best;
+				struct stat st;
+				for(auto dIt = mDirectories.begin(); dIt != mDirectories.end(); ++dIt){
+					if(dIt->mPrefix != prefix || (best && best->mRank > dIt->mRank)) continue;
+					if(!stat((dIt->mPath + "/" + fileName).c_str(), &st) && !S_ISDIR(st.st_mode)) best = *dIt;
+				}
+				if(best) mIndex[it->first] = {best->mPath + "/" + fileName, best->mSrcType, best->mRank};
+				keysFor(it->first, keys);
+			}
+		}
+		return invalidateKeys(keys, paths);
+	}
+
+	InternStats Library::getInternStats() const {
+		std::lock_guard<std::mutex> lock(mModelsLock);
+		return InternStats{mInternLookups, mInternHits, mInterned.size()};
+	}
+
+	size_t Library::preload(const std::vector<std::string> &names, FileLoader &loader, LODLevel level, const LODPolicy &policy){
+		size_t ret = 0;
+		std::mutex frontierLock;
+		std::unordered_set<std::string> seen;
+		std::vector<std::string> frontier, next, staged;
+		for(auto it = names.begin(); it != names.end(); ++it){
+			const std::string variant = variantFor(*it, level, policy);
+			if(seen.insert(variant).second) frontier.push_back(variant);
+		}
+
+		while(frontier.size()){
+			std::vector<std::string> paths;
+			for(auto it = frontier.begin(); it != frontier.end(); ++it){
+				boost::optional<Entry> entry = locate(*it); // Submodels of an MPD won't be in the index, and don't need to be
+				if(!entry || find(cacheKey(*it, level))) continue;
+				std::lock_guard<std::mutex> lock(mModelsLock);
+				if(!mStaged.count(entry->mPath)) paths.push_back(entry->mPath);
+			}
+
+			next.clear();
+			loader.load(paths, [&](size_t, const std::string &path, FileContents contents, int){
+				if(!contents) return; // The builder will find out for itself
+				std::vector<std::string> includes;
+				scanIncludes(contents->data(), contents->size(), includes);
+				{
+					std::lock_guard<std::mutex> lock(mModelsLock);
+					mStaged[path] = contents;
+				}
+				std::lock_guard<std::mutex> lock(frontierLock);
+				++ret;
+				staged.push_back(path);
+				for(auto it = includes.begin(); it != includes.end(); ++it){
+					const std::string variant = variantFor(*it, level, policy);
+					if(seen.insert(variant).second) next.push_back(variant);
+				}
+			});
+			frontier.swap(next);
+		}
+
+		// Builders running alongside may have cached some of these while they were being read, from disk
+		std::lock_guard<std::mutex> lock(mModelsLock);
+		for(auto it = staged.begin(); it != staged.end(); ++it) if(mKeysOfPath.count(*it)) mStaged.erase(*it);
+		return ret;
+	}
+
+	FileContents Library::takeStaged(const std::string &path){
+		FileContents ret;
+		std::lock_guard<std::mutex> lock(mModelsLock);
+		auto it = mStaged.find(path);
+		if(it != mStaged.end()){
+			ret = it->second;
+			mStaged.erase(it);
+		}
+		return ret;
+	}
+
+	void Library::stage(const std::string &path, FileContents contents){
+		std::lock_guard<std::mutex> lock(mModelsLock);
+		mStaged[path] = contents;
+	}
+
+	size_t Library::releaseStaged(){
+		std::lock_guard<std::mutex> lock(mModelsLock);
+		const size_t ret = mStaged.size();
+		mStaged.clear();
+		return ret;
+	}
+
+	bool Library::hasStaged(const std::string &path) const {
+		std::lock_guard<std::mutex> lock(mModelsLock);
+		return mStaged.count(path);
+	}
+}
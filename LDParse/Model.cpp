@@ -7,12 +7,112 @@
 //
 
 #include <LDParse/Model.hpp>
+#include <LDParse/Weld.hpp>
 namespace LDParse {
-	Model::Model(std::string name, std::string srcLoc, SrcType srcType, ColorTable& colorTable,
+	Model::Model(std::string name, std::string srcLoc, SrcType srcType, const std::shared_ptr<const Palette> &palette,
 				 const std::shared_ptr<const IndexType> subModelNames, std::shared_ptr<CacheType> subModels)
 	: mName(name), mSrcLoc(srcLoc), mSrcType(srcType),
 	mSubModelNames(subModelNames), mSubModels((subModels == nullptr) ? std::shared_ptr<CacheType>((mSrcType == MPDRootT) ? CacheType::makeRoot() : nullptr) : subModels),
-	mColorTable(colorTable), mCertify(boost::logic::indeterminate), mWinding(BFCOff)
-	{ mStepEnds.clear(); mLocalColors.clear(); mLocalComplements.clear(); }
+	mPalette(palette), mLocalColors(std::make_shared<const ColourOverlay>()), mCertify(boost::logic::indeterminate), mWinding(BFCOff)
+	{ mStepEnds.clear(); }
 
+	void Model::flatten(LDMesh &out, uint32_t colour, OptLineBuffer *optLines) const {
+		const size_t firstLine = out.lineColours.size();
+		visitInstances([&](const Instance &instance){ instance.model->appendInstance(out, optLines, instance); }, colour);
+		// Neighbouring parts, and parts and their primitives, often draw the same edge, and each placement has its own vertices
+		EdgeSet edges;
+		dedupeLines(out, edges, firstLine);
+	}
+	
+	void Model::appendInstance(LDMesh &out, OptLineBuffer *optLines, const Instance &instance) const {
+		const TransMatrix &transform = instance.transform;
+		const uint32_t colour = instance.colour;
+		const bool invert = instance.invert, cull = instance.cull;
+		const std::vector<Position> &positions = std::get<0>(mData.attributes);
+		const std::vector<Position> &normals = std::get<1>(mData.attributes);
+		const std::vector<uint32_t> &colours = std::get<2>(mData.attributes);
+		std::vector<Position> &outPositions = std::get<0>(out.attributes);
+		std::vector<Position> &outNormals = std::get<1>(out.attributes);
+		std::vector<uint32_t> &outColours = std::get<2>(out.attributes);
+		
+		const uint32_t base = (uint32_t)out.vertexCount();
+		const size_t vertexCt = mData.vertexCount();
+		outPositions.insert(outPositions.end(), positions.begin(), positions.end());
+		transformPositions(transform, outPositions.data() + base, vertexCt, outPositions.data() + base);
+		for(size_t i = 0; i < vertexCt; ++i){
+			outNormals.push_back(transformNormal(transform, normals[i]));
+			outColours.push_back(mPalette->resolve(colours[i], colour));
+		}
+		
+		// Triangles are (a, b, c); inverting swaps b and c
+		const size_t second = invert ? 2 : 1, third = invert ? 1 : 2;
+		const std::vector<uint32_t> &indices = mData.indices;
+		for(size_t i = 0; i + 2 < indices.size(); i += 3){
+			out.indices.push_back(base + indices[i]);
+			out.indices.push_back(base + indices[i + second]);
+			out.indices.push_back(base + indices[i + third]);
+		}
+		if(cull){
+			const std::vector<uint32_t> &bfIndices = mData.bfIndices;
+			for(size_t i = 0; i + 2 < bfIndices.size(); i += 3){
+				out.bfIndices.push_back(base + bfIndices[i]);
+				out.bfIndices.push_back(base + bfIndices[i + second]);
+				out.bfIndices.push_back(base + bfIndices[i + third]);
+			}
+		} else {
+			// Culling was disabled further up, so every face gets a back face, whatever this file asked for
+			for(size_t i = 0; i + 2 < indices.size(); i += 3){
+				out.bfIndices.push_back(base + indices[i]);
+				out.bfIndices.push_back(base + indices[i + third]);
+				out.bfIndices.push_back(base + indices[i + second]);
+			}
+		}
+		
+		const std::vector<uint32_t> &lineIndices = mData.lineIndices;
+		for(size_t i = 0; i < lineIndices.size(); ++i) out.lineIndices.push_back(base + lineIndices[i]);
+		for(auto it = mData.lineColours.begin(); it != mData.lineColours.end(); ++it) out.lineColours.push_back(mPalette->resolve(*it, colour));
+		
+		if(optLines) optLines->append(mOptLines, 0, mOptLines.size(), transform, colour);
+	}
+	
+	const PositionArrays& Model::getPositionArrays() const {
+		std::call_once(mPositionArraysOnce, [this](){ mPositionArrays.assign(std::get<0>(mData.attributes)); });
+		return mPositionArrays;
+	}
+	
+	const AABB& Model::getLocalBounds() const {
+		std::call_once(mLocalBoundsOnce, [this](){ mLocalBounds = bounds(getPositionArrays()); });
+		return mLocalBounds;
+	}
+	
+	const AABB& Model::getBounds() const {
+		std::call_once(mBoundsOnce, [this](){
+			mBounds = getLocalBounds();
+			for(auto it = mChildren.begin(); it != mChildren.end(); ++it){
+				const Model * child = std::get<3>(*it);
+				if(child != nullptr) mBounds.extend(child->getBounds().transformed(std::get<2>(*it)));
+			}
+		});
+		return mBounds;
+	}
+	
+	const AABB& Model::getExactBounds() const {
+		std::call_once(mExactBoundsOnce, [this](){
+			mExactBounds = getLocalBounds();
+			for(auto it = mChildren.begin(); it != mChildren.end(); ++it){
+				const Model * child = std::get<3>(*it);
+				if(child != nullptr) child->extendExactBounds(mExactBounds, std::get<2>(*it));
+			}
+		});
+		return mExactBounds;
+	}
+	
+	void Model::extendExactBounds(AABB &bounds, const TransMatrix &transform) const {
+		if(bounds.contains(getBounds().transformed(transform))) return; // Nothing down here can reach outside what we have
+		extendTransformed(bounds, transform, getPositionArrays());
+		for(auto it = mChildren.begin(); it != mChildren.end(); ++it){
+			const Model * child = std::get<3>(*it);
+			if(child != nullptr) child->extendExactBounds(bounds, composeTransforms(transform, std::get<2>(*it)));
+		}
+	}
 }
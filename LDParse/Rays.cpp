@@ -0,0 +1,128 @@
+//
+//  Rays.cpp
+//  LDParse
+//
+//  Created by Thomas Dickerson on 1/30/16.
+//  Copyright © 2016 StickFigure Graphic Productions. All rights reserved.
+//
+
+#include <LDParse/Rays.hpp>
+
+#ifdef LDPARSE_WITH_EMBREE
+
+#include <LDParse/Parallel.hpp>
+
+namespace LDParse {
+	RayScene::RayScene(const Model &root) : mDevice(rtcNewDevice(nullptr)), mScene(nullptr) {
+		if(mDevice == nullptr) return;
+		mScene = rtcDeviceNewScene(mDevice, RTC_SCENE_STATIC, RTC_INTERSECT1);
+		std::vector<uint32_t> path;
+		mPathOffsets.push_back(0);
+		addInstances(root, identityTransform(), path);
+		rtcCommit(mScene);
+	}
+
+	RayScene::~RayScene(){
+		if(mScene != nullptr) rtcDeleteScene(mScene);
+		for(auto it = mParts.begin(); it != mParts.end(); ++it) rtcDeleteScene(it->second);
+		if(mDevice != nullptr) rtcDeleteDevice(mDevice);
+	}
+
+	// Built once per Model, the first time it turns up
+	RTCScene RayScene::partScene(const Model &model){
+		auto partIt = mParts.find(&model);
+		if(partIt != mParts.end()) return partIt->second;
+
+		const LDMesh &mesh = model.getMesh();
+		const std::vector<Position> &positions = std::get<0>(mesh.attributes);
+		const size_t triangleCt = mesh.indices.size() / 3;
+		RTCScene ret = rtcDeviceNewScene(mDevice, RTC_SCENE_STATIC, RTC_INTERSECT1);
+		const unsigned geomID = rtcNewTriangleMesh(ret, RTC_GEOMETRY_STATIC, triangleCt, positions.size());
+
+		// Embree reads vertices 16 bytes at a time, so they're padded out to four floats
+		float *vertices = static_cast<float*>(rtcMapBuffer(ret, geomID, RTC_VERTEX_BUFFER));
+		for(size_t i = 0; i < positions.size(); ++i){
+			vertices[4 * i] = std::get<0>(positions[i]);
+			vertices[4 * i + 1] = std::get<1>(positions[i]);
+			vertices[4 * i + 2] = std::get<2>(positions[i]);
+			vertices[4 * i + 3] = 0.f;
+		}
+		rtcUnmapBuffer(ret, geomID, RTC_VERTEX_BUFFER);
+
+		int *triangles = static_cast<int*>(rtcMapBuffer(ret, geomID, RTC_INDEX_BUFFER));
+		for(size_t i = 0; i < 3 * triangleCt; ++i) triangles[i] = (int)mesh.indices[i];
+		rtcUnmapBuffer(ret, geomID, RTC_INDEX_BUFFER);
+
+		rtcCommit(ret); // Has to happen before anything instances it
+		mParts[&model] = ret;
+		return ret;
+	}
+
+	void RayScene::addInstances(const Model &model, const TransMatrix &transform, std::vector<uint32_t> &path){
+		if(model.getMesh().indices.size()){
+			const unsigned geomID = rtcNewInstance(mScene, partScene(model));
+			rtcSetTransform(mScene, geomID, RTC_MATRIX_ROW_MAJOR, transform.m); // Which is exactly TransMatrix's layout
+			mInstanceModels.push_back(&model);
+			mInstanceTransforms.push_back(transform);
+			mPathData.insert(mPathData.end(), path.begin(), path.end());
+			mPathOffsets.push_back(mPathData.size());
+		}
+		const std::vector<Model::ChildType> &children = model.getChildren();
+		for(size_t i = 0; i < children.size(); ++i){
+			const Model * child = std::get<3>(children[i]);
+			if(child == nullptr) continue;
+			path.push_back((uint32_t)i);
+			addInstances(*child, composeTransforms(transform, std::get<2>(children[i])), path);
+			path.pop_back();
+		}
+	}
+
+	static void makeRay(const Ray &in, RTCRay &out){
+		out.org[0] = std::get<0>(in.origin); out.org[1] = std::get<1>(in.origin); out.org[2] = std::get<2>(in.origin);
+		out.dir[0] = std::get<0>(in.direction); out.dir[1] = std::get<1>(in.direction); out.dir[2] = std::get<2>(in.direction);
+		out.tnear = in.tNear;
+		out.tfar = in.tFar;
+		out.time = 0.f;
+		out.mask = 0xFFFFFFFF;
+		out.geomID = RTC_INVALID_GEOMETRY_ID;
+		out.primID = RTC_INVALID_GEOMETRY_ID;
+		out.instID = RTC_INVALID_GEOMETRY_ID;
+	}
+
+	// Committed Embree scenes are safe to trace from any number of threads
+	void RayScene::intersect(const Ray *rays, size_t count, RayHit *hits, size_t threads) const {
+		Parallel::forChunks(count, RayChunkSize, [&](size_t begin, size_t end){
+			RTCRay ray;
+			for(size_t i = begin; i < end; ++i){
+				RayHit &hit = hits[i];
+				hit.instance = hit.triangle = NoHit;
+				if(mScene == nullptr) continue;
+				makeRay(rays[i], ray);
+				rtcIntersect(mScene, ray);
+				if(ray.geomID == RTC_INVALID_GEOMETRY_ID) continue;
+				// Each instance was added in order, so its geometry ID in the top scene is its index
+				hit.instance = ray.instID;
+				hit.triangle = ray.primID;
+				hit.t = ray.tfar;
+				hit.u = ray.u;
+				hit.v = ray.v;
+				hit.point = Position(ray.org[0] + ray.tfar * ray.dir[0], ray.org[1] + ray.tfar * ray.dir[1], ray.org[2] + ray.tfar * ray.dir[2]);
+			}
+		}, threads);
+	}
+
+	void RayScene::occluded(const Ray *rays, size_t count, bool *blocked, size_t threads) const {
+		Parallel::forChunks(count, RayChunkSize, [&](size_t begin, size_t end){
+			RTCRay ray;
+			for(size_t i = begin; i < end; ++i){
+				blocked[i] = false;
+				if(mScene == nullptr) continue;
+				makeRay(rays[i], ray);
+				rtcOccluded(mScene, ray);
+				blocked[i] = (ray.geomID != RTC_INVALID_GEOMETRY_ID); // Embree 2 zeroes geomID on any hit
+			}
+		}, threads);
+	}
+}
+
+#endif /* LDPARSE_WITH_EMBREE */
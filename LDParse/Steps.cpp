@@ -0,0 +1,79 @@
+//
+//  Steps.cpp
+//  LDParse
+//
+//  Created by Thomas Dickerson on 1/27/16.
+//  Copyright © 2016 StickFigure Graphic Productions. All rights reserved.
+//
+
+#include <LDParse/Steps.hpp>
+
+#include <algorithm>
+
+namespace LDParse {
+	static bool isStepped(const Model &model){
+		return model.getSrcType() >= ModelT && model.getSrcType() != UnknownT;
+	}
+
+	StepIndex::StepIndex(const Model &root) {
+		mSteps.clear();
+		mCompletions.clear();
+		visit(root);
+	}
+
+	void StepIndex::visit(const Model &model){
+		std::vector<size_t> &completions = mCompletions[&model];
+		const std::vector<StepMark> &marks = model.getStepEnds();
+		const std::vector<Model::ChildType> &children = model.getChildren();
+		completions.reserve(marks.size());
+		size_t childIt = 0;
+		for(size_t k = 0; k < marks.size(); ++k){
+			for(; childIt < marks[k].children; ++childIt){
+				const Model * child = std::get<3>(children[childIt]);
+				if(child != nullptr && isStepped(*child) && !mCompletions.count(child)) visit(*child);
+			}
+			completions.push_back(mSteps.size());
+			mSteps.push_back({&model, k});
+		}
+	}
+
+	size_t StepIndex::localStepsDone(const Model &model, size_t step) const {
+		auto it = mCompletions.find(&model);
+		if(it == mCompletions.end()) return model.getStepEnds().size(); // Not stepped through, so always complete
+		return std::upper_bound(it->second.begin(), it->second.end(), step) - it->second.begin();
+	}
+
+	StepRanges StepIndex::visible(const Model &model, size_t step) const {
+		const size_t done = localStepsDone(model, step);
+		StepRanges ret = {{0, 0}, {0, 0}, {0, 0}, {0, 0}, {0, 0}};
+		if(done){
+			const StepMark &end = model.getStepEnds()[done - 1];
+			ret.indices.second = end.indices;
+			ret.bfIndices.second = end.bfIndices;
+			ret.children.second = end.children;
+			ret.optLines.second = end.optLines;
+			ret.lineIndices.second = end.lineIndices;
+		} else if(!mCompletions.count(&model)) {
+			const StepMark end = model.currentMark();
+			ret.indices.second = end.indices;
+			ret.bfIndices.second = end.bfIndices;
+			ret.children.second = end.children;
+			ret.optLines.second = end.optLines;
+			ret.lineIndices.second = end.lineIndices;
+		}
+		return ret;
+	}
+
+	StepRanges StepIndex::added(size_t step) const {
+		const Entry &entry = mSteps[step];
+		return localStep(*entry.model, entry.localStep);
+	}
+
+	StepRanges StepIndex::localStep(const Model &model, size_t localStep){
+		const std::vector<StepMark> &marks = model.getStepEnds();
+		const StepMark begin = localStep ? marks[localStep - 1] : StepMark{0, 0, 0, 0, 0};
+		const StepMark &end = marks[localStep];
+		return {{begin.indices, end.indices}, {begin.bfIndices, end.bfIndices}, {begin.children, end.children}, {begin.optLines, end.optLines},
+			{begin.lineIndices, end.lineIndices}};
+	}
+}
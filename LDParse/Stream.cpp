@@ -0,0 +1,278 @@
+//
+//  Stream.cpp
+//  LDParse
+//
+//  Created by Thomas Dickerson on 2/6/16.
+//  Copyright © 2016 StickFigure Graphic Productions. All rights reserved.
+//
+
+#include <LDParse/Stream.hpp>
+#include <LDParse/Weld.hpp>
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+namespace LDParse {
+	void MeshChunk::clear(){
+		std::get<0>(mMesh.attributes).clear();
+		std::get<1>(mMesh.attributes).clear();
+		std::get<2>(mMesh.attributes).clear();
+		mMesh.indices.clear();
+		mMesh.bfIndices.clear();
+		mMesh.lineIndices.clear();
+		mMesh.lineColours.clear();
+		for(size_t i = 0; i < OptLineBuffer::CoordCount; ++i) mOptLines.coords[i].clear();
+		mOptLines.colours.clear();
+	}
+
+	namespace {
+		// Hands chunks from the thread filling them to the thread draining them and back again
+		class ChunkPipeline {
+			std::mutex mLock;
+			std::condition_variable mFreed, mFilled;
+			std::vector<MeshChunk *> mFree;
+			std::deque<MeshChunk *> mFull;
+			bool mFinished, mCancelled;
+		public:
+			ChunkPipeline(std::vector<MeshChunk> &chunks) : mFinished(false), mCancelled(false) {
+				for(auto it = chunks.begin(); it != chunks.end(); ++it) mFree.push_back(&*it);
+			}
+
+			// An empty chunk, once one is free. Null if the consumer has given up.
+			MeshChunk * acquire(){
+				std::unique_lock<std::mutex> lock(mLock);
+				mFreed.wait(lock, [this](){ return mCancelled || !mFree.empty(); });
+				if(mCancelled) return nullptr;
+				MeshChunk * chunk = mFree.back();
+				mFree.pop_back();
+				return chunk;
+			}
+
+			void publish(MeshChunk * chunk){
+				std::lock_guard<std::mutex> lock(mLock);
+				mFull.push_back(chunk);
+				mFilled.notify_one();
+			}
+
+			void finish(){
+				std::lock_guard<std::mutex> lock(mLock);
+				mFinished = true;
+				mFilled.notify_one();
+			}
+
+			// The next full chunk, in order. Null once everything has been handed over.
+			MeshChunk * next(){
+				std::unique_lock<std::mutex> lock(mLock);
+				mFilled.wait(lock, [this](){ return mFinished || !mFull.empty(); });
+				if(mFull.empty()) return nullptr;
+				MeshChunk * chunk = mFull.front();
+				mFull.pop_front();
+				return chunk;
+			}
+
+			void recycle(MeshChunk * chunk){
+				chunk->clear();
+				std::lock_guard<std::mutex> lock(mLock);
+				mFree.push_back(chunk);
+				mFreed.notify_one();
+			}
+
+			void cancel(){
+				std::lock_guard<std::mutex> lock(mLock);
+				mCancelled = true;
+				mFreed.notify_one();
+			}
+		};
+
+		/*
+		 * Packs instances into chunks. An instance that fits in what's left of the current chunk is copied in whole, just as
+		 * flatten would; anything else starts a new chunk, and if it doesn't fit in an empty one either, it's split a triangle
+		 * at a time, with each vertex copied into whichever chunk first needs it.
+		 */
+		class ChunkFiller {
+			ChunkPipeline &mPipeline;
+			const StreamOptions &mOptions;
+			StreamStats &mStats;
+			MeshChunk * mChunk;
+			size_t mSequence;
+			// Where each of the current Model's vertices went in this chunk, valid where the stamp matches mGeneration
+			std::vector<uint32_t> mRemap, mStamp;
+			uint32_t mGeneration;
+			EdgeSet mEdges; // Edge lines already in this chunk
+
+			size_t vertexLoad() const { return mChunk->mMesh.vertexCount() + 4 * mChunk->mOptLines.size(); }
+			bool empty() const { return !vertexLoad() && !mChunk->indexCount(); }
+			bool fits(size_t vertices, size_t indices) const {
+				return vertexLoad() + vertices <= mOptions.mChunkVertices && mChunk->indexCount() + indices <= mOptions.mChunkIndices;
+			}
+
+			void forget(){
+				if(++mGeneration == 0){
+					std::fill(mStamp.begin(), mStamp.end(), 0);
+					mGeneration = 1;
+				}
+			}
+
+			void publish(){
+				const LDMesh &mesh = mChunk->mMesh;
+				++mStats.chunks;
+				mStats.vertices += mesh.vertexCount();
+				mStats.triangles += (mesh.indices.size() + mesh.bfIndices.size()) / 3;
+				mStats.lines += mesh.lineColours.size();
+				mChunk->mSequence = mSequence++;
+				mPipeline.publish(mChunk);
+			}
+
+			void flush(){
+				publish();
+				mChunk = mPipeline.acquire();
+				mEdges.clear();
+				forget();
+			}
+
+			uint32_t vertex(const Instance &instance, uint32_t source){
+				if(mStamp[source] == mGeneration) return mRemap[source];
+				const LDMesh &mesh = instance.model->getMesh();
+				LDMesh &out = mChunk->mMesh;
+				const uint32_t index = (uint32_t)out.vertexCount();
+				std::get<0>(out.attributes).push_back(applyTransform(instance.transform, std::get<0>(mesh.attributes)[source]));
+				std::get<1>(out.attributes).push_back(transformNormal(instance.transform, std::get<1>(mesh.attributes)[source]));
+				std::get<2>(out.attributes).push_back(instance.model->getPalette().resolve(std::get<2>(mesh.attributes)[source], instance.colour));
+				mStamp[source] = mGeneration;
+				mRemap[source] = index;
+				return index;
+			}
+
+			// Room for n more vertices and indices, in this chunk or a fresh one. False if the consumer has given up.
+			bool reserve(size_t n){
+				if(!fits(n, n)) flush();
+				return mChunk != nullptr;
+			}
+
+			bool appendTriangles(const Instance &instance, const std::vector<uint32_t> &src, bool swap, std::vector<uint32_t> LDMesh::*dst){
+				const size_t second = swap ? 2 : 1, third = swap ? 1 : 2;
+				for(size_t i = 0; i + 2 < src.size(); i += 3){
+					if(!reserve(3)) return false;
+					const uint32_t a = vertex(instance, src[i]), b = vertex(instance, src[i + second]), c = vertex(instance, src[i + third]);
+					std::vector<uint32_t> &out = mChunk->mMesh.*dst;
+					out.push_back(a);
+					out.push_back(b);
+					out.push_back(c);
+				}
+				return true;
+			}
+
+			void appendPiecewise(const Instance &instance){
+				const LDMesh &mesh = instance.model->getMesh();
+				const size_t vertexCt = mesh.vertexCount();
+				if(mStamp.size() < vertexCt){
+					mStamp.resize(vertexCt, 0);
+					mRemap.resize(vertexCt);
+				}
+				forget();
+
+				// The same triangles in the same order as Model::appendInstance
+				if(!appendTriangles(instance, mesh.indices, instance.invert, &LDMesh::indices)) return;
+				if(instance.cull){
+					if(!appendTriangles(instance, mesh.bfIndices, instance.invert, &LDMesh::bfIndices)) return;
+				} else if(!appendTriangles(instance, mesh.indices, !instance.invert, &LDMesh::bfIndices)) return;
+
+				for(size_t i = 0; i + 1 < mesh.lineIndices.size(); i += 2){
+					if(!reserve(2)) return;
+					const std::vector<Position> &positions = std::get<0>(mesh.attributes);
+					if(!mEdges.insert(applyTransform(instance.transform, positions[mesh.lineIndices[i]]),
+									  applyTransform(instance.transform, positions[mesh.lineIndices[i + 1]]))) continue;
+					const uint32_t a = vertex(instance, mesh.lineIndices[i]), b = vertex(instance, mesh.lineIndices[i + 1]);
+					mChunk->mMesh.lineIndices.push_back(a);
+					mChunk->mMesh.lineIndices.push_back(b);
+					mChunk->mMesh.lineColours.push_back(instance.model->getPalette().resolve(mesh.lineColours[i / 2], instance.colour));
+				}
+
+				if(mOptions.mOptLines){
+					const OptLineBuffer &optLines = instance.model->getOptLines();
+					for(size_t begin = 0; begin < optLines.size();){
+						if(!reserve(4)) return;
+						const size_t room = (mOptions.mChunkVertices - vertexLoad()) / 4;
+						const size_t end = std::min(optLines.size(), begin + room);
+						mChunk->mOptLines.append(optLines, begin, end, instance.transform, instance.colour);
+						begin = end;
+					}
+				}
+			}
+		public:
+			ChunkFiller(ChunkPipeline &pipeline, const StreamOptions &options, StreamStats &stats)
+			: mPipeline(pipeline), mOptions(options), mStats(stats), mChunk(pipeline.acquire()), mSequence(0), mGeneration(1) {}
+
+			void add(const Instance &instance){
+				if(!mChunk) return;
+				++mStats.instances;
+				const Model &model = *instance.model;
+				const LDMesh &mesh = model.getMesh();
+				const size_t optLineCt = mOptions.mOptLines ? model.getOptLines().size() : 0;
+				const size_t vertices = mesh.vertexCount() + 4 * optLineCt;
+				const size_t indices = mesh.indices.size() + (instance.cull ? mesh.bfIndices.size() : mesh.indices.size()) + mesh.lineIndices.size();
+				if(!vertices && !indices) return;
+
+				if(!fits(vertices, indices) && !empty()){
+					flush();
+					if(!mChunk) return;
+				}
+				if(fits(vertices, indices)){
+					const size_t firstLine = mChunk->mMesh.lineColours.size();
+					model.appendInstance(mChunk->mMesh, mOptions.mOptLines ? &mChunk->mOptLines : nullptr, instance);
+					dedupeLines(mChunk->mMesh, mEdges, firstLine);
+				} else appendPiecewise(instance);
+			}
+
+			void finish(){
+				if(mChunk){
+					if(empty()) mPipeline.recycle(mChunk);
+					else publish();
+				}
+				mPipeline.finish();
+			}
+		};
+	}
+
+	StreamStats flattenStreaming(const Model &model, const ChunkSinkF &sink, const StreamOptions &options){
+		StreamOptions opts = options;
+		// Anything smaller couldn't hold a single conditional line, which asks for room for four vertices and four indices
+		// (see appendPiecewise); a fresh chunk without that room would be published empty
+		opts.mChunkVertices = std::max(opts.mChunkVertices, (size_t)4);
+		opts.mChunkIndices = std::max(opts.mChunkIndices, (size_t)4);
+		opts.mPipelineDepth = std::max(opts.mPipelineDepth, (size_t)1);
+
+		std::vector<MeshChunk> chunks(opts.mPipelineDepth);
+		ChunkPipeline pipeline(chunks);
+		StreamStats stats = {};
+		std::exception_ptr failure;
+		std::thread producer([&](){
+			try {
+				ChunkFiller filler(pipeline, opts, stats);
+				model.visitInstances([&](const Instance &instance){ filler.add(instance); }, opts.mColour);
+				filler.finish();
+			} catch(...) {
+				failure = std::current_exception();
+				pipeline.finish();
+			}
+		});
+
+		try {
+			while(MeshChunk * chunk = pipeline.next()){
+				sink(*chunk);
+				pipeline.recycle(chunk);
+			}
+		} catch(...) {
+			pipeline.cancel();
+			producer.join();
+			throw;
+		}
+		producer.join();
+		if(failure) std::rethrow_exception(failure);
+		return stats;
+	}
+}
@@ -0,0 +1,153 @@
+//
+//  Trace.cpp
+//  LDParse
+//
+//  Created by Thomas Dickerson on 1/31/16.
+//  Copyright © 2016 StickFigure Graphic Productions. All rights reserved.
+//
+
+#include <LDParse/Trace.hpp>
+
+#ifdef LDPARSE_INSTRUMENT
+
+#include <time.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace LDParse {
+	namespace Trace {
+		namespace {
+			std::atomic<uint64_t> gCounters[CounterCount];
+			std::atomic<uint64_t> gPhaseNanos[PhaseCount];
+			std::atomic<uint64_t> gPhaseCpuNanos[PhaseCount];
+			std::atomic<uint64_t> gPhaseCalls[PhaseCount];
+			std::atomic<bool> gTracing(false);
+
+			struct Event {
+				Phase mPhase;
+				std::string mDetail;
+				size_t mThread;
+				std::chrono::steady_clock::time_point mBegin, mEnd;
+			};
+
+			// Events are per file, not per line, so a lock is cheap enough here
+			std::mutex gEventLock;
+			std::vector<Event> gEvents;
+			std::unordered_map<std::thread::id, size_t> gThreadIds;
+			std::chrono::steady_clock::time_point gTraceStart;
+
+			void writeEscaped(std::ostream &out, const std::string &s){
+				static const char hex[] = "0123456789abcdef";
+				for(auto it = s.begin(); it != s.end(); ++it){
+					const unsigned char c = *it;
+					if(c == '"' || c == '\\') out << '\\' << c;
+					else if(c < 0x20) out << "\\u00" << hex[c >> 4] << hex[c & 0xf];
+					else out << c;
+				}
+			}
+		}
+
+		const char * counterName(Counter c){
+			static const char * const names[] = {"lines", "tokens", "includes", "cacheHits", "cacheMisses", "switchFiles"};
+			return c < CounterCount ? names[c] : "unknown";
+		}
+
+		const char * phaseName(Phase p){
+			static const char * const names[] = {"lex", "boundary", "parse", "build"};
+			return p < PhaseCount ? names[p] : "unknown";
+		}
+
+		void count(Counter c, uint64_t n){
+			gCounters[c].fetch_add(n, std::memory_order_relaxed);
+		}
+
+		void addPhase(Phase p, uint64_t nanos, uint64_t cpuNanos, bool newCall){
+			gPhaseNanos[p].fetch_add(nanos, std::memory_order_relaxed);
+			gPhaseCpuNanos[p].fetch_add(cpuNanos, std::memory_order_relaxed);
+			if(newCall) gPhaseCalls[p].fetch_add(1, std::memory_order_relaxed);
+		}
+
+		size_t& phaseDepth(Phase p){
+			static thread_local size_t depths[PhaseCount] = {};
+			return depths[p];
+		}
+
+		uint64_t threadCpuNanos(){
+			struct timespec ts;
+			if(clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts)) return 0;
+			return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+		}
+
+		Stats snapshot(){
+			Stats ret;
+			for(size_t i = 0; i < CounterCount; ++i) ret.mCounters[i] = gCounters[i].load(std::memory_order_relaxed);
+			for(size_t i = 0; i < PhaseCount; ++i){
+				ret.mPhaseNanos[i] = gPhaseNanos[i].load(std::memory_order_relaxed);
+				ret.mPhaseCpuNanos[i] = gPhaseCpuNanos[i].load(std::memory_order_relaxed);
+				ret.mPhaseCalls[i] = gPhaseCalls[i].load(std::memory_order_relaxed);
+			}
+			return ret;
+		}
+
+		void reset(){
+			for(size_t i = 0; i < CounterCount; ++i) gCounters[i].store(0, std::memory_order_relaxed);
+			for(size_t i = 0; i < PhaseCount; ++i){
+				gPhaseNanos[i].store(0, std::memory_order_relaxed);
+				gPhaseCpuNanos[i].store(0, std::memory_order_relaxed);
+				gPhaseCalls[i].store(0, std::memory_order_relaxed);
+			}
+			std::lock_guard<std::mutex> lock(gEventLock);
+			gEvents.clear();
+		}
+
+		void startTrace(){
+			std::lock_guard<std::mutex> lock(gEventLock);
+			gEvents.clear();
+			gTraceStart = std::chrono::steady_clock::now();
+			gTracing.store(true, std::memory_order_release);
+		}
+
+		void stopTrace(){
+			gTracing.store(false, std::memory_order_release);
+		}
+
+		bool tracing(){
+			return gTracing.load(std::memory_order_relaxed);
+		}
+
+		void recordEvent(Phase p, const std::string &detail, std::chrono::steady_clock::time_point begin, std::chrono::steady_clock::time_point end){
+			std::lock_guard<std::mutex> lock(gEventLock);
+			auto idIt = gThreadIds.emplace(std::this_thread::get_id(), gThreadIds.size()).first;
+			gEvents.push_back({p, detail, idIt->second, begin, end});
+		}
+
+		bool writeChromeTrace(std::ostream &out){
+			std::lock_guard<std::mutex> lock(gEventLock);
+			auto micros = [](std::chrono::steady_clock::duration d){ return std::chrono::duration_cast<std::chrono::microseconds>(d).count(); };
+			out << "{\"traceEvents\":[";
+			std::chrono::steady_clock::time_point last = gTraceStart;
+			for(size_t i = 0; i < gEvents.size(); ++i){
+				const Event &e = gEvents[i];
+				out << (i ? "," : "") << "{\"name\":\"" << phaseName(e.mPhase) << "\",\"cat\":\"LDParse\",\"ph\":\"X\",\"pid\":1,\"tid\":" << e.mThread
+				<< ",\"ts\":" << micros(e.mBegin - gTraceStart) << ",\"dur\":" << micros(e.mEnd - e.mBegin);
+				if(e.mDetail.size()){
+					out << ",\"args\":{\"file\":\"";
+					writeEscaped(out, e.mDetail);
+					out << "\"}";
+				}
+				out << "}";
+				last = std::max(last, e.mEnd);
+			}
+			const Stats stats = snapshot();
+			out << (gEvents.size() ? "," : "") << "{\"name\":\"counters\",\"cat\":\"LDParse\",\"ph\":\"C\",\"pid\":1,\"tid\":0,\"ts\":" << micros(last - gTraceStart) << ",\"args\":{";
+			for(size_t i = 0; i < CounterCount; ++i) out << (i ? "," : "") << "\"" << counterName((Counter)i) << "\":" << stats.mCounters[i];
+			out << "}}]}" << std::endl;
+			return (bool)out;
+		}
+	}
+}
+
+#endif /* LDPARSE_INSTRUMENT */
@@ -0,0 +1,312 @@
+//
+//  Validate.cpp
+//  LDParse
+//
+//  Created by Thomas Dickerson on 2/11/16.
+//  Copyright © 2016 StickFigure Graphic Productions. All rights reserved.
+//
+
+#include <LDParse/Validate.hpp>
+#include <LDParse/FileLoader.hpp>
+#include <LDParse/Parallel.hpp>
+#include <LDParse/Parse.hpp>
+
+#include <atomic>
+#include <fstream>
+#include <unordered_map>
+
+#include <boost/logic/tribool.hpp>
+
+namespace LDParse {
+	namespace {
+		/*
+		 * The parts of ModelBuilder's handlers that can make construct fail or complain, and nothing else. There's no SwitchFile,
+		 * so submodels are parsed in the order they appear, each from its own first line to its own EOF, and per-file state
+		 * only has to cover the file being parsed.
+		 */
+		class Validator {
+			template<typename R, typename ...ArgTs> struct CallbackMethod {
+				typedef R(Validator::*CallbackM)(ArgTs... args);
+				Validator * mSelf;
+				const CallbackM mCallbackM;
+				CallbackMethod(Validator * self, const CallbackM callbackM) : mSelf(self), mCallbackM(callbackM) {}
+				R operator()(ArgTs... args){ return (mSelf->*mCallbackM)(args ...); }
+			};
+
+			DiagnosticCollector mErr;
+			const Library * mLibrary;
+			ModelStream mStream; // Kept between files, so its outermost buffer is too
+			std::unordered_map<std::string, size_t> mSubModels; // Name -> index in mStream, if it's an MPD
+			std::vector<std::vector<size_t> > mIncludes; // Submodels each submodel includes
+			size_t mCurrent; // Which file in mStream is being parsed
+			boost::tribool mCertify;
+			bool mInvertNext;
+
+			Action handleMPDCommand(boost::optional<const std::string&> file){ return Action(); }
+			CallbackMethod<Action, boost::optional<const std::string&> > mpdCallback;
+			Action handleMetaCommand(TokenStream::const_iterator &tokenIt, const TokenStream::const_iterator &eolIt);
+			CallbackMethod<Action, TokenStream::const_iterator &, const TokenStream::const_iterator &> metaCallback;
+			Action handleInclude(const ColorRef &c, const TransMatrix &t, const std::string &name);
+			CallbackMethod<Action, const ColorRef &, const TransMatrix &, const std::string &> inclCallback;
+			Action handleLine(const ColorRef &c, const Line &l){ return drawn(); }
+			CallbackMethod<Action, const ColorRef &, const Line &> lineCallback;
+			Action handleTriangle(const ColorRef &c, const Triangle &t){ return drawn(); }
+			CallbackMethod<Action, const ColorRef &, const Triangle &> triCallback;
+			Action handleQuad(const ColorRef &c, const Quad &q){ return drawn(); }
+			CallbackMethod<Action, const ColorRef &, const Quad &> quadCallback;
+			Action handleOptLine(const ColorRef &c, const OptLine &l){ return drawn(); }
+			CallbackMethod<Action, const ColorRef &, const OptLine &> optLineCallback;
+			void handleEOF();
+			CallbackMethod<void> eofCallback;
+
+			typedef Parser<decltype(mpdCallback), decltype(metaCallback), decltype(inclCallback),
+			decltype(lineCallback), decltype(triCallback), decltype(quadCallback), decltype(optLineCallback),
+			decltype(eofCallback), DiagnosticCollector> ValidationParser;
+			ValidationParser mParser;
+
+			void resetFile(){
+				mCertify = boost::indeterminate;
+				mInvertNext = false;
+			}
+			Action drawn();
+			bool checkNames();
+		public:
+			Validator(const Library * library);
+			void validate(const std::string &path, const std::string &name, std::istream &input, SrcType srcType, ValidationResult &result);
+		};
+
+		Validator::Validator(const Library * library)
+		: mLibrary(library), mCurrent(0), mCertify(boost::indeterminate), mInvertNext(false),
+		mpdCallback(this, &Validator::handleMPDCommand),
+		metaCallback(this, &Validator::handleMetaCommand),
+		inclCallback(this, &Validator::handleInclude),
+		lineCallback(this, &Validator::handleLine),
+		triCallback(this, &Validator::handleTriangle),
+		quadCallback(this, &Validator::handleQuad),
+		optLineCallback(this, &Validator::handleOptLine),
+		eofCallback(this, &Validator::handleEOF),
+		mParser(mpdCallback, metaCallback, inclCallback, lineCallback, triCallback, quadCallback, optLineCallback, eofCallback, mErr) {}
+
+		// Follows ModelBuilder::handleMetaCommand, but says why wherever that would stop without a word
+		Action Validator::handleMetaCommand(TokenStream::const_iterator &tokenIt, const TokenStream::const_iterator &eolIt){
+			if(tokenIt == eolIt) return Action();
+			bool success = true;
+			switch ((tokenIt++)->k) {
+				case Colour: {
+					std::string name;
+					ColorRef code, v, e;
+					if(success &= mParser.expectIdent(tokenIt, eolIt, name)
+					   && mParser.expectKeyword(tokenIt, eolIt, Code)
+					   && mParser.expectColor(tokenIt, eolIt, code)){
+						if(!(success &= code.first)) mErr("Colour code must be decimal", name, true);
+					}
+					if(success && (success &= mParser.expectKeyword(tokenIt, eolIt, Value) && mParser.expectColor(tokenIt, eolIt, v))){
+						if(!(success &= !v.first)) mErr("Colour value must be hexadecimal", name, true);
+					}
+					if(success && (success &= mParser.expectKeyword(tokenIt, eolIt, Edge) && mParser.expectColor(tokenIt, eolIt, e))){
+						ColorRef alpha;
+						if(tokenIt != eolIt && tokenIt->k == Alpha) success &= mParser.expectColor(++tokenIt, eolIt, alpha);
+					}
+					break;
+				}
+				case BFC:
+					if(!(success &= (tokenIt != eolIt))){
+						mErr("BFC without a command", "BFC", true);
+						break;
+					}
+					switch (tokenIt->k) {
+						case InvertNext:
+							if(mCertify) mInvertNext = true;
+							break;
+						case NoCertify:
+							mCertify = false;
+							break;
+						case Certify:
+							if(!(success &= (indeterminate(mCertify) || (bool)mCertify))){
+								mErr("BFC CERTIFY after NOCERTIFY, or after the first drawing or include line", tokenIt->textRepr(true), true);
+							} else {
+								mCertify = true;
+								if(++tokenIt != eolIt && !(success &= tokenIt->k == Orientation)) mErr("Expected CW or CCW after BFC CERTIFY", tokenIt->textRepr(true), true);
+							}
+							break;
+						case Clip:
+						case NoClip:
+						case Orientation: {
+							bool sawClip = false, sawOrient = false;
+							for(; success && tokenIt != eolIt; ++tokenIt){
+								switch(tokenIt->k){
+									case Clip:
+									case NoClip:
+										success &= !sawClip;
+										sawClip = true;
+										break;
+									case Orientation:
+										success &= !sawOrient;
+										sawOrient = true;
+										break;
+									default:
+										success = false;
+								}
+								if(!success) mErr("Expected at most one of CLIP or NOCLIP, and one of CW or CCW", tokenIt->textRepr(true), true);
+							}
+							break;
+						}
+						default:
+							success = false;
+							mErr("Unknown BFC command", tokenIt->textRepr(true), true);
+					}
+					break;
+				default:
+					break;
+			}
+			return success ? Action() : Action(StopParsing, false);
+		}
+
+		Action Validator::handleInclude(const ColorRef &c, const TransMatrix &t, const std::string &name){
+			if(indeterminate(mCertify)) mCertify = false;
+			auto subIt = mSubModels.find(name);
+			if(subIt != mSubModels.end()){
+				mIncludes[mCurrent].push_back(subIt->second);
+			} else if(mLibrary && !mLibrary->locate(name)){
+				mErr("Couldn't find included file", name, false);
+			}
+			mInvertNext = false;
+			return Action();
+		}
+
+		// The certification rule for "operational command lines" (http://www.ldraw.org/article/415.html), as ModelBuilder enforces it
+		Action Validator::drawn(){
+			if(indeterminate(mCertify)) mCertify = false;
+			if(mInvertNext) mErr("BFC INVERTNEXT isn't followed directly by an include, so it will apply to the next one", mStream[mCurrent].first, false);
+			mInvertNext = false;
+			return Action();
+		}
+
+		void Validator::handleEOF(){
+			if(mInvertNext) mErr("BFC INVERTNEXT at the end of a file", mStream[mCurrent].first, false);
+			resetFile();
+			++mCurrent;
+		}
+
+		// False if two submodels share a name, since construct can only keep one of them
+		bool Validator::checkNames(){
+			bool ret = true;
+			mSubModels.clear();
+			for(size_t i = 0; i < mStream.size(); ++i){
+				if(!mSubModels.insert(std::make_pair(mStream[i].first, i)).second){
+					mErr("Submodel is defined more than once", mStream[i].first, true);
+					ret = false;
+				}
+			}
+			return ret;
+		}
+
+		void Validator::validate(const std::string &path, const std::string &name, std::istream &input, SrcType srcType, ValidationResult &result){
+			mErr.retarget(&result.mDiagnostics);
+			Lexer<DiagnosticCollector> lexer(input, mErr);
+			std::string rootName = name;
+			const bool isMPD = lexer.lexModelBoundaries(mStream, rootName);
+			if(isMPD && srcType < ModelT) mErr("Was told this file was not an MPD, but MPD commands were found", name, false);
+
+			result.mModels = mStream.size();
+			result.mLines = 0;
+			for(auto it = mStream.begin(); it != mStream.end(); ++it) result.mLines += it->second.size();
+
+			bool ok = !isMPD || checkNames();
+			if(!isMPD) mSubModels.clear();
+			mIncludes.assign(mStream.size(), std::vector<size_t>());
+			mCurrent = 0;
+			resetFile();
+			ok &= mParser.parseModels(mStream);
+
+			if(ok && isMPD){
+				// A submodel that includes itself however indirectly would have construct switching files forever.
+				// Depth first from every submodel, marking what's on the current path; reaching one of those again is a cycle
+				std::vector<uint8_t> state(mStream.size(), 0); // Unvisited, on the path, done
+				std::vector<std::pair<size_t, size_t> > stack; // Submodel, next include of it to follow
+				for(size_t root = 0; ok && root < mStream.size(); ++root){
+					if(state[root]) continue;
+					state[root] = 1;
+					stack.push_back(std::make_pair(root, 0));
+					while(ok && stack.size()){
+						std::pair<size_t, size_t> &top = stack.back();
+						if(top.second == mIncludes[top.first].size()){
+							state[top.first] = 2;
+							stack.pop_back();
+							continue;
+						}
+						const size_t next = mIncludes[top.first][top.second++];
+						if(state[next] == 1){
+							mErr("Submodel includes itself", mStream[next].first, true);
+							ok = false;
+						} else if(!state[next]){
+							state[next] = 1;
+							stack.push_back(std::make_pair(next, 0));
+						}
+					}
+				}
+				stack.clear();
+			}
+
+			result.mPath = path;
+			result.mOk = ok;
+			result.mErrors = result.mWarnings = 0;
+			for(auto it = result.mDiagnostics.begin(); it != result.mDiagnostics.end(); ++it){
+				if(it->mFatal) ++result.mErrors;
+				else ++result.mWarnings;
+			}
+			mErr.retarget(nullptr);
+		}
+	}
+
+	std::vector<ValidationResult> validateBatch(const std::vector<BatchSource> &sources, const Library * library, const ValidateOptions &options){
+		std::vector<ValidationResult> ret(sources.size());
+		const size_t threads = options.mThreads ? options.mThreads : Parallel::defaultThreadCount();
+		std::atomic<size_t> nextSource(0);
+
+		// One chunk per worker; the sources themselves are handed out one at a time
+		Parallel::forChunks(threads, 1, [&](size_t, size_t){
+			Validator validator(library);
+			std::vector<char> buffer; // Reused, so most files are read without allocating
+
+			size_t i;
+			while((i = nextSource++) < sources.size()){
+				const BatchSource &source = sources[i];
+				ValidationResult &result = ret[i];
+				const char * data = nullptr;
+				size_t size = 0;
+				bool opened = true;
+				if(source.mContents){
+					data = source.mContents->data();
+					size = source.mContents->size();
+				} else {
+					opened = false;
+					std::ifstream file(source.mPath, std::ios::binary);
+					file.seekg(0, std::ios::end);
+					const std::streamoff end = file.tellg();
+					file.seekg(0);
+					if(file && end >= 0){
+						buffer.resize((size_t)end);
+						if(file.read(buffer.data(), end)){
+							data = buffer.data();
+							size = buffer.size();
+							opened = true;
+						}
+					}
+				}
+				if(!opened){
+					result = ValidationResult();
+					result.mPath = source.mPath;
+					result.mDiagnostics.push_back({"Couldn't open file", source.mPath, true});
+					result.mErrors = 1;
+					continue;
+				}
+				MemoryStreamBuf streamBuf(data, size);
+				std::istream input(&streamBuf);
+				validator.validate(source.mPath, source.mName, input, source.mSrcType, result);
+			}
+		}, threads);
+
+		return ret;
+	}
+}
@@ -0,0 +1,179 @@
+//
+//  Watch.cpp
+//  LDParse
+//
+//  Created by Thomas Dickerson on 2/8/16.
+//  Copyright © 2016 StickFigure Graphic Productions. All rights reserved.
+//
+
+#include <LDParse/Watch.hpp>
+#include <LDParse/ModelBuilder.hpp>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <set>
+#include <vector>
+#include <unordered_set>
+
+#ifdef LDPARSE_WITH_INOTIFY
+#include <sys/inotify.h>
+#endif
+
+namespace LDParse {
+	Watcher::Watcher(Library &library, const WatchOptions &options) : mLibrary(library), mOptions(options), mFd(-1), mStopping(false) {
+		mWake[0] = mWake[1] = -1;
+#ifdef LDPARSE_WITH_INOTIFY
+		mFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if(mFd >= 0 && pipe2(mWake, O_NONBLOCK | O_CLOEXEC)){
+			close(mFd);
+			mFd = -1;
+		}
+#endif
+	}
+
+	Watcher::~Watcher(){
+		stop();
+		if(mFd >= 0) close(mFd);
+		if(mWake[0] >= 0){
+			close(mWake[0]);
+			close(mWake[1]);
+		}
+	}
+
+	void Watcher::watch(const Library::IndexedDirectory &dir){
+#ifdef LDPARSE_WITH_INOTIFY
+		const uint32_t mask = IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR;
+		const int wd = inotify_add_watch(mFd, dir.mPath.c_str(), mask);
+		if(wd >= 0) mWatches[wd] = dir; // A directory watched twice gets the same descriptor back
+#endif
+	}
+
+	bool Watcher::watchLibrary(){
+		if(mFd < 0) return false;
+		const std::vector<Library::IndexedDirectory> dirs = mLibrary.getDirectories();
+		for(auto it = dirs.begin(); it != dirs.end(); ++it) watch(*it);
+		return true;
+	}
+
+	void Watcher::rebuild(WatchEvent &event){
+		if(!mOptions.mRebuild) return;
+		DiagnosticCollector collector(&event.mDiagnostics);
+		ModelBuilder<DiagnosticCollector> builder(collector);
+		builder.setLibrary(&mLibrary);
+		builder.setWeldEpsilon(mOptions.mWeldEpsilon);
+		builder.setInterning(mOptions.mInterning);
+		// Whatever was invalidated first is usually included by what came after, so most of these are cache hits by the end
+		for(auto it = event.mInvalidated.begin(); it != event.mInvalidated.end(); ++it){
+			LODPolicy policy = mOptions.mLODPolicy;
+			bool includesOnly;
+			const std::string name = Library::keyName(*it, policy.mLevel, &includesOnly);
+			builder.setLODPolicy(policy);
+			builder.setIncludesOnly(includesOnly);
+			if(builder.require(name)) event.mRebuilt.push_back(*it);
+		}
+	}
+
+	size_t Watcher::poll(int timeoutMs){
+#ifdef LDPARSE_WITH_INOTIFY
+		if(mFd < 0) return 0;
+		struct pollfd fds[] = {{mFd, POLLIN, 0}, {mWake[0], POLLIN, 0}};
+		if(::poll(fds, 2, timeoutMs) <= 0 || !(fds[0].revents & POLLIN)) return 0;
+
+		// Editors tend to write a file several ways at once, so each file is only dealt with once a round
+		std::set<std::pair<int, std::string> > files, dirs, goneDirs;
+		std::vector<int> ignored;
+		alignas(struct inotify_event) char buffer[1 << 14];
+		ssize_t bytes;
+		while((bytes = read(mFd, buffer, sizeof(buffer))) > 0){
+			for(char * p = buffer; p < buffer + bytes;){
+				const struct inotify_event * ev = reinterpret_cast<const struct inotify_event *>(p);
+				p += sizeof(struct inotify_event) + ev->len;
+				if(ev->mask & IN_IGNORED){
+					ignored.push_back(ev->wd); // Not until the end of the round, since the events before it still need its directory
+				} else if(ev->len && mWatches.count(ev->wd)){
+					// A directory that's gone takes its files with it, and they each get an event of their own first
+					if(!(ev->mask & IN_ISDIR)) files.insert(std::make_pair(ev->wd, std::string(ev->name)));
+					else if(ev->mask & (IN_CREATE | IN_MOVED_TO)) dirs.insert(std::make_pair(ev->wd, std::string(ev->name)));
+					else if(ev->mask & (IN_DELETE | IN_MOVED_FROM)) goneDirs.insert(std::make_pair(ev->wd, std::string(ev->name)));
+				}
+			}
+		}
+
+		WatchEvent event;
+		std::unordered_set<std::string> invalidated;
+		auto record = [&](const std::vector<std::string> &keys){
+			for(auto it = keys.begin(); it != keys.end(); ++it){
+				if(invalidated.insert(*it).second) event.mInvalidated.push_back(*it);
+			}
+		};
+		// Gone before new, so a directory moved within the library is unindexed under its old name before it's indexed under the new one
+		for(auto it = goneDirs.begin(); it != goneDirs.end(); ++it){
+			auto watched = mWatches.find(it->first);
+			if(watched == mWatches.end()) continue; // Inside another directory that's gone, which took care of it
+			const Library::IndexedDirectory dir = watched->second;
+			const std::string gone = dir.mPath + "/" + it->second;
+			event.mPaths.push_back(gone);
+			record(mLibrary.removeDirectory(dir, it->second));
+			// A moved directory is still watched under its old path, so stop; watchLibrary picks it up again under the new one
+			for(auto wIt = mWatches.begin(); wIt != mWatches.end();){
+				const std::string &path = wIt->second.mPath;
+				if(path == gone || !path.compare(0, gone.size() + 1, gone + "/")){
+					inotify_rm_watch(mFd, wIt->first);
+					wIt = mWatches.erase(wIt);
+				} else {
+					++wIt;
+				}
+			}
+		}
+		for(auto it = dirs.begin(); it != dirs.end(); ++it){
+			auto watched = mWatches.find(it->first);
+			if(watched == mWatches.end()) continue;
+			const Library::IndexedDirectory dir = watched->second;
+			event.mPaths.push_back(dir.mPath + "/" + it->second);
+			record(mLibrary.refreshDirectory(dir, it->second));
+		}
+		if(dirs.size()) watchLibrary(); // Picks up the new directories, and anything already inside them
+		for(auto it = files.begin(); it != files.end(); ++it){
+			auto watched = mWatches.find(it->first);
+			if(watched == mWatches.end()) continue; // Its directory is gone, and removeDirectory has seen to it
+			const Library::IndexedDirectory dir = watched->second;
+			event.mPaths.push_back(dir.mPath + "/" + it->second);
+			record(mLibrary.refresh(dir, it->second));
+		}
+		for(auto it = ignored.begin(); it != ignored.end(); ++it) mWatches.erase(*it);
+
+		rebuild(event);
+		if(mListener) mListener(event);
+		return event.mPaths.size();
+#else
+		return 0;
+#endif
+	}
+
+	void Watcher::start(){
+		if(mFd < 0 || mThread.joinable()) return;
+		mStopping = false;
+		mThread = std::thread([this](){
+			while(!mStopping) poll(-1);
+		});
+	}
+
+	void Watcher::stop(){
+		if(!mThread.joinable()) return;
+		mStopping = true;
+		const char wake = 0;
+		if(write(mWake[1], &wake, 1) < 0) {} // Only fails if the pipe is full, and then the thread is awake anyway
+		mThread.join();
+		char drain;
+		while(read(mWake[0], &drain, 1) == 1) {} // So the next start() doesn't wake straight away
+	}
+
+	WatchEvent Watcher::changed(const std::string &path){
+		WatchEvent event;
+		event.mPaths.push_back(path);
+		event.mInvalidated = mLibrary.invalidate(path);
+		rebuild(event);
+		return event;
+	}
+}
@@ -0,0 +1,65 @@
+//
+//  Files.cpp
+//  ParseTest
+//
+//  Created by Thomas Dickerson on 2/11/16.
+//  Copyright © 2016 StickFigure Graphic Productions. All rights reserved.
+//
+
+#include "Files.hpp"
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <iostream>
+
+namespace ParseTest {
+	namespace {
+		bool isModelFile(const std::string &name){
+			const size_t dot = name.rfind('.');
+			if(dot == std::string::npos) return false;
+			std::string ext = name.substr(dot + 1);
+			std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+			return ext == "ldr" || ext == "mpd" || ext == "dat";
+		}
+	}
+
+	void collect(const std::string &path, bool explicitPath, std::vector<std::string> &out){
+		struct stat st;
+		if(stat(path.c_str(), &st)){
+			if(explicitPath) std::cerr << "Warning: couldn't stat " << path << std::endl;
+			return;
+		}
+		if(S_ISDIR(st.st_mode)){
+			DIR *d = opendir(path.c_str());
+			if(d == nullptr) return;
+			std::vector<std::string> entries;
+			struct dirent *ent;
+			while((ent = readdir(d)) != nullptr){
+				const std::string entName = ent->d_name;
+				if(entName != "." && entName != "..") entries.push_back(entName);
+			}
+			closedir(d);
+			std::sort(entries.begin(), entries.end());
+			for(auto it = entries.begin(); it != entries.end(); ++it){
+				const std::string child = path + "/" + *it;
+				if(stat(child.c_str(), &st)) continue;
+				if(S_ISDIR(st.st_mode) || isModelFile(*it)) collect(child, false, out);
+			}
+		} else {
+			out.push_back(path);
+		}
+	}
+
+	std::string jsonString(const std::string &s){
+		static const char hex[] = "0123456789abcdef";
+		std::string ret = "\"";
+		for(auto it = s.begin(); it != s.end(); ++it){
+			const unsigned char c = *it;
+			if(c == '"' || c == '\\'){ ret += '\\'; ret += c; }
+			else if(c < 0x20){ ret += "\\u00"; ret += hex[c >> 4]; ret += hex[c & 0xf]; }
+			else ret += c;
+		}
+		return ret + "\"";
+	}
+}
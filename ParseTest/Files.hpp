@@ -0,0 +1,23 @@
+//
+//  Files.hpp
+//  ParseTest
+//
+//  Created by Thomas Dickerson on 2/11/16.
+//  Copyright © 2016 StickFigure Graphic Productions. All rights reserved.
+//
+
+#ifndef Files_h
+#define Files_h
+
+#include <string>
+#include <vector>
+
+namespace ParseTest {
+	// Files are taken as given; directories are searched for .ldr, .mpd and .dat files, in name order, so runs over the same tree are comparable
+	void collect(const std::string &path, bool explicitPath, std::vector<std::string> &out);
+
+	// Quoted and escaped
+	std::string jsonString(const std::string &s);
+}
+
+#endif /* Files_h */
@@ -0,0 +1,230 @@
+//
+//  Profile.cpp
+//  ParseTest
+//
+//  Created by Thomas Dickerson on 2/4/16.
+//  Copyright © 2016 StickFigure Graphic Productions. All rights reserved.
+//
+
+#include "Profile.hpp"
+#include "Files.hpp"
+
+#include <LDParse/Arena.hpp>
+#include <LDParse/Library.hpp>
+#include <LDParse/ModelBuilder.hpp>
+#include <LDParse/Trace.hpp>
+
+#include <sys/resource.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
+// Every allocation the program makes goes through here, so we can count them
+namespace {
+	std::atomic<uint64_t> gAllocCt(0);
+	std::atomic<uint64_t> gAllocBytes(0);
+}
+
+void * operator new(std::size_t n){
+	gAllocCt.fetch_add(1, std::memory_order_relaxed);
+	gAllocBytes.fetch_add(n, std::memory_order_relaxed);
+	void * ret = std::malloc(n ? n : 1);
+	if(ret == nullptr) throw std::bad_alloc();
+	return ret;
+}
+
+// Kept out of line, or GCC sees our malloc'd pointers reach free through a delete-expression and warns
+__attribute__((noinline)) void operator delete(void * p) noexcept { std::free(p); }
+
+namespace ParseTest {
+	namespace {
+		struct FileProfile {
+			std::string mPath;
+			bool mBuilt;
+			uint64_t mBytes;
+			uint64_t mErrors;
+			uint64_t mAllocs;
+			uint64_t mAllocBytes;
+			double mWallMs;
+			double mCpuMs;
+#ifdef LDPARSE_INSTRUMENT
+			uint64_t mLines;
+			uint64_t mTokens;
+#endif
+		};
+
+		uint64_t gErrorCt = 0;
+		void countErr(std::string msg, std::string tok, bool fatal) { ++gErrorCt; }
+		LDParse::ErrF gErrF = &countErr;
+
+		double processCpuMs(){
+			struct rusage usage;
+			getrusage(RUSAGE_SELF, &usage);
+			return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1e3 + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e3;
+		}
+
+		long peakRSSKiB(){
+			struct rusage usage;
+			getrusage(RUSAGE_SELF, &usage);
+			return usage.ru_maxrss; // KiB on Linux
+		}
+
+		double perSecond(double count, double ms){ return ms > 0 ? count * 1e3 / ms : 0; }
+	}
+
+	int profile(int argc, const char * argv[]){
+		bool json = false, intern = false;
+		std::string libraryDir;
+		std::vector<std::string> paths;
+		for(int i = 0; i < argc; ++i){
+			const std::string arg = argv[i];
+			if(arg == "--json") json = true;
+			else if(arg == "--intern") intern = true;
+			else if(arg == "--library" && i + 1 < argc) libraryDir = argv[++i];
+			else collect(arg, true, paths);
+		}
+		if(paths.empty()){
+			std::cerr << "No files to profile" << std::endl;
+			return -1;
+		}
+
+		LDParse::ColorTable colors;
+		LDParse::Library library(colors);
+		if(libraryDir.size()){
+			library.addRoot(libraryDir);
+			std::ifstream config(libraryDir + "/LDConfig.ldr");
+			if(config){
+				LDParse::ModelBuilder<LDParse::ErrF> configBuilder(gErrF);
+				delete configBuilder.construct(libraryDir + "/LDConfig.ldr", "LDConfig.ldr", config, colors, LDParse::ConfigT);
+			}
+		}
+
+#ifdef LDPARSE_INSTRUMENT
+		LDParse::Trace::reset();
+#endif
+		std::vector<FileProfile> files;
+		files.reserve(paths.size());
+		const uint64_t allocsBefore = gAllocCt.load(), allocBytesBefore = gAllocBytes.load();
+		const double cpuBefore = processCpuMs();
+		const std::chrono::steady_clock::time_point wallBefore = std::chrono::steady_clock::now();
+		for(auto it = paths.begin(); it != paths.end(); ++it){
+			FileProfile file = FileProfile();
+			file.mPath = *it;
+			std::ifstream in(*it, std::ios::binary);
+			in.seekg(0, std::ios::end);
+			file.mBytes = std::max<std::streamoff>(0, in.tellg());
+			in.seekg(0);
+
+			const uint64_t errors = gErrorCt, allocs = gAllocCt.load(), allocBytes = gAllocBytes.load();
+#ifdef LDPARSE_INSTRUMENT
+			const LDParse::Trace::Stats stats = LDParse::Trace::snapshot();
+#endif
+			const double cpu = processCpuMs();
+			const std::chrono::steady_clock::time_point wall = std::chrono::steady_clock::now();
+			{
+				// Each file's Models go when its arena does, so one file's garbage doesn't count against the next
+				LDParse::Arena arena;
+				LDParse::ModelBuilder<LDParse::ErrF> builder(gErrF);
+				builder.setArena(&arena);
+				if(libraryDir.size() || intern) builder.setLibrary(&library);
+				builder.setInterning(intern);
+				file.mBuilt = in && builder.construct(*it, *it, in, colors) != nullptr;
+			}
+			file.mWallMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - wall).count();
+			file.mCpuMs = processCpuMs() - cpu;
+			file.mErrors = gErrorCt - errors;
+			file.mAllocs = gAllocCt.load() - allocs;
+			file.mAllocBytes = gAllocBytes.load() - allocBytes;
+#ifdef LDPARSE_INSTRUMENT
+			const LDParse::Trace::Stats after = LDParse::Trace::snapshot();
+			file.mLines = after.mCounters[LDParse::Trace::Lines] - stats.mCounters[LDParse::Trace::Lines];
+			file.mTokens = after.mCounters[LDParse::Trace::Tokens] - stats.mCounters[LDParse::Trace::Tokens];
+#endif
+			files.push_back(file);
+		}
+		const double wallMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - wallBefore).count();
+		const double cpuMs = processCpuMs() - cpuBefore;
+		const uint64_t allocCt = gAllocCt.load() - allocsBefore, allocBytes = gAllocBytes.load() - allocBytesBefore;
+
+		const LDParse::InternStats interned = library.getInternStats();
+		uint64_t totalBytes = 0, failed = 0;
+		for(auto it = files.begin(); it != files.end(); ++it){
+			totalBytes += it->mBytes;
+			failed += !it->mBuilt;
+		}
+#ifdef LDPARSE_INSTRUMENT
+		const LDParse::Trace::Stats stats = LDParse::Trace::snapshot();
+		const uint64_t lines = stats.mCounters[LDParse::Trace::Lines], tokens = stats.mCounters[LDParse::Trace::Tokens];
+		// Boundary and parse run inside build; lex runs inside boundary
+		const LDParse::Trace::Phase phases[] = {LDParse::Trace::LexPhase, LDParse::Trace::BoundaryPhase, LDParse::Trace::ParsePhase, LDParse::Trace::BuildPhase};
+#endif
+
+		if(json){
+			std::cout << "{\"files\":[";
+			for(auto it = files.begin(); it != files.end(); ++it){
+				std::cout << (it == files.begin() ? "" : ",") << "{\"path\":" << jsonString(it->mPath) << ",\"built\":" << (it->mBuilt ? "true" : "false")
+				<< ",\"bytes\":" << it->mBytes << ",\"errors\":" << it->mErrors << ",\"wallMs\":" << it->mWallMs << ",\"cpuMs\":" << it->mCpuMs
+				<< ",\"allocations\":" << it->mAllocs << ",\"allocatedBytes\":" << it->mAllocBytes;
+#ifdef LDPARSE_INSTRUMENT
+				std::cout << ",\"lines\":" << it->mLines << ",\"tokens\":" << it->mTokens;
+#endif
+				std::cout << "}";
+			}
+			std::cout << "],\"total\":{\"files\":" << files.size() << ",\"failed\":" << failed << ",\"bytes\":" << totalBytes
+			<< ",\"wallMs\":" << wallMs << ",\"cpuMs\":" << cpuMs << ",\"bytesPerSecond\":" << perSecond(totalBytes, wallMs)
+			<< ",\"allocations\":" << allocCt << ",\"allocatedBytes\":" << allocBytes << ",\"peakRSSKiB\":" << peakRSSKiB();
+			if(intern) std::cout << ",\"intern\":{\"lookups\":" << interned.mLookups << ",\"hits\":" << interned.mHits << ",\"models\":" << interned.mModels << "}";
+#ifdef LDPARSE_INSTRUMENT
+			std::cout << ",\"lines\":" << lines << ",\"tokens\":" << tokens
+			<< ",\"linesPerSecond\":" << perSecond(lines, wallMs) << ",\"tokensPerSecond\":" << perSecond(tokens, wallMs) << "},\"phases\":{";
+			for(size_t i = 0; i < LDParse::Trace::PhaseCount; ++i){
+				std::cout << (i ? "," : "") << "\"" << LDParse::Trace::phaseName(phases[i]) << "\":{\"calls\":" << stats.mPhaseCalls[phases[i]]
+				<< ",\"wallMs\":" << stats.mPhaseNanos[phases[i]] / 1e6 << ",\"cpuMs\":" << stats.mPhaseCpuNanos[phases[i]] / 1e6 << "}";
+			}
+			std::cout << "},\"counters\":{";
+			for(size_t i = 0; i < LDParse::Trace::CounterCount; ++i){
+				std::cout << (i ? "," : "") << "\"" << LDParse::Trace::counterName((LDParse::Trace::Counter)i) << "\":" << stats.mCounters[i];
+			}
+#endif
+			std::cout << "}}" << std::endl;
+		} else {
+			printf("%-40s %6s %10s %10s %10s %10s %12s\n", "file", "built", "KiB", "wall ms", "cpu ms", "allocs", "alloc KiB");
+			for(auto it = files.begin(); it != files.end(); ++it){
+				const std::string name = it->mPath.size() > 40 ? "..." + it->mPath.substr(it->mPath.size() - 37) : it->mPath;
+				printf("%-40s %6s %10.1f %10.2f %10.2f %10llu %12.1f\n", name.c_str(), it->mBuilt ? "yes" : "NO", it->mBytes / 1024.0,
+					   it->mWallMs, it->mCpuMs, (unsigned long long)it->mAllocs, it->mAllocBytes / 1024.0);
+			}
+			printf("\n%zu files (%llu failed), %.1f KiB in %.2f ms wall, %.2f ms cpu: %.2f MB/s\n", files.size(), (unsigned long long)failed,
+				   totalBytes / 1024.0, wallMs, cpuMs, perSecond(totalBytes, wallMs) / 1e6);
+			printf("%llu allocations, %.1f KiB allocated, peak RSS %.1f MiB\n", (unsigned long long)allocCt, allocBytes / 1024.0, peakRSSKiB() / 1024.0);
+			if(intern){
+				printf("%zu of %zu models shared by content (%.1f%%), %zu distinct\n", interned.mHits, interned.mLookups,
+					   interned.mLookups ? 100.0 * interned.mHits / interned.mLookups : 0.0, interned.mModels);
+			}
+#ifdef LDPARSE_INSTRUMENT
+			printf("%llu lines (%.0f/s), %llu tokens (%.0f/s)\n", (unsigned long long)lines, perSecond(lines, wallMs),
+				   (unsigned long long)tokens, perSecond(tokens, wallMs));
+			printf("\n%-10s %10s %12s %12s\n", "phase", "calls", "wall ms", "cpu ms");
+			for(size_t i = 0; i < LDParse::Trace::PhaseCount; ++i){
+				const LDParse::Trace::Phase p = phases[i];
+				if(p == LDParse::Trace::LexPhase) printf("%-10s %10llu %12.2f %12s\n", LDParse::Trace::phaseName(p), (unsigned long long)stats.mPhaseCalls[p], stats.mPhaseNanos[p] / 1e6, "-");
+				else printf("%-10s %10llu %12.2f %12.2f\n", LDParse::Trace::phaseName(p), (unsigned long long)stats.mPhaseCalls[p], stats.mPhaseNanos[p] / 1e6, stats.mPhaseCpuNanos[p] / 1e6);
+			}
+			printf("\n");
+			for(size_t i = 0; i < LDParse::Trace::CounterCount; ++i){
+				printf("%-12s %llu\n", LDParse::Trace::counterName((LDParse::Trace::Counter)i), (unsigned long long)stats.mCounters[i]);
+			}
+#else
+			printf("(Build with LDPARSE_INSTRUMENT for per-phase times, line and token counts, and cache statistics)\n");
+#endif
+		}
+		return failed ? 1 : 0;
+	}
+}
@@ -0,0 +1,23 @@
+//
+//  Profile.hpp
+//  ParseTest
+//
+//  Created by Thomas Dickerson on 2/4/16.
+//  Copyright © 2016 StickFigure Graphic Productions. All rights reserved.
+//
+
+#ifndef Profile_h
+#define Profile_h
+
+namespace ParseTest {
+	/*
+	 * parsetest --profile [--json] [--intern] [--library <ldraw dir>] <file or directory>...
+	 * Builds each file (directories are searched for .ldr, .mpd and .dat files), and reports time, memory and allocations
+	 * per file and in total. Per-phase times, line and token counts and cache statistics come from LDParse's counters,
+	 * so they are only reported when built with LDPARSE_INSTRUMENT. With --intern, identical submodels and parts are shared across
+ * every file (see ModelBuilder::setInterning), and the share rate is reported.
+	 */
+	int profile(int argc, const char * argv[]);
+}
+
+#endif /* Profile_h */
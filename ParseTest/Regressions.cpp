@@ -0,0 +1,311 @@
+//
+//  Regressions.cpp
+//  ParseTest
+//
+//  Created by Thomas Dickerson on 2/12/16.
+//  Copyright © 2016 StickFigure Graphic Productions. All rights reserved.
+//
+
+#include "Regressions.hpp"
+
+#include <LDParse/ModelBuilder.hpp>
+#include <LDParse/Stream.hpp>
+#include <LDParse/Trace.hpp>
+#include <LDParse/Watch.hpp>
+
+#include <cstdio>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Reports what was expected when it wasn't the case, and fails the check it's in
+#define EXPECT(cond) do { if(!(cond)){ std::cerr << "  " << __FILE__ << ":" << __LINE__ << ": expected " << #cond << std::endl; return false; } } while(0)
+
+namespace ParseTest {
+	namespace {
+		void quiet(std::string, std::string, bool) {}
+		LDParse::ErrF quietF = &quiet;
+
+		// Builds src as a file called name, with the given library (if any) and interning
+		LDParse::Model * build(const std::string &name, const std::string &src, LDParse::ColorTable &colors, LDParse::Library * library = nullptr, bool interning = false){
+			std::istringstream in(src);
+			LDParse::ModelBuilder<LDParse::ErrF> builder(quietF);
+			builder.setLibrary(library);
+			builder.setInterning(interning);
+			return builder.construct(name, name, in, colors);
+		}
+
+		// Colour codes of a model's flattened triangles, one per vertex, in order
+		std::vector<uint32_t> flatColours(const LDParse::Model &model){
+			LDParse::LDMesh mesh;
+			model.flatten(mesh);
+			return std::get<2>(mesh.attributes);
+		}
+
+		// A hex colour is a direct colour, and a decimal one is a code, so the two mustn't be interned as one submodel
+		bool hexColoursFingerprint(){
+			const std::string src =
+			"0 FILE main.ldr\n1 16 0 0 0 1 0 0 0 1 0 0 0 1 hex.ldr\n1 16 0 0 0 1 0 0 0 1 0 0 0 1 dec.ldr\n"
+			"0 FILE hex.ldr\n3 #2FF0000 0 0 0 1 0 0 0 1 0\n"
+			"0 FILE dec.ldr\n3 50266112 0 0 0 1 0 0 0 1 0\n";
+			LDParse::ColorTable colors;
+			LDParse::Model * plain = build("main.ldr", src, colors);
+			LDParse::Library library(colors);
+			LDParse::Model * interned = build("main.ldr", src, colors, &library, true);
+			EXPECT(plain && interned);
+			const std::vector<uint32_t> expect = flatColours(*plain), got = flatColours(*interned);
+			delete plain;
+			delete interned;
+			EXPECT(expect.size() == 6 && expect[0] != expect[3] && expect[3] == 50266112);
+			EXPECT(got == expect);
+			return true;
+		}
+
+		// Whether every normal is the unit vector along (x, y, z)
+		bool normalsAlong(const std::vector<LDParse::Position> &normals, float x, float y, float z){
+			const float len = std::sqrt(x * x + y * y + z * z);
+			for(auto it = normals.begin(); it != normals.end(); ++it){
+				if(std::fabs(std::get<0>(*it) - x / len) > 1e-5f || std::fabs(std::get<1>(*it) - y / len) > 1e-5f || std::fabs(std::get<2>(*it) - z / len) > 1e-5f) return false;
+			}
+			return true;
+		}
+
+		// A part that's scaled unevenly has its normals scaled by the inverse, or they stop being perpendicular to its faces
+		bool scaledNormals(){
+			// The face's normal is (1, 1, 0); stretched four times along y, it's (1, 1/4, 0), and mirrored in x, (-1, 1, 0)
+			const std::string src =
+			"0 FILE main.ldr\n1 16 0 0 0 1 0 0 0 4 0 0 0 1 face.ldr\n1 16 0 0 0 -1 0 0 0 1 0 0 0 1 face.ldr\n"
+			"0 FILE face.ldr\n3 16 1 0 0 0 1 0 0 1 1\n";
+			LDParse::ColorTable colors;
+			LDParse::Model * model = build("main.ldr", src, colors);
+			EXPECT(model);
+			LDParse::LDMesh mesh;
+			model->flatten(mesh);
+			const std::vector<LDParse::Position> &normals = std::get<1>(mesh.attributes);
+			std::vector<LDParse::Position> streamed;
+			LDParse::flattenStreaming(*model, [&](const LDParse::MeshChunk &chunk){
+				const std::vector<LDParse::Position> &n = std::get<1>(chunk.mMesh.attributes);
+				streamed.insert(streamed.end(), n.begin(), n.end());
+			});
+			// Chunks too small for a whole instance are filled a triangle at a time, which transforms normals separately
+			LDParse::StreamOptions piecewise;
+			piecewise.mChunkVertices = piecewise.mChunkIndices = 4;
+			size_t scaled = 0, mirrored = 0;
+			LDParse::flattenStreaming(*model, [&](const LDParse::MeshChunk &chunk){
+				const std::vector<LDParse::Position> &n = std::get<1>(chunk.mMesh.attributes);
+				scaled += normalsAlong(n, 1.f, .25f, 0.f);
+				mirrored += normalsAlong(n, -1.f, 1.f, 0.f);
+			}, piecewise);
+			delete model;
+			EXPECT(normals.size() == 6 && streamed == normals);
+			EXPECT(scaled == 2 && mirrored == 2); // Front and back faces of each
+			EXPECT(normalsAlong(std::vector<LDParse::Position>(normals.begin(), normals.begin() + 3), 1.f, .25f, 0.f));
+			EXPECT(normalsAlong(std::vector<LDParse::Position>(normals.begin() + 3, normals.end()), -1.f, 1.f, 0.f));
+			return true;
+		}
+
+		// Exact bounds go through the structure-of-arrays kernels, four vertices at a time and then whatever's left over
+		bool exactBounds(){
+			const std::string src =
+			"0 FILE main.ldr\n1 16 10 -20 30 0 0 2 0 1 0 -3 0 0 part.ldr\n"
+			"0 FILE part.ldr\n3 16 1 0 0 0 1 0 0 1 1\n4 16 -1 -2 -3 2 -2 -3 2 5 -3 -1 5 7\n2 24 0 0 0 9 9 9\n";
+			LDParse::ColorTable colors;
+			LDParse::Model * model = build("main.ldr", src, colors);
+			EXPECT(model);
+			LDParse::LDMesh mesh;
+			model->flatten(mesh);
+			LDParse::AABB expect;
+			const std::vector<LDParse::Position> &positions = std::get<0>(mesh.attributes);
+			for(auto it = positions.begin(); it != positions.end(); ++it) expect.extend(*it);
+			const LDParse::AABB got = model->getExactBounds();
+			delete model;
+			EXPECT(positions.size() > 8 && positions.size() % 4);
+			for(size_t axis = 0; axis < 3; ++axis) EXPECT(std::fabs(got.lo[axis] - expect.lo[axis]) < 1e-4f && std::fabs(got.hi[axis] - expect.hi[axis]) < 1e-4f);
+			return true;
+		}
+
+		// However small the chunks asked for, none comes out empty, or over the (clamped) limits
+		bool smallestChunks(){
+			const std::string src =
+			"0 FILE main.ldr\n1 16 0 0 0 1 0 0 0 1 0 0 0 1 edges.ldr\n1 16 0 0 0 1 0 0 0 1 0 0 0 1 faces.ldr\n"
+			"0 FILE edges.ldr\n5 24 0 0 0 1 0 0 0 1 0 0 -1 0\n5 24 0 0 0 0 1 0 1 0 0 -1 0 0\n5 24 1 0 0 0 1 0 0 0 0 1 1 0\n"
+			"0 FILE faces.ldr\n4 16 0 0 0 1 0 0 1 1 0 0 1 0\n2 24 0 0 0 1 0 0\n5 24 0 0 0 1 1 0 1 0 0 0 1 0\n";
+			LDParse::ColorTable colors;
+			LDParse::Model * model = build("main.ldr", src, colors);
+			EXPECT(model);
+			LDParse::LDMesh mesh;
+			LDParse::OptLineBuffer optLines;
+			model->flatten(mesh, LDParse::MainColour, &optLines);
+
+			const size_t limits[] = {1, 4};
+			for(size_t limit : limits){
+				LDParse::StreamOptions options;
+				options.mChunkVertices = options.mChunkIndices = limit;
+				options.mOptLines = true;
+				size_t chunks = 0, empty = 0, over = 0, triangles = 0, streamedOptLines = 0;
+				const LDParse::StreamStats stats = LDParse::flattenStreaming(*model, [&](const LDParse::MeshChunk &chunk){
+					const size_t vertices = chunk.mMesh.vertexCount() + 4 * chunk.mOptLines.size();
+					++chunks;
+					empty += !vertices && !chunk.indexCount();
+					over += vertices > 4 || chunk.indexCount() > 4;
+					triangles += (chunk.mMesh.indices.size() + chunk.mMesh.bfIndices.size()) / 3;
+					streamedOptLines += chunk.mOptLines.size();
+				}, options);
+				EXPECT(!empty && !over && chunks == stats.chunks);
+				EXPECT(triangles == (mesh.indices.size() + mesh.bfIndices.size()) / 3 && streamedOptLines == optLines.size());
+			}
+			delete model;
+			EXPECT(optLines.size() == 4);
+			return true;
+		}
+
+		// rm -rf, near enough
+		void removeTree(const std::string &path){
+			DIR * d = opendir(path.c_str());
+			if(d == nullptr){
+				unlink(path.c_str());
+				return;
+			}
+			struct dirent * ent;
+			while((ent = readdir(d)) != nullptr){
+				const std::string entName = ent->d_name;
+				if(entName != "." && entName != "..") removeTree(path + "/" + entName);
+			}
+			closedir(d);
+			rmdir(path.c_str());
+		}
+
+		// A watched directory that's moved or deleted has to take its files' names (and whatever was built from them) with it
+		bool watchedDirectoryGone(){
+#ifdef LDPARSE_WITH_INOTIFY
+			char tmpl[] = "/tmp/ldparse-watch-XXXXXX";
+			if(mkdtemp(tmpl) == nullptr) return false;
+			const std::string root = tmpl, parts = root + "/parts";
+			mkdir(parts.c_str(), 0755);
+			mkdir((parts + "/s").c_str(), 0755);
+			std::ofstream(parts + "/s/x.dat") << "3 16 0 0 0 1 0 0 0 1 0\n";
+			std::ofstream(parts + "/a.dat") << "1 16 0 0 0 1 0 0 0 1 0 0 0 1 s\\x.dat\n";
+
+			bool ok = [&]() -> bool {
+				LDParse::ColorTable colors;
+				LDParse::Library library(colors);
+				library.addRoot(root);
+				LDParse::WatchOptions options;
+				options.mRebuild = false;
+				LDParse::Watcher watcher(library, options);
+				EXPECT(watcher.watchLibrary());
+				LDParse::ModelBuilder<LDParse::ErrF> builder(quietF);
+				builder.setLibrary(&library);
+				EXPECT(builder.require("a.dat"));
+				EXPECT(library.find("s\\x.dat") && library.find("a.dat"));
+
+				// Moved within the library: gone under the old name, there under the new one
+				EXPECT(!rename((parts + "/s").c_str(), (parts + "/t").c_str()));
+				watcher.poll(1000);
+				EXPECT(!library.locate("s\\x.dat") && library.locate("t\\x.dat"));
+				EXPECT(!library.find("s\\x.dat") && !library.find("a.dat"));
+				const LDParse::Model * rebuilt = builder.require("a.dat");
+				EXPECT(rebuilt && flatColours(*rebuilt).empty()); // Its include doesn't resolve any more
+
+				// Still watched under its new name, even though it's the same directory
+				std::ofstream(parts + "/t/y.dat") << "3 16 0 0 0 1 0 0 0 1 0\n";
+				watcher.poll(1000);
+				EXPECT(library.locate("t\\y.dat"));
+
+				// Deleted
+				EXPECT(builder.require("t\\x.dat"));
+				removeTree(parts + "/t");
+				watcher.poll(1000);
+				EXPECT(!library.locate("t\\x.dat") && !library.locate("t\\y.dat") && !library.find("t\\x.dat"));
+				const std::vector<LDParse::Library::IndexedDirectory> dirs = library.getDirectories();
+				for(auto it = dirs.begin(); it != dirs.end(); ++it) EXPECT(it->mPath.find(parts + "/s") && it->mPath.find(parts + "/t"));
+
+				// And the events that come after it for the directory's own watch don't leave anything behind
+				EXPECT(!watcher.poll(100));
+				return true;
+			}();
+			removeTree(root);
+			return ok;
+#else
+			return true; // Nothing to watch with
+#endif
+		}
+
+		// Lines parsed again (after a SwitchFile, or a suspension) aren't counted again, and nor are builds inside another
+		bool instrumentCounts(){
+#ifdef LDPARSE_INSTRUMENT
+			char tmpl[] = "/tmp/ldparse-trace-XXXXXX";
+			if(mkdtemp(tmpl) == nullptr) return false;
+			const std::string dir = tmpl;
+			std::ofstream(dir + "/part.dat") << "3 16 0 0 0 1 0 0 0 1 0\n";
+
+			bool ok = [&]() -> bool {
+				const std::string src =
+				"0 FILE main.ldr\n1 16 0 0 0 1 0 0 0 1 0 0 0 1 sub.ldr\n1 16 0 0 0 1 0 0 0 1 0 0 0 1 part.dat\n"
+				"0 FILE sub.ldr\n3 16 0 0 0 1 0 0 0 1 0\n";
+				LDParse::ColorTable colors;
+				LDParse::Library library(colors);
+				library.addSearchDirectory(dir, LDParse::PartT);
+				LDParse::ModelBuilder<LDParse::ErrF> builder(quietF);
+				builder.setLibrary(&library);
+				size_t asked = 0;
+				builder.setDeferral([&](const std::string &, const LDParse::Library::Entry &){ return !asked++; });
+
+				LDParse::Trace::reset();
+				std::istringstream in(src);
+				EXPECT(builder.start("main.ldr", "main.ldr", in, colors));
+				EXPECT(builder.suspended());
+				EXPECT(builder.resume() && !builder.suspended());
+				delete builder.result();
+				const LDParse::Trace::Stats stats = LDParse::Trace::snapshot();
+				EXPECT(stats.mCounters[LDParse::Trace::Lines] == 8); // Five, part.dat's one, and the empty line each file's stream ends with
+				EXPECT(stats.mCounters[LDParse::Trace::Includes] == 2);
+				EXPECT(stats.mCounters[LDParse::Trace::SwitchFiles] == 1);
+				EXPECT(stats.mPhaseCalls[LDParse::Trace::BuildPhase] == 1); // part.dat was built inside main.ldr's resume
+				return true;
+			}();
+			removeTree(dir);
+			return ok;
+#else
+			return true; // Nothing to count with
+#endif
+		}
+
+		struct Check {
+			const char * mName;
+			bool (*mRun)();
+		};
+
+		const Check checks[] = {
+			{"hex-colours-fingerprint", &hexColoursFingerprint},
+			{"watched-directory-gone", &watchedDirectoryGone},
+			{"scaled-normals", &scaledNormals},
+			{"exact-bounds", &exactBounds},
+			{"smallest-chunks", &smallestChunks},
+			{"instrument-counts", &instrumentCounts},
+		};
+	}
+
+	int regressions(int argc, const char * argv[]){
+		size_t ran = 0, failed = 0;
+		for(const Check &check : checks){
+			bool wanted = argc == 0;
+			for(int i = 0; i < argc && !wanted; ++i) wanted = !strcmp(argv[i], check.mName);
+			if(!wanted) continue;
+			const bool ok = check.mRun();
+			std::cout << (ok ? "ok     " : "FAILED ") << check.mName << std::endl;
+			++ran;
+			failed += !ok;
+		}
+		std::cout << ran << " checks, " << failed << " failed" << std::endl;
+		return (failed || !ran) ? 1 : 0;
+	}
+}
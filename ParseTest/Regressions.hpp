@@ -0,0 +1,21 @@
+//
+//  Regressions.hpp
+//  ParseTest
+//
+//  Created by Thomas Dickerson on 2/12/16.
+//  Copyright © 2016 StickFigure Graphic Productions. All rights reserved.
+//
+
+#ifndef Regressions_h
+#define Regressions_h
+
+namespace ParseTest {
+	/*
+	 * parsetest --regressions [<name>...]
+	 * Runs the checks in Regressions.cpp (all of them, or just those named), each against small files it makes for itself,
+	 * and prints how each went. Exits with 1 if any failed. This is what CTest runs.
+	 */
+	int regressions(int argc, const char * argv[]);
+}
+
+#endif /* Regressions_h */
@@ -0,0 +1,84 @@
+//
+//  ValidateFiles.cpp
+//  ParseTest
+//
+//  Created by Thomas Dickerson on 2/11/16.
+//  Copyright © 2016 StickFigure Graphic Productions. All rights reserved.
+//
+
+#include "ValidateFiles.hpp"
+#include "Files.hpp"
+
+#include <LDParse/Validate.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace ParseTest {
+	int validate(int argc, const char * argv[]){
+		bool json = false;
+		std::string libraryDir;
+		LDParse::ValidateOptions options;
+		std::vector<std::string> paths;
+		for(int i = 0; i < argc; ++i){
+			const std::string arg = argv[i];
+			if(arg == "--json") json = true;
+			else if(arg == "--threads" && i + 1 < argc) options.mThreads = strtoul(argv[++i], nullptr, 10);
+			else if(arg == "--library" && i + 1 < argc) libraryDir = argv[++i];
+			else collect(arg, true, paths);
+		}
+		if(paths.empty()){
+			std::cerr << "No files to validate" << std::endl;
+			return -1;
+		}
+
+		LDParse::ColorTable colors;
+		LDParse::Library library(colors);
+		if(libraryDir.size()) library.addRoot(libraryDir);
+		std::vector<LDParse::BatchSource> sources(paths.begin(), paths.end());
+
+		const std::chrono::steady_clock::time_point wallBefore = std::chrono::steady_clock::now();
+		const std::vector<LDParse::ValidationResult> results = LDParse::validateBatch(sources, libraryDir.size() ? &library : nullptr, options);
+		const double wallMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - wallBefore).count();
+
+		size_t failed = 0, errors = 0, warnings = 0, lines = 0;
+		for(auto it = results.begin(); it != results.end(); ++it){
+			failed += !it->mOk;
+			errors += it->mErrors;
+			warnings += it->mWarnings;
+			lines += it->mLines;
+		}
+
+		if(json){
+			std::cout << "{\"files\":[";
+			bool first = true;
+			for(auto it = results.begin(); it != results.end(); ++it){
+				if(it->mOk && it->mDiagnostics.empty()) continue;
+				std::cout << (first ? "" : ",") << "{\"path\":" << jsonString(it->mPath) << ",\"ok\":" << (it->mOk ? "true" : "false")
+				<< ",\"lines\":" << it->mLines << ",\"models\":" << it->mModels << ",\"errors\":" << it->mErrors << ",\"warnings\":" << it->mWarnings << ",\"diagnostics\":[";
+				for(auto dIt = it->mDiagnostics.begin(); dIt != it->mDiagnostics.end(); ++dIt){
+					std::cout << (dIt == it->mDiagnostics.begin() ? "" : ",") << "{\"message\":" << jsonString(dIt->mMessage)
+					<< ",\"token\":" << jsonString(dIt->mToken) << ",\"fatal\":" << (dIt->mFatal ? "true" : "false") << "}";
+				}
+				std::cout << "]}";
+				first = false;
+			}
+			std::cout << "],\"total\":{\"files\":" << results.size() << ",\"failed\":" << failed << ",\"errors\":" << errors
+			<< ",\"warnings\":" << warnings << ",\"lines\":" << lines << ",\"wallMs\":" << wallMs << "}}" << std::endl;
+		} else {
+			for(auto it = results.begin(); it != results.end(); ++it){
+				if(it->mOk && it->mDiagnostics.empty()) continue;
+				printf("%s: %s, %zu errors, %zu warnings\n", it->mPath.c_str(), it->mOk ? "ok" : "FAILED", it->mErrors, it->mWarnings);
+				for(auto dIt = it->mDiagnostics.begin(); dIt != it->mDiagnostics.end(); ++dIt){
+					printf("\t%s: %s ( %s )\n", dIt->mFatal ? "Error" : "Warning", dIt->mMessage.c_str(), dIt->mToken.c_str());
+				}
+			}
+			printf("\n%zu files (%zu failed), %zu lines: %zu errors, %zu warnings in %.2f ms\n", results.size(), failed, lines, errors, warnings, wallMs);
+		}
+		return failed ? 1 : 0;
+	}
+}
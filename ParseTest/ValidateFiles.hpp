@@ -0,0 +1,22 @@
+//
+//  ValidateFiles.hpp
+//  ParseTest
+//
+//  Created by Thomas Dickerson on 2/11/16.
+//  Copyright © 2016 StickFigure Graphic Productions. All rights reserved.
+//
+
+#ifndef ValidateFiles_h
+#define ValidateFiles_h
+
+namespace ParseTest {
+	/*
+	 * parsetest --validate [--json] [--threads <n>] [--library <ldraw dir>] <file or directory>...
+	 * Checks each file with LDParse::validateBatch, in parallel, building nothing. Files with diagnostics are listed along with them,
+	 * followed by totals. With --library, includes that aren't in the library's index (or the file itself, for submodels) are reported.
+	 * Exits with 1 if any file wouldn't have built.
+	 */
+	int validate(int argc, const char * argv[]);
+}
+
+#endif /* ValidateFiles_h */
@@ -13,6 +13,10 @@
 #include <LDParse/Model.hpp>
 #include <LDParse/ModelBuilder.hpp>
 
+#include "Profile.hpp"
+#include "Regressions.hpp"
+#include "ValidateFiles.hpp"
+
 void err(std::string msg, std::string tok, bool fatal) {
 	std::cerr << (fatal ? "Error: " : "Warning: ") << msg << " ( " << tok << " )" << std::endl;
 	if(fatal) exit(-1);
@@ -45,8 +49,15 @@ static LDParse::MPDF mpdHandler = [](boost::optional<const std::string &> file)
 int main(int argc, const char * argv[]) {
 	if(argc < 2){
 		std::cerr << "Requires a filename to run" << std::endl;
+		std::cerr << "Usage: " << argv[0] << " <file>" << std::endl;
+		std::cerr << "       " << argv[0] << " --profile [--json] [--intern] [--library <ldraw dir>] <file or directory>..." << std::endl;
+		std::cerr << "       " << argv[0] << " --validate [--json] [--threads <n>] [--library <ldraw dir>] <file or directory>..." << std::endl;
+		std::cerr << "       " << argv[0] << " --regressions [<name>...]" << std::endl;
 		exit(-1);
 	}
+	if(std::string(argv[1]) == "--profile") return ParseTest::profile(argc - 2, argv + 2);
+	if(std::string(argv[1]) == "--validate") return ParseTest::validate(argc - 2, argv + 2);
+	if(std::string(argv[1]) == "--regressions") return ParseTest::regressions(argc - 2, argv + 2);
 	std::string fileName = argv[1];
 	std::ifstream file(fileName);
 	
@@ -0,0 +1,114 @@
+//
+//  Arena.hpp
+//  LDParse
+//
+//  Created by Thomas Dickerson on 2/2/16.
+//  Copyright © 2016 StickFigure Graphic Productions. All rights reserved.
+//
+
+#ifndef Arena_h
+#define Arena_h
+
+#include <stddef.h>
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace LDParse {
+
+	constexpr static const size_t ArenaBlockSize = 1 << 16;
+
+	/*
+	 * Bump allocation for the many small objects a load creates (Models, cache nodes, index entries), which all die together.
+	 * Everything made here is destroyed, in reverse order of creation, when the Arena is, and not before: pointers into an Arena
+	 * are owned by it, never by whoever holds them (see ArenaDelete). So an Arena has to outlive everything that can still reach
+	 * what it made. make() is safe to call from any thread.
+	 */
+	class Arena {
+		struct Finalizer {
+			void (*mDestroy)(void *);
+			void * mObject;
+		};
+
+		std::vector<char *> mBlocks;
+		char * mCursor;
+		size_t mRemaining;
+		size_t mBytes;
+		std::vector<Finalizer> mFinalizers;
+		mutable std::mutex mLock;
+
+		template<typename T> static void destroy(void * object){ static_cast<T*>(object)->~T(); }
+
+		void * allocate(size_t bytes, size_t align){
+			std::lock_guard<std::mutex> lock(mLock);
+			size_t pad = (align - ((size_t)mCursor & (align - 1))) & (align - 1);
+			if(mCursor == nullptr || pad + bytes > mRemaining){
+				// Anything too big to share a block gets one of its own, so the current block isn't wasted
+				const size_t blockBytes = std::max(ArenaBlockSize, bytes + align);
+				char * block = static_cast<char *>(::operator new(blockBytes));
+				mBlocks.push_back(block);
+				if(bytes + align > ArenaBlockSize){
+					mBytes += bytes;
+					return block + ((align - ((size_t)block & (align - 1))) & (align - 1));
+				}
+				mCursor = block;
+				mRemaining = blockBytes;
+				pad = (align - ((size_t)mCursor & (align - 1))) & (align - 1);
+			}
+			void * ret = mCursor + pad;
+			mCursor += pad + bytes;
+			mRemaining -= pad + bytes;
+			mBytes += bytes;
+			return ret;
+		}
+	public:
+		Arena() : mCursor(nullptr), mRemaining(0), mBytes(0) {}
+		~Arena(){
+			for(auto it = mFinalizers.rbegin(); it != mFinalizers.rend(); ++it) it->mDestroy(it->mObject);
+			for(auto it = mBlocks.begin(); it != mBlocks.end(); ++it) ::operator delete(*it);
+		}
+		Arena(const Arena &) = delete;
+		Arena& operator=(const Arena &) = delete;
+
+		template<typename T, typename ...ArgTs> T * make(ArgTs&&... args){
+			T * ret = new(allocate(sizeof(T), alignof(T))) T(std::forward<ArgTs>(args)...);
+			if(!std::is_trivially_destructible<T>::value){
+				std::lock_guard<std::mutex> lock(mLock);
+				mFinalizers.push_back({&destroy<typename std::remove_cv<T>::type>, (void *)ret});
+			}
+			return ret;
+		}
+
+		// Bytes handed out so far, not counting alignment padding or the unused tail of each block
+		size_t bytesUsed() const { std::lock_guard<std::mutex> lock(mLock); return mBytes; }
+		size_t blockCount() const { std::lock_guard<std::mutex> lock(mLock); return mBlocks.size(); }
+	};
+
+	/*
+	 * The deleter for pointers that may or may not have come from an Arena. Heap objects are deleted as usual;
+	 * objects in an Arena are left for the Arena to destroy. Plain unique_ptrs convert to ArenaPtrs implicitly.
+	 */
+	template<typename T> struct ArenaDelete {
+		bool mInArena;
+
+		ArenaDelete(bool inArena = false) : mInArena(inArena) {}
+		template<typename U> ArenaDelete(const std::default_delete<U> &) : mInArena(false) {}
+		template<typename U> ArenaDelete(const ArenaDelete<U> &o) : mInArena(o.mInArena) {}
+
+		void operator()(T * p) const { if(!mInArena) delete p; }
+	};
+
+	template<typename T> using ArenaPtr = std::unique_ptr<T, ArenaDelete<T> >;
+
+	// Makes a T in arena, or on the heap if there isn't one
+	template<typename T, typename ...ArgTs> ArenaPtr<T> makeIn(Arena * arena, ArgTs&&... args){
+		return arena ? ArenaPtr<T>(arena->make<T>(std::forward<ArgTs>(args)...), ArenaDelete<T>(true))
+					 : ArenaPtr<T>(new T(std::forward<ArgTs>(args)...));
+	}
+}
+
+#endif /* Arena_h */
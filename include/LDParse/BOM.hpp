@@ -0,0 +1,56 @@
+//
+//  BOM.hpp
+//  LDParse
+//
+//  Created by Thomas Dickerson on 2/9/16.
+//  Copyright © 2016 StickFigure Graphic Productions. All rights reserved.
+//
+
+#ifndef BOM_h
+#define BOM_h
+
+#include "Model.hpp"
+#include "Steps.hpp"
+
+#include <unordered_map>
+#include <vector>
+
+namespace LDParse {
+
+	struct BOMLine {
+		const Model * mPart;
+		uint32_t mColour; // Still 16 (or 24) if nothing between it and a root counted in colour 16 said otherwise
+		size_t mCount;
+	};
+
+	// Sorted by part name, then colour
+	typedef std::vector<BOMLine> BillOfMaterials;
+
+	/*
+	 * Counts the parts beneath a model, by colour. A part is any Model built from parts/ (SrcType PartT), and nothing inside one
+	 * is looked at. Nor is any geometry, so a model built with ModelBuilder::setIncludesOnly does just as well as a full one.
+	 * Each submodel is tallied once, with colour 16 left open, and that tally is reused wherever it's placed, so the cost
+	 * follows the size of the include DAG rather than the number of instances. Tallies are kept between calls, so the Models
+	 * must outlive the counter.
+	 */
+	class BOMCounter {
+		typedef std::pair<const Model *, uint32_t> Key;
+		struct KeyHash {
+			size_t operator()(const Key &k) const { return std::hash<const Model *>()(k.first) ^ ((size_t)k.second * 0x9e3779b97f4a7c15ull); }
+		};
+		typedef std::unordered_map<Key, size_t, KeyHash> Counts;
+
+		std::unordered_map<const Model *, BillOfMaterials> mTallies; // Relative to colour 16
+
+		const BillOfMaterials& tally(const Model &model);
+		void addChildren(Counts &into, const Model &model, uint32_t colour, const StepIndex * steps, size_t step);
+		static BillOfMaterials sorted(const Counts &counts);
+	public:
+		BillOfMaterials count(const Model &root, uint32_t colour = MainColour);
+		// Only what's on show once global step `step` is done, as StepIndex::visible has it. steps must have been made from root.
+		BillOfMaterials count(const Model &root, const StepIndex &steps, size_t step, uint32_t colour = MainColour);
+		void clear() { mTallies.clear(); }
+	};
+}
+
+#endif /* BOM_h */
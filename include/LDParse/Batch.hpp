@@ -0,0 +1,78 @@
+//
+//  Batch.hpp
+//  LDParse
+//
+//  Created by Thomas Dickerson on 2/1/16.
+//  Copyright © 2016 StickFigure Graphic Productions. All rights reserved.
+//
+
+#ifndef Batch_h
+#define Batch_h
+
+#include "Library.hpp"
+#include "Weld.hpp"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace LDParse {
+
+	struct Diagnostic {
+		std::string mMessage;
+		std::string mToken;
+		bool mFatal;
+	};
+
+	/*
+	 * An error handler that records what it's told, for builders that can't just print and exit.
+	 * The lexer keeps its own copy of its handler, so this only points at where diagnostics go; copies all record to the same place.
+	 */
+	class DiagnosticCollector {
+		std::vector<Diagnostic> * mOut;
+	public:
+		DiagnosticCollector(std::vector<Diagnostic> * out = nullptr) : mOut(out) {}
+		void retarget(std::vector<Diagnostic> * out) { mOut = out; }
+		void operator()(std::string msg, std::string tokText, bool fatal) const {
+			if(mOut) mOut->push_back({msg, tokText, fatal});
+		}
+	};
+
+	// One file to build. If mContents is set it's parsed from memory, and mPath is only used to name the result.
+	struct BatchSource {
+		std::string mPath;
+		std::string mName;
+		std::shared_ptr<const std::string> mContents;
+		SrcType mSrcType;
+
+		BatchSource(const std::string &path, SrcType srcType = UnknownT) : mPath(path), mName(path), mSrcType(srcType) {}
+		BatchSource(const std::string &name, std::shared_ptr<const std::string> contents, SrcType srcType = UnknownT)
+		: mPath(name), mName(name), mContents(contents), mSrcType(srcType) {}
+	};
+
+	struct BatchResult {
+		std::unique_ptr<Model> mModel; // Null if the file couldn't be read or parsed
+		std::vector<Diagnostic> mDiagnostics; // Including any raised while building the library files it was first to need
+	};
+
+	struct BatchOptions {
+		size_t mThreads; // 0 for one per hardware thread
+		boost::optional<float> mWeldEpsilon;
+		LODPolicy mLODPolicy;
+		bool mInterning; // Share identical submodels and parts across the batch, through library (see ModelBuilder::setInterning)
+
+		BatchOptions() : mThreads(0), mInterning(false) {}
+	};
+
+	/*
+	 * Builds every source, in parallel. Each worker has a ModelBuilder of its own (they carry per-file state), and takes the next
+	 * unbuilt source whenever it finishes one, so a few large files don't hold the rest up. All of them share library's cache, so a part
+	 * is normally built once for the whole batch; two workers that need the same new part at once may both build it, but only one copy is kept.
+	 * colorTable must already hold LDConfig's colours, and must not be changed until this returns. library may be null.
+	 * Results are in the same order as sources. If weldStats is given, every weld done along the way is added to it.
+	 */
+	std::vector<BatchResult> buildBatch(const std::vector<BatchSource> &sources, ColorTable &colorTable, Library * library,
+										const BatchOptions &options = BatchOptions(), WeldStats * weldStats = nullptr);
+}
+
+#endif /* Batch_h */
@@ -9,21 +9,26 @@
 #ifndef Cache_h
 #define Cache_h
 
+#include "Arena.hpp"
+
 #include <algorithm>
 #include <string>
 #include <vector>
 #include <locale>
 #include <iostream>
 #include <cassert>
+#include <memory>
 #include <boost/optional.hpp>
 
 namespace LDParse {
 	namespace Cache {
+		// Nodes below the root are made in the root's Arena, if it was given one; contents may come from anywhere (see ArenaDelete)
 		template<typename Contents> class CacheNode {
 		private:
-			std::unique_ptr<Contents> mContents;
+			ArenaPtr<Contents> mContents;
 			std::string mPrefix;
-			std::vector<std::unique_ptr<CacheNode>> mSuffixes; // Semantically, this is a set, but we don't use any of the nice set operations, so...
+			std::vector<ArenaPtr<CacheNode>> mSuffixes; // Semantically, this is a set, but we don't use any of the nice set operations, so...
+			Arena * mArena;
 			
 			inline static const std::string findCommonPrefix(const std::string& str1, const std::string& str2){
 				static std::locale fcpLocale;
@@ -89,7 +94,7 @@ namespace LDParse {
 				return retVal;
 			}
 			
-			CacheNode& insert(std::string nodeName, std::unique_ptr<Contents> contents, int depth = -1) {
+			CacheNode& insert(std::string nodeName, ArenaPtr<Contents> contents, int depth = -1) {
 				std::string ds;
 				if(depth >= 0){
 					depth++;
@@ -104,7 +109,6 @@ namespace LDParse {
 				CacheNode * retNode = nullptr;
 				if((mpS == 0 && cpS == 0) || (cpS < nnS && cpS == mpS)){ // ("","something") or ("cat","catsup")
 					curSuffix = nodeName.substr(cpS, nnS - cpS);
-					std::unique_ptr<CacheNode> sufNode(new CacheNode(curSuffix));
 					boost::optional<CacheNode&> checkNode = boost::none;
 					for(auto checkIt = mSuffixes.begin(); checkIt != mSuffixes.end() && (*checkIt); checkIt++) {
 						checkNode = **checkIt;
@@ -113,10 +117,9 @@ namespace LDParse {
 					}
 					
 					if(checkNode) {
-						// sufNode will delete itself, because yay unique_ptr
 						retNode = &(checkNode->insert(curSuffix, std::move(contents), depth));
 					} else {
-						sufNode->setContents(std::move(contents));
+						ArenaPtr<CacheNode> sufNode = makeIn<CacheNode>(mArena, curSuffix, std::move(contents), mArena);
 						retNode = sufNode.get();
 						mSuffixes.push_back(std::move(sufNode));
 					}
@@ -131,7 +134,7 @@ namespace LDParse {
 				} else if (cpS > 0 && cpS < mpS){ // ("catsup","cat")
 												  // We split!
 					curSuffix = mPrefix.substr(cpS, mpS - cpS);
-					std::unique_ptr<CacheNode> newChild(new CacheNode(curSuffix, std::move(mContents)));
+					ArenaPtr<CacheNode> newChild = makeIn<CacheNode>(mArena, curSuffix, std::move(mContents), mArena);
 					newChild->mSuffixes = std::move(mSuffixes);
 					
 					mSuffixes.clear();
@@ -142,7 +145,7 @@ namespace LDParse {
 						retNode = this;
 					} else{
 						curSuffix = nodeName.substr(cpS, nnS - cpS);
-						std::unique_ptr<CacheNode> sufNode(new CacheNode(curSuffix, std::move(contents)));
+						ArenaPtr<CacheNode> sufNode = makeIn<CacheNode>(mArena, curSuffix, std::move(contents), mArena);
 						retNode = sufNode.get();
 						mSuffixes.push_back(std::move(sufNode));
 					}
@@ -160,6 +163,24 @@ namespace LDParse {
 			}
 			
 			
+			// Drops whatever is stored under nodeName, leaving the node for the next insert. False if nothing was.
+			bool erase(std::string nodeName){
+				const std::string commonPrefix = findCommonPrefix(mPrefix, nodeName);
+				const size_t cpS = commonPrefix.size(), nnS = nodeName.size(), mpS = mPrefix.size();
+				if(nnS == mpS && mpS == cpS){
+					const bool ret = (bool)mContents;
+					mContents.reset();
+					return ret;
+				} else if(cpS == nnS || cpS < mpS){ // Not in the tree
+					return false;
+				}
+				const std::string suffix = nodeName.substr(cpS, nnS - cpS);
+				for(auto it = mSuffixes.begin(); it != mSuffixes.end() && (*it) != nullptr; it++){
+					if(findCommonPrefix((*it)->mPrefix, suffix) != "") return (*it)->erase(suffix);
+				}
+				return false;
+			}
+			
 			void dump(std::ostream &out = std::cout, std::string prefix = ""){
 				std::string withme(prefix);
 				withme += mPrefix;
@@ -169,12 +190,13 @@ namespace LDParse {
 				}
 			}
 			
-			void setContents(std::unique_ptr<Contents> newContents){ mContents = std::move(newContents); }
+			void setContents(ArenaPtr<Contents> newContents){ mContents = std::move(newContents); }
 			boost::optional<Contents&> getContents() const {return mContents ? boost::optional<Contents&>(*mContents) : boost::none;};
 			
-			static CacheNode* makeRoot(){ return new CacheNode; }
+			// The root itself is always on the heap, so it can be owned like any other object
+			static CacheNode* makeRoot(Arena * arena = nullptr){ return new CacheNode("", nullptr, arena); }
 			
-			CacheNode(std::string prefix = "", std::unique_ptr<Contents> contents = nullptr) : mPrefix(prefix) {
+			CacheNode(std::string prefix = "", ArenaPtr<Contents> contents = nullptr, Arena * arena = nullptr) : mPrefix(prefix), mArena(arena) {
 				setContents(std::move(contents));
 				mSuffixes.clear();
 			}
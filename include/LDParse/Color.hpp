@@ -10,23 +10,100 @@
 #define Color_hpp
 
 #include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
 #include <vector>
 #include <boost/optional.hpp>
 
 namespace LDParse {
-	struct ColorTable {
-		uint16_t mNextFree;
-		std::vector<uint32_t> mColors;
-		std::vector<uint16_t> mComplements;
-		
+	constexpr static const uint16_t MainColour = 16; // Inherit the colour of the referencing line
+	constexpr static const uint16_t EdgeColour = 24; // The complement of the inherited colour
+	constexpr static const uint32_t PaletteSize = 512; // Codes below this are LDConfig's; anything above was interned by LocalColours
+
+	/*
+	 * Colours that files define for themselves, and direct colours, interned process-wide on their (RGBA, complement) pair,
+	 * so loading the same files again never grows the table. Entries are never moved or removed, which makes lookups
+	 * O(1) and lock-free from any thread; only interning takes a lock.
+	 */
+	class LocalColours {
+	public:
+		struct Entry {
+			uint32_t mRGBA;
+			uint32_t mComplement; // A code
+		};
+	private:
+		constexpr static const size_t ChunkBits = 10;
+		constexpr static const size_t ChunkSize = 1 << ChunkBits;
+		constexpr static const size_t MaxChunks = 64;
+
+		std::atomic<Entry*> mChunks[MaxChunks];
+		std::atomic<uint32_t> mSize;
+		std::mutex mInternLock;
+		std::unordered_map<uint64_t, uint32_t> mIndex; // (RGBA, complement) -> code. Guarded by mInternLock.
+	public:
+		LocalColours();
+		~LocalColours();
+		LocalColours(const LocalColours &) = delete;
+		LocalColours& operator=(const LocalColours &) = delete;
+
+		boost::optional<uint32_t> intern(uint32_t rgba, uint32_t complement);
+		size_t size() const { return mSize.load(std::memory_order_acquire); }
+
+		// code must have come from intern()
+		const Entry& get(uint32_t code) const {
+			const uint32_t i = code - PaletteSize;
+			return mChunks[i >> ChunkBits].load(std::memory_order_acquire)[i & (ChunkSize - 1)];
+		}
+	};
+
+	// An immutable snapshot of LDConfig's colours. Models keep one alive for as long as they need it, so it is safe to share across threads.
+	class Palette {
+		friend class ColorTable;
+		uint32_t mColors[PaletteSize];
+		uint32_t mComplements[PaletteSize];
+		std::shared_ptr<LocalColours> mLocals;
+
+		Palette(const std::shared_ptr<LocalColours> &locals);
+	public:
+		boost::optional<uint32_t> getColour(uint32_t code) const;
+		uint32_t getComplement(uint32_t code) const;
+		// What code stands for beneath a reference in colour inherited: 16 is inherited itself, 24 is its complement
+		uint32_t resolve(uint32_t code, uint32_t inherited) const {
+			uint32_t ret = code;
+			if(code == MainColour) ret = inherited;
+			else if(code == EdgeColour && inherited != MainColour) ret = getComplement(inherited);
+			return ret;
+		}
+		LocalColours& getLocals() const { return *mLocals; }
+	};
+
+	// Per-model !COLOUR definitions: the code a file uses -> the code it was interned as. Shared until someone writes to it.
+	typedef std::unordered_map<uint16_t, uint32_t> ColourOverlay;
+
+	/*
+	 * Where LDConfig's colours are collected as it is parsed. Everything else sees the colours through snapshot(), which
+	 * stays the same object until the next change, so all the Models built in between share it.
+	 * Snapshots can be taken from any thread, but populate it (i.e. load LDConfig) before sharing it between builders.
+	 */
+	class ColorTable {
+		std::shared_ptr<LocalColours> mLocals;
+		std::shared_ptr<Palette> mStaging;
+		std::shared_ptr<const Palette> mSnapshot;
+		std::mutex mSnapshotLock;
+	public:
 		ColorTable();
-		boost::optional<uint32_t> getColour(uint16_t code) const;
+
 		bool setColour(uint16_t code, uint32_t color);
-		bool setComplement(uint16_t code, uint16_t cCode);
-		boost::optional<uint16_t> addLocalColour(uint32_t);
-		
+		bool setComplement(uint16_t code, uint32_t cCode);
+		boost::optional<uint32_t> addLocalColour(uint32_t rgba, uint32_t complement = 0) { return mLocals->intern(rgba, complement); }
+
+		std::shared_ptr<const Palette> snapshot();
+		LocalColours& getLocals() const { return *mLocals; }
 	};
-	
+
 }
 
 
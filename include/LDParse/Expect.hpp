@@ -51,7 +51,8 @@ namespace LDParse {
 		Expect(ErrHandler &err, ReadF read) : mRead(read), mErr(err), failF(mErr, tokenName) {}
 		
 		bool operator()(TokenStream::const_iterator &tokenIt, const TokenStream::const_iterator &eol, Out &o){
-			bool ret = std::distance(tokenIt, eol) >= 1;
+			// Every reader takes exactly TokenCount tokens, so a line that's too short fails here, before anything reads past its end
+			bool ret = std::distance(tokenIt, eol) >= (ptrdiff_t)tokenLen;
 			if(ret) {
 				ret = mRead(tokenIt, o, failF);
 			} else {
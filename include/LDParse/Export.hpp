@@ -0,0 +1,89 @@
+//
+//  Export.hpp
+//  LDParse
+//
+//  Created by Thomas Dickerson on 1/29/16.
+//  Copyright © 2016 StickFigure Graphic Productions. All rights reserved.
+//
+
+#ifndef Export_h
+#define Export_h
+
+#include "Model.hpp"
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace LDParse {
+
+	constexpr static const size_t ExportChunkSize = 1 << 16; // Bytes per write buffer
+	constexpr static const size_t ExportMaxPending = 16; // Full buffers gathered into each writev
+	constexpr static const size_t ExportBlockVertices = 1 << 10; // Vertices transformed at a time
+
+	/*
+	 * Buffered output to a file descriptor. Data is copied into fixed-size buffers, and full buffers are handed to the
+	 * kernel ExportMaxPending at a time with writev, then recycled, so memory use doesn't depend on how much is written.
+	 * Failures are sticky: once a write fails, everything after it is dropped and ok() stays false.
+	 */
+	class ChunkWriter {
+		int mFd;
+		bool mOwned;
+		bool mOk;
+		size_t mWritten;
+		std::vector<char> mCurrent;
+		std::vector<std::vector<char> > mPending;
+		std::vector<std::vector<char> > mSpare;
+
+		void submit();
+		void drain();
+	public:
+		explicit ChunkWriter(int fd);
+		explicit ChunkWriter(const std::string &path); // Creates or truncates path
+		~ChunkWriter();
+		ChunkWriter(const ChunkWriter &) = delete;
+		ChunkWriter& operator=(const ChunkWriter &) = delete;
+
+		void write(const void *data, size_t size);
+		template<typename T> void put(const T &value){ write(&value, sizeof(T)); }
+		void fill(char c, size_t count);
+		void flush();
+
+		bool ok() const { return mOk; }
+		size_t written() const { return mWritten + mCurrent.size(); } // Including anything still buffered
+	};
+
+	struct ExportOptions {
+		uint32_t mColour; // What colour 16 means at the root
+		bool mNormals; // Vertex normals, as ModelBuilder computed them when each file was done (see computeNormals)
+		bool mLines; // Edge lines
+		bool mInstancing; // glTF only: share one mesh between all placements of a part, with EXT_mesh_gpu_instancing
+
+		ExportOptions() : mColour(MainColour), mNormals(false), mLines(true), mInstancing(false) {}
+	};
+
+	// What a streaming export of a model will write, found by walking the instances without touching any vertices
+	struct ExportCounts {
+		size_t vertices;
+		size_t triangles; // Including back faces
+		size_t lines;
+	};
+
+	ExportCounts countGeometry(const Model &model, const ExportOptions &options = ExportOptions());
+
+	/*
+	 * These walk model's instances and write each one's transformed vertices and indices straight out, so nothing the size
+	 * of the flattened mesh is ever held in memory. Formats that need counts or offsets up front get them from a counting
+	 * pass first, and formats that want all of one kind of data before the next walk the instances once per section.
+	 * Each returns false if anything failed to write.
+	 */
+	bool writePLY(const Model &model, ChunkWriter &out, const ExportOptions &options = ExportOptions()); // Binary, in host byte order
+	bool writeOBJ(const Model &model, ChunkWriter &out, const ExportOptions &options = ExportOptions()); // With vertex colours after each position
+	bool writeGLB(const Model &model, ChunkWriter &out, const ExportOptions &options = ExportOptions());
+
+	bool writePLY(const Model &model, const std::string &path, const ExportOptions &options = ExportOptions());
+	bool writeOBJ(const Model &model, const std::string &path, const ExportOptions &options = ExportOptions());
+	bool writeGLB(const Model &model, const std::string &path, const ExportOptions &options = ExportOptions());
+}
+
+#endif /* Export_h */
@@ -0,0 +1,98 @@
+//
+//  FileLoader.hpp
+//  LDParse
+//
+//  Created by Thomas Dickerson on 2/5/16.
+//  Copyright © 2016 StickFigure Graphic Productions. All rights reserved.
+//
+
+#ifndef FileLoader_h
+#define FileLoader_h
+
+#include <stddef.h>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+namespace LDParse {
+
+	constexpr static const size_t DefaultLoadQueueDepth = 256;
+	constexpr static const size_t InitialLoadBufferSize = 1 << 16; // Nearly every library file fits in one read of this
+
+	typedef std::shared_ptr<std::vector<char> > FileContents;
+
+	/*
+	 * Buffers for file contents, recycled rather than freed: a buffer handed out by acquire() returns to the pool,
+	 * capacity and all, when the last FileContents pointing at it goes. The pool can go first; its buffers then just free themselves.
+	 */
+	class BufferPool : public std::enable_shared_from_this<BufferPool> {
+		std::mutex mLock;
+		std::vector<std::unique_ptr<std::vector<char> > > mFree;
+		size_t mMaxFree;
+
+		void release(std::vector<char> * buffer);
+	public:
+		BufferPool(size_t maxFree = DefaultLoadQueueDepth) : mMaxFree(maxFree) {}
+		// Empty, with room for at least capacity bytes
+		FileContents acquire(size_t capacity);
+	};
+
+	/*
+	 * Reads whole files, many at a time. On Linux, when built with LDPARSE_WITH_IO_URING and the kernel allows it, each batch of
+	 * up to queueDepth files is opened, read and closed with a handful of io_uring submissions, rather than three syscalls per file.
+	 * Otherwise (or if io_uring turns out to be unavailable at run time) a pool of threads does open/pread/close.
+	 */
+	class FileLoader {
+	public:
+		// Contents is null if the file couldn't be read, and error is then its errno
+		typedef std::function<void(size_t index, const std::string &path, FileContents contents, int error)> DoneF;
+	private:
+		std::shared_ptr<BufferPool> mPool;
+		size_t mQueueDepth;
+		size_t mThreads;
+		bool mUseRing;
+
+		void loadWithThreads(const std::vector<std::string> &paths, size_t begin, const DoneF &done);
+#ifdef LDPARSE_WITH_IO_URING
+		bool loadWithRing(const std::vector<std::string> &paths, size_t &begin, const DoneF &done);
+#endif
+	public:
+		FileLoader(size_t queueDepth = DefaultLoadQueueDepth, size_t threads = 0);
+
+		/*
+		 * Calls done once per path, as each file finishes, in no particular order. With io_uring that's always on the calling thread;
+		 * with the thread pool it's on the workers, possibly at the same time, so done has to be safe to call concurrently.
+		 */
+		void load(const std::vector<std::string> &paths, const DoneF &done);
+		bool usingRing() const { return mUseRing; }
+	};
+
+	// Lets a buffer be read as a stream (seeking included, for Lexer's rewind), without copying it
+	class MemoryStreamBuf : public std::streambuf {
+	public:
+		MemoryStreamBuf(const char * data, size_t size){
+			char * begin = const_cast<char *>(data); // We never write through it
+			setg(begin, begin, begin + size);
+		}
+	protected:
+		pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) override {
+			if(!(which & std::ios_base::in)) return pos_type(off_type(-1));
+			char * base = (dir == std::ios_base::beg) ? eback() : (dir == std::ios_base::cur) ? gptr() : egptr();
+			char * next = base + off;
+			if(next < eback() || next > egptr()) return pos_type(off_type(-1));
+			setg(eback(), next, egptr());
+			return pos_type(off_type(next - eback()));
+		}
+		pos_type seekpos(pos_type pos, std::ios_base::openmode which) override {
+			return seekoff(off_type(pos), std::ios_base::beg, which);
+		}
+	};
+
+	// The names of the files a buffer of LDraw includes (type 1 lines), in order, duplicates and all
+	void scanIncludes(const char * data, size_t size, std::vector<std::string> &names);
+}
+
+#endif /* FileLoader_h */
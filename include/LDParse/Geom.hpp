@@ -10,11 +10,19 @@
 #define Geom_hpp
 
 #include <stdio.h>
+#include <stdint.h>
+#include <algorithm>
+#include <cmath>
+#include <limits>
 #include <tuple>
 #include <vector>
 #include <string>
 #include <map>
 
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
 namespace LDParse{
 	
 	typedef std::pair<bool, uint32_t> ColorRef;
@@ -23,10 +31,153 @@ namespace LDParse{
 	typedef std::tuple<Position, Position, Position> Triangle;
 	typedef std::tuple<Position, Position, Position, Position> Quad;
 	typedef std::tuple<Line, Line> OptLine;
-	typedef std::tuple<Position,
-	float, float, float,
-	float, float, float,
-	float, float, float> TransMatrix;
+	
+	/*
+	 * An affine transformation, stored as the top three rows of a row-major 4x4 matrix
+	 *   | a b c x |
+	 *   | d e f y |
+	 *   | g h i z |
+	 * so that each row can be loaded as a single SIMD register. Arguments to the constructor
+	 * are given in the order they appear on a type 1 line.
+	 */
+	struct alignas(16) TransMatrix {
+		float m[12];
+		
+		TransMatrix() : m() {}
+		TransMatrix(const Position &t, float a, float b, float c, float d, float e, float f, float g, float h, float i)
+		: m{a, b, c, std::get<0>(t), d, e, f, std::get<1>(t), g, h, i, std::get<2>(t)} {}
+		
+		float& operator()(size_t row, size_t col) { return m[4 * row + col]; }
+		float operator()(size_t row, size_t col) const { return m[4 * row + col]; }
+		Position translation() const { return Position(m[3], m[7], m[11]); }
+		
+		bool operator==(const TransMatrix &o) const {
+			for(size_t i = 0; i < 12; ++i) if(m[i] != o.m[i]) return false;
+			return true;
+		}
+		bool operator!=(const TransMatrix &o) const { return !(*this == o); }
+	};
+	
+	inline TransMatrix identityTransform(){
+		return TransMatrix(Position(0, 0, 0), 1, 0, 0, 0, 1, 0, 0, 0, 1);
+	}
+	
+	inline float determinant(const TransMatrix &t){
+		const float *m = t.m;
+		return m[0] * (m[5] * m[10] - m[6] * m[9])
+		- m[1] * (m[4] * m[10] - m[6] * m[8])
+		+ m[2] * (m[4] * m[9] - m[5] * m[8]);
+	}
+	
+	// Applies only the 3x3 part of t, as for directions
+	inline Position applyLinear(const TransMatrix &t, const Position &p){
+		const float *m = t.m;
+		const float x = std::get<0>(p), y = std::get<1>(p), z = std::get<2>(p);
+		return Position(m[0] * x + m[1] * y + m[2] * z,
+						m[4] * x + m[5] * y + m[6] * z,
+						m[8] * x + m[9] * y + m[10] * z);
+	}
+	
+	// Normals go through the inverse transpose of t's 3x3 part instead, so they stay perpendicular to surfaces that are scaled unevenly.
+	// Its rows are the cross products of t's rows, over the determinant; only the sign of that matters, since the result is unit length (or zero).
+	inline Position transformNormal(const TransMatrix &t, const Position &n){
+		const float *m = t.m;
+		const float x = std::get<0>(n), y = std::get<1>(n), z = std::get<2>(n);
+		const float cx = (m[5] * m[10] - m[6] * m[9]) * x + (m[6] * m[8] - m[4] * m[10]) * y + (m[4] * m[9] - m[5] * m[8]) * z;
+		const float cy = (m[9] * m[2] - m[10] * m[1]) * x + (m[10] * m[0] - m[8] * m[2]) * y + (m[8] * m[1] - m[9] * m[0]) * z;
+		const float cz = (m[1] * m[6] - m[2] * m[5]) * x + (m[2] * m[4] - m[0] * m[6]) * y + (m[0] * m[5] - m[1] * m[4]) * z;
+		const float len2 = cx * cx + cy * cy + cz * cz;
+		const float inv = len2 > 0.f ? std::copysign(1.f / std::sqrt(len2), determinant(t)) : 0.f;
+		return Position(cx * inv, cy * inv, cz * inv);
+	}
+	
+	inline Position applyTransform(const TransMatrix &t, const Position &p){
+		const float *m = t.m;
+		const float x = std::get<0>(p), y = std::get<1>(p), z = std::get<2>(p);
+		return Position(m[0] * x + m[1] * y + m[2] * z + m[3],
+						m[4] * x + m[5] * y + m[6] * z + m[7],
+						m[8] * x + m[9] * y + m[10] * z + m[11]);
+	}
+	
+	// Returns the transformation that applies inner first, then outer.
+	// Each output row is a linear combination of the rows of inner, plus outer's translation.
+	inline TransMatrix composeTransforms(const TransMatrix &outer, const TransMatrix &inner){
+		TransMatrix ret;
+#ifdef __SSE__
+		const __m128 i0 = _mm_load_ps(inner.m), i1 = _mm_load_ps(inner.m + 4), i2 = _mm_load_ps(inner.m + 8);
+		for(size_t r = 0; r < 3; ++r){
+			const float *o = outer.m + 4 * r;
+			__m128 row = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(o[0]), i0), _mm_mul_ps(_mm_set1_ps(o[1]), i1));
+			row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(o[2]), i2));
+			row = _mm_add_ps(row, _mm_set_ps(o[3], 0.f, 0.f, 0.f)); // Only the translation column picks up outer's translation
+			_mm_store_ps(ret.m + 4 * r, row);
+		}
+#else
+		for(size_t r = 0; r < 3; ++r){
+			for(size_t c = 0; c < 4; ++c){
+				ret(r, c) = outer(r, 0) * inner(0, c) + outer(r, 1) * inner(1, c) + outer(r, 2) * inner(2, c);
+			}
+			ret(r, 3) += outer(r, 3);
+		}
+#endif
+		return ret;
+	}
+	
+	// Transforms n positions from in to out. in and out may be the same array.
+	inline void transformPositions(const TransMatrix &t, const Position *in, size_t n, Position *out){
+		for(size_t i = 0; i < n; ++i) out[i] = applyTransform(t, in[i]);
+	}
+	
+	// Axis-aligned bounding box. A default-constructed box is empty, and absorbs whatever it is extended by.
+	struct AABB {
+		float lo[3];
+		float hi[3];
+		
+		AABB() : lo{std::numeric_limits<float>::infinity(), std::numeric_limits<float>::infinity(), std::numeric_limits<float>::infinity()},
+		hi{-std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity()} {}
+		
+		bool empty() const { return lo[0] > hi[0] || lo[1] > hi[1] || lo[2] > hi[2]; }
+		
+		AABB& extend(const Position &p){
+			const float c[] = {std::get<0>(p), std::get<1>(p), std::get<2>(p)};
+			for(size_t a = 0; a < 3; ++a){
+				lo[a] = std::min(lo[a], c[a]);
+				hi[a] = std::max(hi[a], c[a]);
+			}
+			return *this;
+		}
+		
+		AABB& extend(const AABB &o){
+			for(size_t a = 0; a < 3; ++a){
+				lo[a] = std::min(lo[a], o.lo[a]);
+				hi[a] = std::max(hi[a], o.hi[a]);
+			}
+			return *this;
+		}
+		
+		bool contains(const AABB &o) const {
+			return o.empty() || (lo[0] <= o.lo[0] && lo[1] <= o.lo[1] && lo[2] <= o.lo[2] && hi[0] >= o.hi[0] && hi[1] >= o.hi[1] && hi[2] >= o.hi[2]);
+		}
+		
+		bool overlaps(const AABB &o) const {
+			return lo[0] <= o.hi[0] && o.lo[0] <= hi[0] && lo[1] <= o.hi[1] && o.lo[1] <= hi[1] && lo[2] <= o.hi[2] && o.lo[2] <= hi[2];
+		}
+		
+		// The box around the transformed box. This is exact for the corners, and conservative for whatever was inside.
+		AABB transformed(const TransMatrix &t) const {
+			AABB ret;
+			if(empty()) return ret;
+			for(size_t r = 0; r < 3; ++r){
+				ret.lo[r] = ret.hi[r] = t(r, 3);
+				for(size_t c = 0; c < 3; ++c){
+					const float a = t(r, c) * lo[c], b = t(r, c) * hi[c];
+					ret.lo[r] += std::min(a, b);
+					ret.hi[r] += std::max(a, b);
+				}
+			}
+			return ret;
+		}
+	};
 	
 	
 	template<typename ...AttrTypes> class Mesh {
@@ -37,6 +188,8 @@ namespace LDParse{
 		AttrsType attributes;
 		std::vector<uint32_t> indices;
 		std::vector<uint32_t> bfIndices; // We may store reverse copies of certain triangles
+		std::vector<uint32_t> lineIndices; // Pairs, for edge lines
+		std::vector<uint32_t> lineColours; // One per line, so line ends can share vertices with faces of another colour
 		
 		template<typename ...TxFormFs> void mergeMesh(const SelfType &merge, std::tuple<TxFormFs ...> txformFs = std::make_tuple(identity<AttrTypes>() ...)){
 			const size_t offset = vertexCount();
@@ -71,8 +224,37 @@ namespace LDParse{
 			if(txformF != nullptr) for(size_t j = range.first; j < range.second; ++j) txFormF(v[j]);
 		}
 		
+		// True if vertices i and j agree on every attribute except the first (usually the position)
+		bool sameTrailingAttributes(size_t i, size_t j) const {
+			return trailingEqual(i, j, int_<std::tuple_size<AttrsType>::value - 1>());
+		}
+		
+		// Drops every vertex not listed in keep, and renumbers the survivors in the order given. Indices are not touched.
+		void selectVertices(const std::vector<uint32_t> &keep){
+			selectHelper(keep);
+		}
+		
 	private:
 		template<std::size_t> struct int_{};
+		
+		template<size_t N> bool trailingEqual(size_t i, size_t j, int_<N>) const {
+			constexpr size_t k = std::tuple_size<AttrsType>::value - N;
+			const AttrType<k> &attr = std::get<k>(attributes);
+			return attr[i] == attr[j] && trailingEqual(i, j, int_<N-1>());
+		}
+		bool trailingEqual(size_t i, size_t j, int_<0>) const { return true; }
+		
+		template<size_t N = std::tuple_size<AttrsType>::value> void selectHelper(const std::vector<uint32_t> &keep, int_<N> elemCt = int_<N>()){
+			constexpr size_t i = std::tuple_size<AttrsType>::value - N;
+			AttrType<i> &attr = std::get<i>(attributes);
+			AttrType<i> kept;
+			kept.reserve(keep.size());
+			for(auto it = keep.begin(); it != keep.end(); ++it) kept.push_back(attr[*it]);
+			attr.swap(kept);
+			
+			selectHelper(keep, int_<N-1>());
+		}
+		void selectHelper(const std::vector<uint32_t> &keep, int_<0>){}
 		template<size_t N = std::tuple_size<AttrsType>::value> void mergeHelper(const SelfType &merge, std::tuple<void(AttrTypes&) ...> txformFs, int_<N> elemCt = int_<N>()){
 			constexpr size_t i = std::tuple_size<AttrsType>::value - N;
 			AttrType<i> &thisAttr = std::get<i>(attributes);
@@ -0,0 +1,207 @@
+//
+//  GeomKernels.hpp
+//  LDParse
+//
+//  Created by Thomas Dickerson on 1/25/16.
+//  Copyright © 2016 StickFigure Graphic Productions. All rights reserved.
+//
+
+#ifndef GeomKernels_h
+#define GeomKernels_h
+
+#include "Geom.hpp"
+
+#include <cmath>
+#include <cstdlib>
+#include <new>
+
+namespace LDParse {
+
+	constexpr static const size_t KernelAlignment = 32; // Enough for AVX
+
+	template<typename T, size_t Align = KernelAlignment> struct AlignedAllocator {
+		typedef T value_type;
+		template<typename U> struct rebind { typedef AlignedAllocator<U, Align> other; };
+
+		AlignedAllocator() {}
+		template<typename U> AlignedAllocator(const AlignedAllocator<U, Align> &) {}
+
+		T* allocate(size_t n){
+			void *p = nullptr;
+			const size_t bytes = n * sizeof(T);
+			if(posix_memalign(&p, Align, bytes ? bytes : Align)) throw std::bad_alloc();
+			return static_cast<T*>(p);
+		}
+		void deallocate(T *p, size_t){ free(p); }
+
+		template<typename U> bool operator==(const AlignedAllocator<U, Align> &) const { return true; }
+		template<typename U> bool operator!=(const AlignedAllocator<U, Align> &) const { return false; }
+	};
+
+	template<typename T> using AlignedVector = std::vector<T, AlignedAllocator<T> >;
+
+#if defined(__GNUC__)
+#define LDPARSE_ASSUME_ALIGNED(p) static_cast<decltype(p)>(__builtin_assume_aligned((p), KernelAlignment))
+#define LDPARSE_RESTRICT __restrict__
+#else
+#define LDPARSE_ASSUME_ALIGNED(p) (p)
+#define LDPARSE_RESTRICT
+#endif
+
+	/*
+	 * Structure-of-arrays storage for positions. Meshes keep their positions as tuples, since that's what the
+	 * parser produces and what Triangle/Quad/Line are made of; kernels that stream over a lot of vertices
+	 * convert once and work on these instead, so the compiler can vectorize over each axis.
+	 * Models keep a copy for bounds (Model::getPositionArrays), and interference checks keep one per part.
+	 */
+	struct PositionArrays {
+		AlignedVector<float> x, y, z;
+
+		PositionArrays() {}
+		explicit PositionArrays(const std::vector<Position> &positions){ assign(positions); }
+
+		size_t size() const { return x.size(); }
+		void resize(size_t n){ x.resize(n); y.resize(n); z.resize(n); }
+		Position operator[](size_t i) const { return Position(x[i], y[i], z[i]); }
+
+		void assign(const std::vector<Position> &positions){
+			const size_t n = positions.size();
+			resize(n);
+			for(size_t i = 0; i < n; ++i){
+				x[i] = std::get<0>(positions[i]);
+				y[i] = std::get<1>(positions[i]);
+				z[i] = std::get<2>(positions[i]);
+			}
+		}
+	};
+
+	// out may alias in
+	inline void transformPositions(const TransMatrix &t, const PositionArrays &in, PositionArrays &out){
+		const size_t n = in.size();
+		if(&out != &in) out.resize(n);
+		const float m0 = t.m[0], m1 = t.m[1], m2 = t.m[2], m3 = t.m[3];
+		const float m4 = t.m[4], m5 = t.m[5], m6 = t.m[6], m7 = t.m[7];
+		const float m8 = t.m[8], m9 = t.m[9], m10 = t.m[10], m11 = t.m[11];
+		const float * xs = LDPARSE_ASSUME_ALIGNED(in.x.data());
+		const float * ys = LDPARSE_ASSUME_ALIGNED(in.y.data());
+		const float * zs = LDPARSE_ASSUME_ALIGNED(in.z.data());
+		float * ox = LDPARSE_ASSUME_ALIGNED(out.x.data());
+		float * oy = LDPARSE_ASSUME_ALIGNED(out.y.data());
+		float * oz = LDPARSE_ASSUME_ALIGNED(out.z.data());
+		for(size_t i = 0; i < n; ++i){
+			const float x = xs[i], y = ys[i], z = zs[i];
+			ox[i] = m0 * x + m1 * y + m2 * z + m3;
+			oy[i] = m4 * x + m5 * y + m6 * z + m7;
+			oz[i] = m8 * x + m9 * y + m10 * z + m11;
+		}
+	}
+
+	namespace KernelImpl {
+#ifdef __SSE__
+		inline float horizontalMin(__m128 v){
+			float l[4];
+			_mm_storeu_ps(l, v);
+			return std::min(std::min(l[0], l[1]), std::min(l[2], l[3]));
+		}
+		inline float horizontalMax(__m128 v){
+			float h[4];
+			_mm_storeu_ps(h, v);
+			return std::max(std::max(h[0], h[1]), std::max(h[2], h[3]));
+		}
+#endif
+
+		inline void axisBounds(const float * LDPARSE_RESTRICT v, size_t n, float &lo, float &hi){
+			size_t i = 0;
+#ifdef __SSE__
+			if(n >= 4){
+				__m128 vlo = _mm_load_ps(v), vhi = vlo;
+				for(i = 4; i + 4 <= n; i += 4){
+					const __m128 c = _mm_load_ps(v + i);
+					vlo = _mm_min_ps(vlo, c);
+					vhi = _mm_max_ps(vhi, c);
+				}
+				lo = std::min(lo, horizontalMin(vlo));
+				hi = std::max(hi, horizontalMax(vhi));
+			}
+#endif
+			for(; i < n; ++i){
+				lo = std::min(lo, v[i]);
+				hi = std::max(hi, v[i]);
+			}
+		}
+	}
+
+	inline AABB bounds(const PositionArrays &p){
+		AABB ret;
+		const size_t n = p.size();
+		KernelImpl::axisBounds(LDPARSE_ASSUME_ALIGNED(p.x.data()), n, ret.lo[0], ret.hi[0]);
+		KernelImpl::axisBounds(LDPARSE_ASSUME_ALIGNED(p.y.data()), n, ret.lo[1], ret.hi[1]);
+		KernelImpl::axisBounds(LDPARSE_ASSUME_ALIGNED(p.z.data()), n, ret.lo[2], ret.hi[2]);
+		return ret;
+	}
+
+	// Extends box by every position in p, as t places it, without storing the transformed positions anywhere
+	inline void extendTransformed(AABB &box, const TransMatrix &t, const PositionArrays &p){
+		const size_t n = p.size();
+		const float * xs = LDPARSE_ASSUME_ALIGNED(p.x.data());
+		const float * ys = LDPARSE_ASSUME_ALIGNED(p.y.data());
+		const float * zs = LDPARSE_ASSUME_ALIGNED(p.z.data());
+		size_t i = 0;
+#ifdef __SSE__
+		if(n >= 4){
+			__m128 m[12];
+			for(size_t k = 0; k < 12; ++k) m[k] = _mm_set1_ps(t.m[k]);
+			__m128 lo[3], hi[3];
+			for(size_t k = 0; k < 3; ++k){
+				lo[k] = _mm_set1_ps(box.lo[k]);
+				hi[k] = _mm_set1_ps(box.hi[k]);
+			}
+			for(; i + 4 <= n; i += 4){
+				const __m128 x = _mm_load_ps(xs + i), y = _mm_load_ps(ys + i), z = _mm_load_ps(zs + i);
+				for(size_t k = 0; k < 3; ++k){
+					const __m128 *r = m + 4 * k;
+					const __m128 c = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r[0], x), _mm_mul_ps(r[1], y)), _mm_add_ps(_mm_mul_ps(r[2], z), r[3]));
+					lo[k] = _mm_min_ps(lo[k], c);
+					hi[k] = _mm_max_ps(hi[k], c);
+				}
+			}
+			for(size_t k = 0; k < 3; ++k){
+				box.lo[k] = KernelImpl::horizontalMin(lo[k]);
+				box.hi[k] = KernelImpl::horizontalMax(hi[k]);
+			}
+		}
+#endif
+		for(; i < n; ++i) box.extend(applyTransform(t, Position(xs[i], ys[i], zs[i])));
+	}
+
+	/*
+	 * Fills the second attribute (the normals) with area-weighted vertex normals of the triangles in indices.
+	 * Vertices shared between faces get smooth normals, so this is best run after welding.
+	 */
+	template<typename ...RestTypes> void computeNormals(Mesh<Position, Position, RestTypes...> &mesh){
+		const std::vector<Position> &positions = std::get<0>(mesh.attributes);
+		std::vector<Position> &normals = std::get<1>(mesh.attributes);
+		normals.assign(mesh.vertexCount(), Position(0, 0, 0));
+
+		const std::vector<uint32_t> &indices = mesh.indices;
+		for(size_t t = 0; t + 2 < indices.size(); t += 3){
+			const Position &a = positions[indices[t]], &b = positions[indices[t + 1]], &c = positions[indices[t + 2]];
+			const float ux = std::get<0>(b) - std::get<0>(a), uy = std::get<1>(b) - std::get<1>(a), uz = std::get<2>(b) - std::get<2>(a);
+			const float vx = std::get<0>(c) - std::get<0>(a), vy = std::get<1>(c) - std::get<1>(a), vz = std::get<2>(c) - std::get<2>(a);
+			// Unnormalized, so larger faces count for more
+			const float nx = uy * vz - uz * vy, ny = uz * vx - ux * vz, nz = ux * vy - uy * vx;
+			for(size_t k = 0; k < 3; ++k){
+				Position &n = normals[indices[t + k]];
+				n = Position(std::get<0>(n) + nx, std::get<1>(n) + ny, std::get<2>(n) + nz);
+			}
+		}
+
+		for(auto it = normals.begin(); it != normals.end(); ++it){
+			const float len2 = std::get<0>(*it) * std::get<0>(*it) + std::get<1>(*it) * std::get<1>(*it) + std::get<2>(*it) * std::get<2>(*it);
+			const float inv = len2 > 0.f ? 1.f / std::sqrt(len2) : 0.f;
+			*it = Position(std::get<0>(*it) * inv, std::get<1>(*it) * inv, std::get<2>(*it) * inv);
+		}
+	}
+}
+
+#endif /* GeomKernels_h */
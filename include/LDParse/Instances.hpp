@@ -0,0 +1,59 @@
+//
+//  Instances.hpp
+//  LDParse
+//
+//  Created by Thomas Dickerson on 2/10/16.
+//  Copyright © 2016 StickFigure Graphic Productions. All rights reserved.
+//
+
+#ifndef Instances_h
+#define Instances_h
+
+#include "GeomKernels.hpp"
+#include "Model.hpp"
+
+#include <stdint.h>
+#include <vector>
+
+namespace LDParse {
+
+	constexpr static const size_t SerialInstanceLimit = 1 << 14; // Fewer instances than this aren't worth starting threads for
+
+	/*
+	 * Where every instance beneath a root ends up, composed once rather than on every walk from the root. Instances are numbered
+	 * in the order visitInstances would visit them (the root is 0), and each one's descendants follow it directly, so a subtree
+	 * is a contiguous range. Everything is kept in flat arrays, one entry per instance.
+	 * The root's children are composed in parallel, each subtree on one thread. The table refers to the Models, which must outlive it.
+	 */
+	class InstanceTable {
+	public:
+		constexpr static const uint32_t NoParent = UINT32_MAX;
+	private:
+		std::vector<const Model *> mModels;
+		std::vector<uint32_t> mParents;
+		std::vector<uint32_t> mEnds; // Instance i's descendants are (i, mEnds[i])
+		std::vector<uint32_t> mColours;
+		AlignedVector<TransMatrix> mLocal; // Relative to the parent
+		AlignedVector<TransMatrix> mWorld; // Relative to the root
+		std::vector<int8_t> mSigns; // Of the world determinant: -1 where BFC winding is mirrored, 0 if it's degenerate
+
+		uint32_t fill(const Model &model, uint32_t index, uint32_t parent, const TransMatrix &local, uint32_t colour);
+		void compose(uint32_t index);
+	public:
+		explicit InstanceTable(const Model &root, uint32_t colour = MainColour, size_t threads = 0);
+
+		size_t size() const { return mModels.size(); }
+		const std::vector<const Model *>& getModels() const { return mModels; }
+		const std::vector<uint32_t>& getParents() const { return mParents; }
+		const std::vector<uint32_t>& getColours() const { return mColours; }
+		const AlignedVector<TransMatrix>& getLocal() const { return mLocal; }
+		const AlignedVector<TransMatrix>& getWorld() const { return mWorld; }
+		const std::vector<int8_t>& getSigns() const { return mSigns; }
+		size_t subtreeEnd(size_t index) const { return mEnds[index]; }
+
+		// Moves one instance relative to its parent, and recomposes just its subtree. The Models aren't touched.
+		void setLocal(size_t index, const TransMatrix &local);
+	};
+}
+
+#endif /* Instances_h */
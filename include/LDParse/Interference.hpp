@@ -0,0 +1,47 @@
+//
+//  Interference.hpp
+//  LDParse
+//
+//  Created by Thomas Dickerson on 1/30/16.
+//  Copyright © 2016 StickFigure Graphic Productions. All rights reserved.
+//
+
+#ifndef Interference_h
+#define Interference_h
+
+#include "Model.hpp"
+
+#include <utility>
+#include <vector>
+
+namespace LDParse {
+
+	constexpr static const float DefaultInterferenceTolerance = 0.1f; // In LDU. Parts are meant to touch, so contact alone never counts.
+	constexpr static const size_t InterferenceChunkSize = 1 << 8;
+
+	// A part placed somewhere beneath a root. Parts are the first non-model files (or files that include nothing) along each chain of includes.
+	struct PartInstance {
+		const Model * part;
+		TransMatrix transform;
+		AABB bounds; // In the root's frame; conservative
+	};
+
+	typedef std::pair<uint32_t, uint32_t> InstancePair; // Indices into the instance list, first < second
+
+	// In the order flatten would visit them. Faces that sit directly in a model file, rather than in a part, are ignored.
+	std::vector<PartInstance> collectPartInstances(const Model &root);
+
+	// Whether two triangles cross each other by more than tolerance, in every sense: coplanar or merely touching triangles don't count
+	bool trianglesInterfere(const Position a[3], const Position b[3], float tolerance);
+
+	/*
+	 * Finds every pair of instances whose parts pass through each other by more than tolerance, in ascending order.
+	 * The broad phase is a sweep and prune over the instance bounds along x; each instance sweeps its own run of neighbours,
+	 * so that runs in parallel. The narrow phase tests transformed triangles, keeping only those that reach into the overlap
+	 * of the two boxes, and stops at the first crossing. Candidate pairs are split across `threads` workers (0 for all of them).
+	 * Two copies of the same part in the same place are reported too, though none of their faces cross.
+	 */
+	std::vector<InstancePair> findInterference(const std::vector<PartInstance> &instances, float tolerance = DefaultInterferenceTolerance, size_t threads = 0);
+}
+
+#endif /* Interference_h */
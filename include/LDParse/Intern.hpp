@@ -0,0 +1,70 @@
+//
+//  Intern.hpp
+//  LDParse
+//
+//  Created by Thomas Dickerson on 2/7/16.
+//  Copyright © 2016 StickFigure Graphic Productions. All rights reserved.
+//
+
+#ifndef Intern_h
+#define Intern_h
+
+#include "Cache.hpp"
+#include "Lex.hpp"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <boost/optional.hpp>
+
+namespace LDParse {
+
+	// 128 bits, so that two different files sharing a Model by accident is not something to worry about
+	struct Fingerprint {
+		uint64_t mHigh;
+		uint64_t mLow;
+
+		bool operator==(const Fingerprint &o) const { return mHigh == o.mHigh && mLow == o.mLow; }
+		bool operator!=(const Fingerprint &o) const { return !(*this == o); }
+	};
+
+	struct FingerprintHash {
+		size_t operator()(const Fingerprint &f) const { return (size_t)(f.mHigh ^ f.mLow); }
+	};
+
+	// Two independent 64 bit lanes: FNV-1a, and a multiply-rotate mix
+	class FingerprintHasher {
+		uint64_t mHigh;
+		uint64_t mLow;
+	public:
+		FingerprintHasher() : mHigh(0xcbf29ce484222325ull), mLow(0x9e3779b97f4a7c15ull) {}
+
+		void add(const void * data, size_t size);
+		void add(uint64_t v) { add(&v, sizeof(v)); }
+		void add(const std::string &s) { add((uint64_t)s.size()); add(s.data(), s.size()); }
+		void add(const Fingerprint &f) { add(f.mHigh); add(f.mLow); }
+		Fingerprint result() const;
+	};
+
+	/*
+	 * Fingerprints each model of a file from its tokens, ignoring anything the builder would: whitespace, number formatting
+	 * (1 and 1.0 are the same, but #1 isn't, since a colour written in hex is a direct colour), comments, and the model's own
+	 * FILE line. An include of another model in the same file is hashed as that model's fingerprint, so identical submodels
+	 * match even under different names, as long as what they include matches too. Anything else included is hashed by its
+	 * normalized name.
+	 * A model that (eventually) includes itself gets no fingerprint, and nor does anything that includes it.
+	 * subModelNames is the file's index of model names, as built for ModelBuilder, or null if it isn't an MPD.
+	 */
+	void fingerprintModels(const ModelStream &models, const Cache::CacheNode<const size_t> * subModelNames,
+						   std::vector<boost::optional<Fingerprint> > &out);
+
+	// How often builders asked a Library for a Model by fingerprint, and how often one was already there to share
+	struct InternStats {
+		size_t mLookups;
+		size_t mHits;
+		size_t mModels; // Distinct Models interned
+	};
+}
+
+#endif /* Intern_h */
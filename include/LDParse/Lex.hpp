@@ -17,6 +17,8 @@
 #include <limits>
 #include <locale>
 
+#include "Trace.hpp"
+
 #include <boost/variant.hpp>
 #include <boost/algorithm/string/trim.hpp>
 
@@ -91,6 +93,7 @@ namespace LDParse {
 		std::istream& mInput;
 		const std::streampos mBOF;
 		size_t mLineNo;
+		std::istringstream mLineStream; // Reused for every line; constructing a stream costs more than lexing most lines
 		ErrFType mErrHandler;
 		
 		static const std::unordered_multimap<TokenKind, std::string, std::hash<uint32_t> > invertMap(const std::unordered_map<std::string, TokenKind> &src){
@@ -112,7 +115,7 @@ namespace LDParse {
 		
 		Lexer(std::istream &input, ErrFType errHandler)
 		: mInput(input), mBOF(mInput.tellg()),
-		mLineNo(0), mErrHandler(errHandler) {mInput >> std::noskipws;}
+		mLineNo(0), mErrHandler(errHandler) {mInput >> std::noskipws; mLineStream >> std::noskipws;}
 		
 		bool lexLine(std::string &lineT, TokenStream &line, LexState start = Lex);
 		bool lexModelBoundaries(ModelStream &models, std::string &root, bool rewind = true);
@@ -220,6 +223,7 @@ namespace LDParse {
 	
 	template<typename ErrFType>
 	bool Lexer<ErrFType>::lexLine(std::string &line, TokenStream &lineV, LexState start) {
+		LDPARSE_TIME_PHASE(LexPhase, nullptr);
 		LexState state = start;
 		bool ret = true;
 		Token cur;
@@ -235,9 +239,10 @@ namespace LDParse {
 			size_t lineNo;
 			size_t colNo = 0;
 			safeGetline(mInput, lineNo, line);
-			std::istringstream lineStream(line);
+			std::istringstream &lineStream = mLineStream;
+			lineStream.clear();
+			lineStream.str(line);
 			const std::streampos BOL = lineStream.tellg();
-			lineStream >> std::noskipws;
 			while(!(lineStream.peek() == EOF || lineStream.eof())){
 				switch (state) {
 					case String:
@@ -277,7 +282,9 @@ namespace LDParse {
 							break; // We weren't EOL yet, but only whitespace was left.
 						} else {
 							bool push = true;
-							auto kindIt = keywordMap.find(tokText);
+							// Keywords are either a single digit or start with a letter or '!', so most numbers needn't be hashed
+							const bool maybeKeyword = tokText.length() == 1 || !(isdigit(tokText[0]) || tokText[0] == '-' || tokText[0] == '.');
+							auto kindIt = maybeKeyword ? keywordMap.find(tokText) : keywordMap.end();
 							if(kindIt == keywordMap.end()) {
 								switch(tokText[0]) {
 									case '"':
@@ -393,6 +400,7 @@ namespace LDParse {
 	
 	template<typename ErrFType>
 	bool Lexer<ErrFType>::lexModelBoundaries(ModelStream &models, std::string &root, bool rewind){
+		LDPARSE_TIME_PHASE(BoundaryPhase, &root);
 		typedef enum : uint8_t {
 			First = 0,
 			Second = 1,
@@ -417,7 +425,7 @@ namespace LDParse {
 		std::string lineT("");
 		
 		auto storeFile = [&](bool cleanup = false){
-			models.push_back(std::make_pair(fileName, fileContents));
+			models.push_back(std::make_pair(fileName, std::move(fileContents)));
 			if(fileCt == 1 || (cleanup && fileCt == 0)) root = fileName;
 			fileName = "";
 			fileContents.clear();
@@ -476,7 +484,7 @@ namespace LDParse {
 				}
 			}
 			if(inFile || state == NTail){
-				fileContents.push_back(std::make_pair(lineT,lineContents));
+				fileContents.push_back(std::make_pair(std::move(lineT), std::move(lineContents))); // lexLine starts both afresh
 			}
 			
 			if(fileContents.size() && !inFile){
@@ -0,0 +1,160 @@
+//
+//  Library.hpp
+//  LDParse
+//
+//  Created by Thomas Dickerson on 1/26/16.
+//  Copyright © 2016 StickFigure Graphic Productions. All rights reserved.
+//
+
+#ifndef Library_h
+#define Library_h
+
+#include "FileLoader.hpp"
+#include "Intern.hpp"
+#include "Model.hpp"
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace LDParse {
+
+	typedef enum : uint8_t {
+		LowRes = 0,
+		StandardRes = 1,
+		HighRes = 2
+	} LODLevel;
+
+	/*
+	 * Decides which variant of a file an include should resolve to.
+	 * Primitives with a p/8 (LowRes) or p/48 (HighRes) counterpart are redirected there automatically;
+	 * mSubstitutes can name simplified stand-ins for anything else (e.g. a plain cylinder for stud.dat).
+	 * If mChoose is set, it gets the final say on each include's level, given the include's transformation,
+	 * which is enough to estimate projected size for instances placed directly in a model.
+	 */
+	struct LODPolicy {
+		LODLevel mLevel;
+		std::unordered_map<std::string, std::string> mSubstitutes[3];
+		std::function<LODLevel(const std::string &name, const TransMatrix &transform, LODLevel level)> mChoose;
+
+		LODPolicy(LODLevel level = StandardRes) : mLevel(level) {}
+	};
+
+	/*
+	 * An LDraw library: a name index over one or more library roots, and a cache of the Models parsed from it.
+	 * Models built at different levels of detail are cached side by side, keyed as "name@level" (or "name@refs", without geometry).
+	 * Once the roots have been indexed, the cache can be shared by builders on any number of threads, and files can be
+	 * invalidated from any thread while it is (see Watcher).
+	 * Cached Models, and the cache itself, are allocated in the Library's own Arena, and live exactly as long as the Library.
+	 */
+	class Library {
+	public:
+		typedef Cache::CacheNode<const Model> CacheType;
+		struct Entry {
+			std::string mPath;
+			SrcType mSrcType;
+			size_t mRank; // Entries from higher ranked directories shadow lower ones
+		};
+		// A directory the index was built from, and what its files are indexed as
+		struct IndexedDirectory {
+			std::string mPath;
+			std::string mPrefix; // e.g. "s\\" for parts/s
+			SrcType mSrcType;
+			size_t mRank; // Shared by everything below the directory that was added
+		};
+	private:
+		ColorTable &mColorTable;
+		std::unordered_map<std::string, Entry> mIndex;
+		std::vector<IndexedDirectory> mDirectories;
+		size_t mRanks;
+		mutable std::mutex mIndexLock; // Guards the three above
+		Arena mArena; // Declared before mModels, so it outlives it
+		std::unique_ptr<CacheType> mModels;
+		mutable std::mutex mModelsLock; // Guards mModels and everything below
+		std::unordered_map<std::string, FileContents> mStaged; // Path -> contents read ahead by preload
+		std::unordered_map<Fingerprint, const Model *, FingerprintHash> mInterned;
+		size_t mInternLookups, mInternHits;
+
+		// Where each cached Model came from, and the nearest cached Models beneath it, looking through submodels
+		std::unordered_map<std::string, std::string> mPathOfKey;
+		std::unordered_map<std::string, std::unordered_set<std::string> > mKeysOfPath;
+		std::unordered_map<const Model *, std::vector<std::string> > mKeysOfModel;
+		std::unordered_map<const Model *, Fingerprint> mFingerprintOf;
+		std::unordered_map<std::string, std::unordered_set<std::string> > mIncludes; // Key -> keys
+		std::unordered_map<std::string, std::unordered_set<std::string> > mDependents; // The reverse of mIncludes
+		std::unordered_map<std::string, std::vector<Fingerprint> > mInternDependents; // Key -> interned Models that include it
+
+		void indexDirectory(const std::string &dir, const std::string &prefix, SrcType srcType, size_t rank, std::vector<std::string> * added = nullptr);
+		template<typename F> void forCachedBeneath(const Model &model, F f) const;
+		std::vector<std::string> invalidateKeys(const std::vector<std::string> &seeds, const std::vector<std::string> &paths);
+	public:
+		Library(ColorTable &colorTable);
+
+		// Indexes parts/, p/ and models/ under an LDraw root. Later roots shadow earlier ones.
+		void addRoot(const std::string &ldrawDir);
+		// Indexes a single directory, for models that sit next to each other outside any library
+		void addSearchDirectory(const std::string &dir, SrcType srcType = ModelT);
+
+		// Lower case, with backslash separators, as file names are compared in LDraw
+		static std::string normalizeName(const std::string &name);
+		static std::string cacheKey(const std::string &name, LODLevel level, bool includesOnly = false);
+
+		boost::optional<Entry> locate(const std::string &name) const;
+		std::vector<IndexedDirectory> getDirectories() const;
+		// The name an include should resolve to at this level of detail
+		std::string variantFor(const std::string &name, LODLevel level, const LODPolicy &policy) const;
+
+		boost::optional<const Model&> find(const std::string &key) const;
+		// If two builders raced to build the same file, the first to finish wins, and the model returned is that one. path is where it was built from.
+		const Model& insert(const std::string &key, ArenaPtr<const Model> model, const std::string &path = std::string());
+		// The inverse of cacheKey
+		static std::string keyName(const std::string &key, LODLevel &level, bool * includesOnly = nullptr);
+
+		/*
+		 * Forgets the cached Models built from path, and everything that includes them however indirectly, along with anything
+		 * interned that did, so they're all rebuilt on next use. Nothing else is touched. Nothing is freed either: forgotten Models
+		 * stay valid, just stale, until the Library goes, so whoever still holds one isn't left dangling. Returns the keys forgotten.
+		 */
+		std::vector<std::string> invalidate(const std::string &path);
+		// For when fileName has appeared in or gone from dir: updates the index, then invalidates whatever the name resolved to, before and after
+		std::vector<std::string> refresh(const IndexedDirectory &dir, const std::string &fileName);
+		// For when a directory has appeared in dir: indexes it and everything in it, and invalidates whatever that shadows
+		std::vector<std::string> refreshDirectory(const IndexedDirectory &dir, const std::string &name);
+		// For when a directory has gone from dir, deleted or moved away: unindexes it and everything in it, and invalidates whatever resolved there
+		std::vector<std::string> removeDirectory(const IndexedDirectory &dir, const std::string &name);
+
+		/*
+		 * Reads the files names resolve to at level, and everything they include, ahead of building them. Each round reads the whole
+		 * known frontier as one batch through loader, then scans what came back for the next frontier. Files that are already cached
+		 * or staged aren't read again. Returns how many files were staged; builders resolving through this Library parse those
+		 * straight from memory, and drop them once they're built. Anything staged for a file that gets cached some other way
+		 * (say, by a builder that read it from disk first) is dropped then, and anything of its path that's invalidated.
+		 */
+		size_t preload(const std::vector<std::string> &names, FileLoader &loader, LODLevel level = StandardRes, const LODPolicy &policy = LODPolicy());
+		// Hands over (rather than shares) what preload read for path, if anything
+		FileContents takeStaged(const std::string &path);
+		// For files read some other way, to be parsed from memory by the next builder that needs them
+		void stage(const std::string &path, FileContents contents);
+		bool hasStaged(const std::string &path) const;
+		// Drops whatever is still staged, e.g. once the builds a preload was for are done. Returns how many files that was.
+		size_t releaseStaged();
+
+		/*
+		 * Models shared by content rather than by name, across every file built through this Library (see ModelBuilder::setInterning).
+		 * Interned Models are made in this Library's Arena, like everything else it caches. If two builders race to intern the same
+		 * content, the first wins and the Model returned is that one; the other stays where it is, still valid, just not shared.
+		 */
+		boost::optional<const Model&> findInterned(const Fingerprint &key);
+		const Model& intern(const Fingerprint &key, const Model &model);
+		InternStats getInternStats() const;
+
+		ColorTable& getColorTable() const { return mColorTable; }
+		Arena& getArena() { return mArena; }
+	};
+}
+
+#endif /* Library_h */
@@ -13,11 +13,13 @@
 #include "Color.hpp"
 #include "Geom.hpp"
 #include "Lex.hpp"
+#include "OptLines.hpp"
 #include "Parse.hpp"
 
 #include <iostream>
 #include <unordered_set>
 #include <forward_list>
+#include <mutex>
 #include <boost/logic/tribool.hpp>
 
 namespace LDParse{
@@ -40,36 +42,110 @@ namespace LDParse{
 		Invert = 1
 	} BFCStatus;
 	
+	// How far each part of a Model's data had got when a step ended. Step k covers [mark k-1, mark k).
+	struct StepMark {
+		size_t indices;
+		size_t bfIndices;
+		size_t children;
+		size_t optLines;
+		size_t lineIndices;
+		
+		bool operator==(const StepMark &o) const {
+			return indices == o.indices && bfIndices == o.bfIndices && children == o.children && optLines == o.optLines && lineIndices == o.lineIndices;
+		}
+		bool operator!=(const StepMark &o) const { return !(*this == o); }
+	};
+	
+	class Model;
+	
+	// One placement of a Model somewhere beneath a root, with everything inherited along the way folded in
+	struct Instance {
+		const Model * model;
+		TransMatrix transform;
+		uint32_t colour;
+		bool invert; // Swap the second and third index of each triangle
+		bool cull; // False if anything above switched BFC off, so every face needs a back face
+	};
+	
 	class Model {
 		template<typename ErrF> friend class ModelBuilder;
 	public:
 		typedef Cache::CacheNode<const Model> CacheType;
 		typedef Cache::CacheNode<const size_t> IndexType;
+		typedef std::tuple<size_t, BFCStatus, TransMatrix, const Model*> ChildType;
 	private:
 		std::string mName;
 		std::string mSrcLoc;
 		SrcType mSrcType;
-		const std::shared_ptr<const IndexType> mSubModelNames;
+		std::shared_ptr<const IndexType> mSubModelNames; // Interned submodels let go of both once they're built
 		std::shared_ptr<CacheType> mSubModels; // This is shared across the whole MPD
-		ColorTable &mColorTable;
-		std::unordered_map<uint16_t, uint16_t> mLocalColors;
-		std::unordered_map<uint16_t, uint16_t> mLocalComplements; // This is a bit of an abomination,
+		std::shared_ptr<const Palette> mPalette;
+		std::shared_ptr<const ColourOverlay> mLocalColors; // Submodels of an MPD share the root's until they define their own
 
 		LDMesh mData;
+		OptLineBuffer mOptLines;
 		size_t mColor;
-		std::vector<std::tuple<size_t, BFCStatus, TransMatrix, const Model*> > mChildren;
+		std::vector<ChildType> mChildren;
 		std::unordered_map<const Model*, std::pair<std::pair<size_t, size_t>, std::pair<size_t, size_t>> > mChildOffsets;
-		std::vector<size_t> mStepEnds;
+		std::vector<StepMark> mStepEnds; // Closed off at EOF, so the last mark always covers everything
 		boost::logic::tribool mCertify;
 		BFCStatus mWinding;
 
+		// Bounds are computed on first request. Models are shared through the cache, so this has to be safe from any thread.
+		mutable std::once_flag mLocalBoundsOnce, mBoundsOnce, mExactBoundsOnce, mPositionArraysOnce;
+		mutable AABB mLocalBounds, mBounds, mExactBounds;
+		mutable PositionArrays mPositionArrays;
+		
+		void extendExactBounds(AABB &bounds, const TransMatrix &transform) const;
+		template<typename F> void visitInstancesFrom(const Instance &here, F &f) const;
 		
 	public:
-		Model(std::string name, std::string srcLoc, SrcType srcType, ColorTable& colorTable, const std::shared_ptr<const IndexType> subModelNames = nullptr, std::shared_ptr<CacheType> subModels = nullptr);
+		Model(std::string name, std::string srcLoc, SrcType srcType, const std::shared_ptr<const Palette> &palette, const std::shared_ptr<const IndexType> subModelNames = nullptr, std::shared_ptr<CacheType> subModels = nullptr);
 		
 		std::shared_ptr<const CacheType> getSubFileCache() const { return mSubModels; }
 		const std::string& getPath() const { return mSrcLoc; }
+		const LDMesh& getMesh() const { return mData; }
+		const std::vector<ChildType>& getChildren() const { return mChildren; }
+		const OptLineBuffer& getOptLines() const { return mOptLines; }
+		const std::vector<StepMark>& getStepEnds() const { return mStepEnds; }
+		const std::string& getName() const { return mName; }
+		SrcType getSrcType() const { return mSrcType; }
+		const Palette& getPalette() const { return *mPalette; }
+		StepMark currentMark() const { return {mData.indices.size(), mData.bfIndices.size(), mChildren.size(), mOptLines.size(), mData.lineIndices.size()}; }
+		
+		// Appends the geometry of this Model and everything it includes to out, in this Model's frame.
+		// Colour 16 resolves to colour (24 to its complement, for edges), and anything BFC doesn't let us cull gets explicit back faces in bfIndices.
+		// Conditional lines go to optLines, if given. Of the edge lines this appends, any that land on one already appended are dropped.
+		void flatten(LDMesh &out, uint32_t colour = MainColour, OptLineBuffer *optLines = nullptr) const;
+		// The same, for just this Model's own data, placed as instance says (instance.model should be this)
+		void appendInstance(LDMesh &out, OptLineBuffer *optLines, const Instance &instance) const;
+		
+		// This Model's own positions again, laid out for the kernels in GeomKernels.hpp. Made on first request, like the bounds.
+		const PositionArrays& getPositionArrays() const;
+		// Bounds of this Model's own geometry, ignoring anything it includes
+		const AABB& getLocalBounds() const;
+		// Bounds of everything, combining each child's bounds as a transformed box. This is conservative, and touches each Model's vertices only once.
+		const AABB& getBounds() const;
+		// Tight bounds, from transformed vertices. Children are only visited where their conservative box could still grow the result.
+		const AABB& getExactBounds() const;
+		
+		// Calls f(const Instance&) for this Model and everything beneath it, parents before children, in the order flatten emits them.
+		// Nothing is copied, so this is the way to stream over a model too big to flatten.
+		template<typename F> void visitInstances(F f, uint32_t colour = MainColour) const {
+			visitInstancesFrom(Instance{this, identityTransform(), colour, false, true}, f);
+		}
 	};
+	
+	template<typename F> void Model::visitInstancesFrom(const Instance &here, F &f) const {
+		f(here);
+		for(auto it = mChildren.begin(); it != mChildren.end(); ++it){
+			const Model * child = std::get<3>(*it);
+			if(child == nullptr) continue;
+			const BFCStatus status = std::get<1>(*it);
+			child->visitInstancesFrom(Instance{child, composeTransforms(here.transform, std::get<2>(*it)), mPalette->resolve(std::get<0>(*it), here.colour),
+				here.invert != (status == Invert), here.cull && status != BFCOff}, f);
+		}
+	}
 }
 
 #endif /* Model_h */
@@ -9,7 +9,15 @@
 #ifndef ModelBuilderDefs_h
 #define ModelBuilderDefs_h
 
+#include <LDParse/GeomKernels.hpp>
 #include <LDParse/Model.hpp>
+#include <LDParse/Library.hpp>
+#include <LDParse/Weld.hpp>
+
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <memory>
 
 namespace LDParse {
 	template<typename ErrF> class ModelBuilder{
@@ -65,19 +73,74 @@ namespace LDParse {
 		template<bool root=false> void recordTo(Model * model){
 			metaCallback.retarget(model);
 			inclCallback.retarget(model);
+			lineCallback.retarget(model);
 			triCallback.retarget(model);
 			quadCallback.retarget(model);
+			optLineCallback.retarget(model);
 			if(root){
 				mWindings.clear();
 				mInvertNext.clear();
+				mClipping.clear();
+				mResumeStack.clear();
 				mpdCallback.retarget(model);
 				eofCallback.retarget(model);
 			}
 		}
 		
+		uint32_t resolveColour(Model &target, const ColorRef &c);
+		void emitPolygon(Model &target, const ColorRef &c, const Position * corners, size_t cornerCt);
+		void resolveChildWindings(Model &model);
+		void weldModel(Model &model);
+		const Model * resolveExternal(Model &target, const std::string &name, const TransMatrix &t);
+		const Model * resolveAt(const std::string &name, LODLevel level);
+		boost::optional<Fingerprint> internKey(const Palette * palette, const ColourOverlay &inherited, size_t index) const;
+		
 		std::unordered_map<const Model*, Winding> mWindings;
 		std::unordered_set<const Model*> mInvertNext;
 		std::unordered_set<const Model*> mClipping;
+		std::vector<Model*> mResumeStack; // Files that were interrupted by a SwitchFile, innermost last
+		
+		// Direct colours this builder has already interned, so that repeats don't take LocalColours' lock.
+		// The palette keeps its LocalColours alive, and with it every code cached here.
+		struct DirectColours {
+			std::shared_ptr<const Palette> mPalette;
+			std::unordered_map<uint32_t, uint32_t> mCodes; // RGBA -> code
+		};
+		DirectColours mOwnDirectColours;
+		DirectColours * mDirectColours; // Builders made for dependencies use their parent's
+		std::unordered_set<std::string> mOwnResolving;
+		std::unordered_set<std::string> * mResolving; // Cache keys of the library files being built further up, including this one
+		
+		boost::optional<float> mWeldEpsilon;
+		size_t mWeldThreads;
+		WeldStats mWeldStats;
+		
+		Library * mLibrary;
+		Arena * mArena;
+		LODPolicy mLODPolicy;
+		ColorTable * mColorTable; // While constructing, so LDConfig can add to it
+		
+		bool mInterning;
+		bool mInternRoot; // For dependencies: the file itself may be shared, not just its submodels
+		bool mIncludesOnly;
+		const ModelStream * mModels; // While constructing
+		std::vector<boost::optional<Fingerprint> > mFingerprints; // One per model in mModels, if interning
+		std::unordered_map<Model*, Fingerprint> mPendingInterns; // Made in the library's Arena, to be interned once they're finished
+		std::unordered_set<const Model*> mUnshared; // Submodels of the file being built that other files mustn't share, however indirectly
+		boost::optional<Fingerprint> mRootKey; // What the last file built was interned as, if it could be
+		const Model * mSharedRoot; // What the last file turned out to be, if it had been interned already
+		
+	public:
+		typedef std::function<bool(const std::string &name, const Library::Entry &entry)> DeferF;
+	private:
+		DeferF mDefer;
+		bool mDeferring; // Only while building with start()
+		std::string mWaitingFor;
+		ModelStream mStream; // The file being built, lexed, until it's done
+		std::unique_ptr<ParseCursor> mCursor;
+		Model * mResult;
+		
+		bool begin(std::string srcLoc, std::string modelName, std::istream &fileContents, ColorTable& colorTable, SrcType srcType);
 		
 		typedef Parser<decltype(mpdCallback), decltype(metaCallback), decltype(inclCallback),
 		decltype(lineCallback), decltype(triCallback), decltype(quadCallback), decltype(optLineCallback),
@@ -85,7 +148,64 @@ namespace LDParse {
 		ModelParser mParser;
 	public:
 		ModelBuilder(ErrF &errF);
+		~ModelBuilder();
+		/*
+		 * Returns null if the file couldn't be parsed. Without an arena, the caller owns the Model and must delete it; its submodels
+		 * belong to it. With one, the arena owns the Model, its submodels and its caches, and they all go when the arena does:
+		 * don't delete it. Either way, anything it includes from a Library belongs to the Library, which has to outlive it.
+		 */
 		Model* construct(std::string srcLoc, std::string modelName, std::istream &fileContents, ColorTable& colorTable, SrcType srcType = UnknownT);
+		
+		/*
+		 * The same, in as many goes as it takes: with a deferral set (see setDeferral), parsing suspends whenever an include needs
+		 * a library file that isn't ready, and resume() carries on from that include once it is. In between, nothing is re-lexed or
+		 * lost, and the thread is free to build something else (with another builder). Each returns false if the file couldn't be
+		 * parsed; once the build isn't suspended(), result() is what construct would have returned.
+		 * colorTable and the stream's contents are kept until then; fileContents itself is done with as soon as start() returns.
+		 */
+		bool start(std::string srcLoc, std::string modelName, std::istream &fileContents, ColorTable& colorTable, SrcType srcType = UnknownT);
+		bool resume();
+		bool suspended() const { return mCursor && mCursor->suspended(); }
+		// The library name a suspended build is waiting for
+		const std::string& waitingFor() const { return mWaitingFor; }
+		Model* result();
+		
+		// When set, each Model's mesh is welded with this tolerance as soon as its file has been parsed
+		void setWeldEpsilon(boost::optional<float> epsilon) { mWeldEpsilon = epsilon; }
+		// Workers for each weld (0 for one per hardware thread). Builders that already run side by side should use 1.
+		void setWeldThreads(size_t threads) { mWeldThreads = threads; }
+		const WeldStats& getWeldStats() const { return mWeldStats; }
+		
+		// Includes that aren't submodels of the file being built are resolved through, and cached in, the library
+		void setLibrary(Library * library) { mLibrary = library; }
+		void setLODPolicy(const LODPolicy &policy) { mLODPolicy = policy; }
+		// Models, their submodel caches and their indices are then made in arena, rather than one by one on the heap
+		void setArena(Arena * arena) { mArena = arena; }
+		/*
+		 * With a library, submodels and library files are looked up by content (see fingerprintModels) before they're parsed, and if
+		 * anything built through the library had the same content, under whatever name, it's shared instead. Submodels that could be
+		 * shared are made in the library's Arena, whatever setArena said, and belong to the library. An interned Model keeps the name
+		 * and path of whichever copy was built first. Only share a library between builders configured alike while interning.
+		 */
+		void setInterning(bool interning) { mInterning = interning; }
+		/*
+		 * Only records what each file includes, and where (plus its STEPs and colours), leaving every mesh empty. Library parts and
+		 * primitives aren't even read: they're stood in for by empty Models. This is enough for anything that only walks the
+		 * include DAG (see BOMCounter), at a fraction of the cost. Such Models are cached apart from full ones, at every level.
+		 */
+		void setIncludesOnly(bool includesOnly) { mIncludesOnly = includesOnly; }
+		/*
+		 * Asked, while building with start(), about each library file an include needs that's neither cached nor staged (see
+		 * Library::stage). Returning true suspends the build until resume(); by then, the file should be staged or cached, or
+		 * it'll be asked about again. Only the file's own includes are deferred: a library file's own dependencies are read as
+		 * it's built, unless they were staged along with it (as preload does). Deferring never happens within construct().
+		 */
+		void setDeferral(const DeferF &defer) { mDefer = defer; }
+		/*
+		 * The library's Model for name at the policy's level, building and caching it (and whatever it includes) if it isn't
+		 * cached already. Null without a library, or if name isn't in it.
+		 */
+		const Model * require(const std::string &name);
 	};
 }
 
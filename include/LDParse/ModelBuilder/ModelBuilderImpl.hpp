@@ -14,18 +14,24 @@
 namespace LDParse {
 	
 	template<typename ErrF>	Action ModelBuilder<ErrF>::handleMPDCommand(Model& target, boost::optional<const std::string&> file){
-		std::cout << "0 ";
-		if(file) {
-			std::cout << "FILE " << *file;
-		} else {
-			std::cout << "NOFILE";
-		}
-		std::cout << std::endl;
-		
 		if(file && file->compare(target.mName)){
-			Model * subModel = new Model(*file, target.mSrcLoc, MPDSubT, target.mColorTable, target.mSubModelNames, target.mSubModels);
-			target.mSubModels->insert(*file, std::unique_ptr<Model>(subModel));
-			recordTo(subModel);
+			boost::optional<const size_t&> index = target.mSubModelNames->find(*file);
+			const boost::optional<Fingerprint> key = index ? internKey(target.mPalette.get(), *target.mLocalColors, *index) : boost::none;
+			if(key){
+				boost::optional<const Model&> shared = mLibrary->findInterned(*key);
+				if(shared){
+					// Built before, maybe under another name: share that, and skip straight to this model's EOF
+					target.mSubModels->insert(*file, ArenaPtr<const Model>(&*shared, ArenaDelete<const Model>(true)));
+					recordTo(nullptr);
+					return Action(SkipNLines, (*mModels)[*index].second.size() - 1);
+				}
+			}
+			ArenaPtr<Model> subModel = makeIn<Model>(key ? &mLibrary->getArena() : mArena, *file, target.mSrcLoc, MPDSubT, target.mPalette, target.mSubModelNames, target.mSubModels);
+			subModel->mLocalColors = target.mLocalColors;
+			recordTo(subModel.get());
+			if(key) mPendingInterns[subModel.get()] = *key;
+			else if(mFingerprints.size()) mUnshared.insert(subModel.get()); // Only matters while interning
+			target.mSubModels->insert(*file, std::move(subModel));
 		} else if(!file) {
 			recordTo(nullptr);
 		}
@@ -65,72 +71,69 @@ namespace LDParse {
 				}
 				
 				if(success){
-					boost::optional<uint16_t> lVal;
-					if(target.mSrcType == ConfigT){
-						target.mColorTable.setColour(code.second, v.second);
-						target.mColorTable.setComplement(code.second, (e.first || !(lVal = target.mColorTable.addLocalColour(e.second))) ? e.second : *lVal);
-						success &= e.first || lVal; // We have garbage data if the !lVal condition above was true
+					// An edge given as a value gets interned as a colour of its own
+					LocalColours &locals = target.mPalette->getLocals();
+					boost::optional<uint32_t> edge = e.first ? boost::optional<uint32_t>(resolveColour(target, e)) : locals.intern(e.second, 0);
+					if(target.mSrcType == ConfigT && mColorTable != nullptr){
+						success &= (bool)edge && mColorTable->setColour(code.second, v.second) && mColorTable->setComplement(code.second, *edge);
 					} else {
-						if(success &= (bool)(lVal = target.mColorTable.addLocalColour(v.second))){
-							target.mLocalColors[code.second] = *lVal;
-							target.mColorTable.setComplement(code.second, (e.first || !(lVal = target.mColorTable.addLocalColour(e.second))) ? e.second : *lVal);
-							if((success &= e.first || lVal) && e.first) { // We have garbage data if the !lVal condition above was true
-								target.mLocalComplements[code.second] = e.second;
-							}
+						boost::optional<uint32_t> local = edge ? locals.intern(v.second, *edge) : boost::none;
+						if(success &= (bool)local){
+							// Copied on write, in case a submodel is still sharing the old overlay
+							std::shared_ptr<ColourOverlay> overlay = std::make_shared<ColourOverlay>(*target.mLocalColors);
+							(*overlay)[code.second] = *local;
+							target.mLocalColors = overlay;
 						}
 					}
-					
+					if(!success) mErr("Couldn't record colour", name, false);
 				}
 				break;
 			}
 			case Step:
-				target.mStepEnds.push_back(target.mData.indices.size());
+				target.mStepEnds.push_back(target.currentMark());
 				break;
 			case BFC:
 				if(success &= (tokenIt != eolIt)){
-					bool leadingOrient = true;
-					switch (tokenIt->k) {
+					switch ((tokenIt++)->k) {
 						case InvertNext:
-							leadingOrient = false;
-							if(target.mCertify) {
-								mInvertNext.insert(&target);
-							} break;
+							if(target.mCertify) mInvertNext.insert(&target);
+							break;
 						case NoCertify:
-							leadingOrient = false;
 							target.mCertify = false;
 							break;
-						case NoClip:
-							leadingOrient = false;
-							if(target.mCertify){
-								mClipping.erase(&target);
-							} break;
 						case Certify:
-							leadingOrient = false;
 							if(success &= (indeterminate(target.mCertify) || (bool)target.mCertify)){
 								target.mCertify = true;
 								mClipping.insert(&target);
 								mWindings[&target] = CCW;
-								if (++tokenIt != eolIt && (success &= tokenIt->k == Orientation)) goto META_PARSE_ORIENTATION;
-								break;
+								if(tokenIt != eolIt && (success &= tokenIt->k == Orientation)) mWindings[&target] = boost::get<Winding>((tokenIt++)->v);
 							}
-						META_PARSE_CLIP:
+							break;
 						case Clip:
-							if(target.mCertify){
-								mClipping.insert(&target);
-								if (++tokenIt != eolIt && (success &= tokenIt->k == Orientation && !leadingOrient)){
-									leadingOrient = false;
-									goto META_PARSE_ORIENTATION;
-								} else {
-									leadingOrient = false;
+						case NoClip:
+						case Orientation: {
+							// Any of CLIP, NOCLIP, CW, CCW, or a clip command and an orientation in either order
+							bool sawClip = false, sawOrient = false;
+							for(--tokenIt; success && tokenIt != eolIt; ++tokenIt){
+								switch(tokenIt->k){
+									case Clip:
+									case NoClip:
+										if((success &= !sawClip) && target.mCertify){
+											if(tokenIt->k == Clip) mClipping.insert(&target);
+											else mClipping.erase(&target);
+										}
+										sawClip = true;
+										break;
+									case Orientation:
+										if((success &= !sawOrient) && target.mCertify) mWindings[&target] = boost::get<Winding>(tokenIt->v);
+										sawOrient = true;
+										break;
+									default:
+										success = false;
 								}
-							} break;
-						META_PARSE_ORIENTATION:
-						case Orientation:
-							if(target.mCertify){
-								mWindings[&target] = boost::get<Winding>(tokenIt->v);
-								if(tokenIt != eolIt && (success &= tokenIt->k == Clip && leadingOrient))
-									goto META_PARSE_CLIP;
-							} break;
+							}
+							break;
+						}
 						default:
 							success = false;
 							break;
@@ -150,46 +153,279 @@ namespace LDParse {
 		boost::optional<const Model&> subModel;
 		// This may be a performance bottleneck and we'll have to combine the two trees, but that would require us to tackle the typing more directly.
 		if(target.mSubModelNames && (subIndex = target.mSubModelNames->find(name)) && !(subModel = target.mSubModels->find(name))){
-			std::cout << "Switching file to " << name << std::endl;
+			LDPARSE_COUNT(SwitchFiles, 1);
+			mResumeStack.push_back(&target);
 			ret = Action(SwitchFile, *subIndex);
-		} else if (subModel) {
-			std::cout << "Submodel " << name << " was present" << std::endl;
-			
-			
 		} else {
-			std::cout << "Fetching " << name << ", later" << std::endl;
+			const Model * child = nullptr;
+			if (subModel) {
+				LDPARSE_COUNT(CacheHits, 1);
+				child = &(*subModel);
+			} else if(!(child = resolveExternal(target, name, t))) {
+				if(mWaitingFor.size()) return Action(SuspendOnDependency, 0); // Before anything else is done with this line
+				mErr("Couldn't find included file", name, false);
+			}
+			if(child){
+				// INVERTNEXT is folded in now, the sign of the determinant once the whole file is known (see resolveChildWindings)
+				BFCStatus status = BFCOff;
+				if(target.mCertify && mClipping.count(&target)) status = mInvertNext.count(&target) ? Invert : Standard;
+				target.mChildren.push_back(std::make_tuple(resolveColour(target, c), status, t, child));
+			}
+		}
+		// A line that switches files (or suspends, above) is parsed again afterwards, and only counted then
+		if(ret.k != SwitchFile){
+			LDPARSE_COUNT(Includes, 1);
+			mInvertNext.erase(&target);
 		}
-		if(ret.k != SwitchFile) mInvertNext.erase(&target);
 		return ret;
 	}
 	
 	template<typename ErrF>	Action ModelBuilder<ErrF>::handleTriangle(Model& target, const ColorRef &c, const Triangle &t){
 		if(indeterminate(target.mCertify)) target.mCertify = false;
+		if(mIncludesOnly) return Action();
+		const Position corners[] = {std::get<0>(t), std::get<1>(t), std::get<2>(t)};
+		emitPolygon(target, c, corners, 3);
 		return Action();
 	}
 	
 	template<typename ErrF>	Action ModelBuilder<ErrF>::handleQuad(Model& target, const ColorRef &c, const Quad &q){
 		if(indeterminate(target.mCertify)) target.mCertify = false;
+		if(mIncludesOnly) return Action();
+		const Position corners[] = {std::get<0>(q), std::get<1>(q), std::get<2>(q), std::get<3>(q)};
+		emitPolygon(target, c, corners, 4);
 		return Action();
 	}
 	
 	template<typename ErrF>	void ModelBuilder<ErrF>::handleEOF(Model& target){
-		std::cout << "Unswitching" << std::endl;
-		recordTo(&target);
+		Model * finished = triCallback.mTarget; // Whichever file we were recording to is the one that just ended
+		if(finished){
+			resolveChildWindings(*finished);
+			// Anything after the last STEP is an implicit final step
+			if(finished->mStepEnds.empty() || finished->mStepEnds.back() != finished->currentMark()){
+				finished->mStepEnds.push_back(finished->currentMark());
+			}
+			if(mWeldEpsilon) weldModel(*finished);
+			// After welding, so faces that now share a vertex share its normal too
+			computeNormals(finished->mData);
+			auto pending = mPendingInterns.find(finished);
+			if(pending != mPendingInterns.end()){
+				// Its fingerprint can't see colours a sibling inherited, so a sibling built under them may still be in this file's
+				// arena, and anything sharing this model would outlive it. Then it stays this file's, like the sibling.
+				bool shareable = true;
+				for(auto it = finished->mChildren.begin(); shareable && it != finished->mChildren.end(); ++it){
+					shareable = !mUnshared.count(std::get<3>(*it));
+				}
+				if(shareable){
+					// Other files will share it now, so it can't hang on to this one's caches
+					finished->mSubModelNames.reset();
+					finished->mSubModels.reset();
+					mLibrary->intern(pending->second, *finished);
+				} else {
+					mUnshared.insert(finished);
+				}
+				mPendingInterns.erase(pending);
+			}
+		}
+		if(mResumeStack.size()){
+			recordTo(mResumeStack.back());
+			mResumeStack.pop_back();
+		} else {
+			recordTo(&target);
+		}
 	}
 	
 	
-	// These two routines have nothing to do but enforce Certification rules w.r.t. "operational command lines" - http://www.ldraw.org/article/415.html
-	template<typename ErrF>	Action ModelBuilder<ErrF>::handleLine(Model& target, const ColorRef &, const Line &){
+	// Besides recording what they're given, these two routines enforce Certification rules w.r.t. "operational command lines" - http://www.ldraw.org/article/415.html
+	template<typename ErrF>	Action ModelBuilder<ErrF>::handleLine(Model& target, const ColorRef &c, const Line &l){
 		if(indeterminate(target.mCertify)) target.mCertify = false;
+		if(mIncludesOnly) return Action();
+		// The ends get vertices of their own for now; welding folds them into the faces they border
+		LDMesh &mesh = target.mData;
+		const uint32_t base = (uint32_t)mesh.vertexCount();
+		std::get<0>(mesh.attributes).push_back(std::get<0>(l));
+		std::get<0>(mesh.attributes).push_back(std::get<1>(l));
+		std::get<1>(mesh.attributes).resize(base + 2, Position(0, 0, 0));
+		std::get<2>(mesh.attributes).resize(base + 2, EdgeColour);
+		mesh.lineIndices.push_back(base);
+		mesh.lineIndices.push_back(base + 1);
+		mesh.lineColours.push_back(resolveColour(target, c));
 		return Action();
 	}
 	
-	template<typename ErrF>	Action ModelBuilder<ErrF>::handleOptLine(Model& target, const ColorRef &, const OptLine &){
+	template<typename ErrF>	Action ModelBuilder<ErrF>::handleOptLine(Model& target, const ColorRef &c, const OptLine &l){
 		if(indeterminate(target.mCertify)) target.mCertify = false;
+		if(mIncludesOnly) return Action();
+		target.mOptLines.push_back(l, resolveColour(target, c));
 		return Action();
 	}
 	
+	template<typename ErrF>	uint32_t ModelBuilder<ErrF>::resolveColour(Model &target, const ColorRef &c){
+		uint32_t ret = c.second;
+		if(c.first){
+			auto localIt = target.mLocalColors->find(c.second);
+			if(localIt != target.mLocalColors->end()) ret = localIt->second;
+		} else {
+			// Direct colours are 0x2RRGGBB, we store them like any other !COLOUR value
+			const uint32_t rgba = ((c.second & 0xffffff) << 8) | 0xff;
+			DirectColours &cache = *mDirectColours;
+			if(!cache.mPalette || &cache.mPalette->getLocals() != &target.mPalette->getLocals()){
+				cache.mPalette = target.mPalette;
+				cache.mCodes.clear();
+			}
+			auto cachedIt = cache.mCodes.find(rgba);
+			boost::optional<uint32_t> code = cachedIt != cache.mCodes.end() ? cachedIt->second : target.mPalette->getLocals().intern(rgba, 0);
+			if(code){
+				ret = *code;
+				cache.mCodes.emplace(rgba, ret);
+			} else {
+				mErr("Colour table is full, direct colour will be treated as the main colour", target.mName, false);
+				ret = MainColour;
+			}
+		}
+		return ret;
+	}
+	
+	// Fans the polygon out into triangles, wound CCW regardless of the file's declared winding.
+	// Anything we aren't allowed to cull gets a reversed copy in bfIndices.
+	template<typename ErrF>	void ModelBuilder<ErrF>::emitPolygon(Model &target, const ColorRef &c, const Position * corners, size_t cornerCt){
+		LDMesh &mesh = target.mData;
+		std::vector<Position> &positions = std::get<0>(mesh.attributes);
+		std::vector<Position> &normals = std::get<1>(mesh.attributes);
+		std::vector<uint32_t> &colours = std::get<2>(mesh.attributes);
+		
+		const uint32_t base = (uint32_t)mesh.vertexCount();
+		const uint32_t colour = resolveColour(target, c);
+		for(size_t i = 0; i < cornerCt; ++i){
+			positions.push_back(corners[i]);
+			normals.push_back(Position(0, 0, 0)); // Filled in at EOF, once vertices have been welded
+			colours.push_back(colour);
+		}
+		
+		const bool cull = (bool)target.mCertify && mClipping.count(&target);
+		auto windingIt = mWindings.find(&target);
+		const bool reverse = cull && windingIt != mWindings.end() && windingIt->second == CW;
+		for(uint32_t k = 1; k + 1 < cornerCt; ++k){
+			uint32_t a = base, b = base + k, d = base + k + 1;
+			if(reverse) std::swap(b, d);
+			mesh.indices.push_back(a); mesh.indices.push_back(b); mesh.indices.push_back(d);
+			if(!cull){
+				mesh.bfIndices.push_back(a); mesh.bfIndices.push_back(d); mesh.bfIndices.push_back(b);
+			}
+		}
+	}
+	
+	template<typename ErrF>	const Model * ModelBuilder<ErrF>::resolveExternal(Model &target, const std::string &name, const TransMatrix &t){
+		if(mLibrary == nullptr) return nullptr;
+		// Without geometry, there's nothing for the level of detail to change
+		const LODLevel level = mIncludesOnly ? StandardRes : mLODPolicy.mChoose ? mLODPolicy.mChoose(name, t, mLODPolicy.mLevel) : mLODPolicy.mLevel;
+		return resolveAt(name, level);
+	}
+	
+	// Everything a variant includes is built at the variant's level too, so the level is part of the cache key all the way down.
+	template<typename ErrF>	const Model * ModelBuilder<ErrF>::resolveAt(const std::string &name, LODLevel level){
+		const Model * ret = nullptr;
+		const std::string variant = mLibrary->variantFor(name, level, mLODPolicy);
+		const std::string key = Library::cacheKey(variant, level, mIncludesOnly);
+		boost::optional<const Model&> cached = mLibrary->find(key);
+		boost::optional<Library::Entry> entry;
+		if(cached){
+			LDPARSE_COUNT(CacheHits, 1);
+			ret = &(*cached);
+		} else if((entry = mLibrary->locate(variant)) && mIncludesOnly && (entry->mSrcType == PartT || entry->mSrcType == PrimitiveT)){
+			// Nothing inside a part matters without its geometry, so it isn't even read
+			LDPARSE_COUNT(CacheMisses, 1);
+			ArenaPtr<Model> stub = makeIn<Model>(&mLibrary->getArena(), variant, entry->mPath, entry->mSrcType, mLibrary->getColorTable().snapshot());
+			stub->mStepEnds.push_back(stub->currentMark());
+			ret = &mLibrary->insert(key, std::move(stub), entry->mPath);
+		} else if(entry && mDeferring && !mLibrary->hasStaged(entry->mPath) && mDefer(variant, *entry)){
+			mWaitingFor = variant; // handleInclude suspends, and this include is tried again on resume
+		} else if(entry && mResolving->count(key)){
+			// It's still being built, somewhere above us, so it includes itself
+			mErr("Cyclic include", variant, false);
+		} else if(entry){
+			LDPARSE_COUNT(CacheMisses, 1);
+			mResolving->insert(key);
+			ModelBuilder<ErrF> dependency(mErr);
+			dependency.mInterning = dependency.mInternRoot = mInterning;
+			dependency.mIncludesOnly = mIncludesOnly;
+			dependency.mDirectColours = mDirectColours;
+			dependency.mResolving = mResolving;
+			dependency.mWeldEpsilon = mWeldEpsilon;
+			dependency.mWeldThreads = mWeldThreads;
+			dependency.mLibrary = mLibrary;
+			dependency.mArena = &mLibrary->getArena();
+			dependency.mLODPolicy = mLODPolicy;
+			dependency.mLODPolicy.mLevel = level;
+			Model * built = nullptr;
+			FileContents staged = mLibrary->takeStaged(entry->mPath);
+			if(staged){
+				MemoryStreamBuf buffer(staged->data(), staged->size());
+				std::istream file(&buffer);
+				built = dependency.construct(entry->mPath, variant, file, mLibrary->getColorTable(), entry->mSrcType);
+			} else {
+				std::ifstream file(entry->mPath);
+				if(file) built = dependency.construct(entry->mPath, variant, file, mLibrary->getColorTable(), entry->mSrcType);
+				else mErr("Couldn't open file", entry->mPath, false);
+			}
+			mResolving->erase(key);
+			mWeldStats += dependency.mWeldStats;
+			const Model * shared = dependency.mSharedRoot;
+			if(built) shared = dependency.mRootKey ? &mLibrary->intern(*dependency.mRootKey, *built) : built;
+			if(shared) ret = &mLibrary->insert(key, ArenaPtr<const Model>(shared, ArenaDelete<const Model>(true)), entry->mPath);
+		}
+		return ret;
+	}
+	
+	template<typename ErrF>	const Model * ModelBuilder<ErrF>::require(const std::string &name){
+		return mLibrary ? resolveAt(name, mLODPolicy.mLevel) : nullptr;
+	}
+	
+	// What the index-th model of the file being built is interned as: its content, and everything it inherits from the builder and the file
+	template<typename ErrF>	boost::optional<Fingerprint> ModelBuilder<ErrF>::internKey(const Palette * palette, const ColourOverlay &inherited, size_t index) const {
+		// Colours inherited from the root of an MPD aren't part of anyone's content, so anything under their influence is left alone
+		if(mLibrary == nullptr || index >= mFingerprints.size() || !mFingerprints[index] || !inherited.empty()) return boost::none;
+		FingerprintHasher hash;
+		hash.add(*mFingerprints[index]);
+		hash.add((uint64_t)(uintptr_t)palette); // Interned Models keep their palette alive, so this can't be reused
+		hash.add((uint64_t)mLODPolicy.mLevel);
+		hash.add((uint64_t)mIncludesOnly);
+		if(mWeldEpsilon){
+			uint32_t bits;
+			memcpy(&bits, &*mWeldEpsilon, sizeof(bits));
+			hash.add((uint64_t)bits);
+		}
+		return hash.result();
+	}
+	
+	// Welding may drop degenerate triangles and duplicate edges, so the step marks have to follow the indices they point into
+	template<typename ErrF>	void ModelBuilder<ErrF>::weldModel(Model &model){
+		const size_t stepCt = model.mStepEnds.size();
+		WeldMarks marks;
+		for(size_t i = 0; i < stepCt; ++i){
+			marks.indices.push_back(model.mStepEnds[i].indices);
+			marks.bfIndices.push_back(model.mStepEnds[i].bfIndices);
+			marks.lineIndices.push_back(model.mStepEnds[i].lineIndices);
+		}
+		mWeldStats += weldVertices(model.mData, *mWeldEpsilon, mWeldThreads, &marks);
+		for(size_t i = 0; i < stepCt; ++i){
+			model.mStepEnds[i].indices = marks.indices[i];
+			model.mStepEnds[i].bfIndices = marks.bfIndices[i];
+			model.mStepEnds[i].lineIndices = marks.lineIndices[i];
+		}
+	}
+	
+	// A mirroring transformation flips the winding of everything beneath it, so we fold the sign of each child's determinant
+	// into its BFCStatus. This runs once per file, over the whole child list, rather than once per include.
+	template<typename ErrF>	void ModelBuilder<ErrF>::resolveChildWindings(Model &model){
+		const size_t childCt = model.mChildren.size();
+		std::vector<float> dets(childCt);
+		for(size_t i = 0; i < childCt; ++i) dets[i] = determinant(std::get<2>(model.mChildren[i]));
+		for(size_t i = 0; i < childCt; ++i){
+			BFCStatus &status = std::get<1>(model.mChildren[i]);
+			if(dets[i] < 0 && status != BFCOff) status = (status == Invert) ? Standard : Invert;
+		}
+	}
+	
 	
 	template<typename ErrF>	ModelBuilder<ErrF>::ModelBuilder(ErrF &errF)
 	: mErr(errF),
@@ -201,6 +437,19 @@ namespace LDParse {
 	quadCallback(this, &ModelBuilder::handleQuad),
 	optLineCallback(this, &ModelBuilder::handleOptLine),
 	eofCallback(this, &ModelBuilder::handleEOF),
+	mDirectColours(&mOwnDirectColours),
+	mResolving(&mOwnResolving),
+	mWeldThreads(0),
+	mLibrary(nullptr),
+	mArena(nullptr),
+	mColorTable(nullptr),
+	mInterning(false),
+	mInternRoot(false),
+	mIncludesOnly(false),
+	mModels(nullptr),
+	mSharedRoot(nullptr),
+	mDeferring(false),
+	mResult(nullptr),
 	mParser(mpdCallback,
 			metaCallback,
 			inclCallback,
@@ -211,15 +460,37 @@ namespace LDParse {
 			eofCallback,
 			mErr) { mWindings.clear(); mInvertNext.clear(); }
 	
+	template<typename ErrF>	ModelBuilder<ErrF>::~ModelBuilder(){
+		if(mCursor && !mArena) delete mResult; // Abandoned part way through
+	}
+	
 	template<typename ErrF>	Model* ModelBuilder<ErrF>::construct(std::string srcLoc, std::string modelName, std::istream &fileContents, ColorTable& colorTable, SrcType srcType){
-		Model* ret = nullptr;
+		LDPARSE_TIME_PHASE(BuildPhase, &srcLoc); // A dependency built along the way is part of this, rather than a call of its own
+		mDeferring = false; // There'd be nothing to resume it, so every dependency is built as soon as it's needed
+		if(begin(srcLoc, modelName, fileContents, colorTable, srcType)) resume();
+		return result();
+	}
+	
+	template<typename ErrF>	bool ModelBuilder<ErrF>::start(std::string srcLoc, std::string modelName, std::istream &fileContents, ColorTable& colorTable, SrcType srcType){
+		LDPARSE_TIME_PHASE(BuildPhase, &srcLoc);
+		mDeferring = (bool)mDefer;
+		return begin(srcLoc, modelName, fileContents, colorTable, srcType) ? resume() : true;
+	}
+	
+	// Everything up to parsing. False if there's nothing to parse, because the file turned out to be shared.
+	template<typename ErrF>	bool ModelBuilder<ErrF>::begin(std::string srcLoc, std::string modelName, std::istream &fileContents, ColorTable& colorTable, SrcType srcType){
+		mResult = nullptr;
+		mCursor.reset();
+		mStream.clear();
+		mWaitingFor.clear();
 		
 		Lexer<ErrF> lexer(fileContents, mErr);
-		ModelStream models;
+		ModelStream &models = mStream;
 		std::string rootName = modelName;
 		bool isMPD = lexer.lexModelBoundaries(models, rootName);
 		
 		std::shared_ptr<Model::IndexType> subModelNames = nullptr;
+		std::shared_ptr<Model::CacheType> subModels = nullptr;
 		
 		if(isMPD){
 			if(srcType < ModelT) {
@@ -231,33 +502,76 @@ namespace LDParse {
 				srcLoc += modelName;
 				modelName = rootName;
 			}
-			subModelNames = std::shared_ptr<Model::IndexType>(Model::IndexType::makeRoot());
+			subModelNames = std::shared_ptr<Model::IndexType>(Model::IndexType::makeRoot(mArena));
+			if(srcType == MPDRootT) subModels = std::shared_ptr<Model::CacheType>(Model::CacheType::makeRoot(mArena));
 			size_t modelCount = models.size();
 			for(size_t i = 0; i < modelCount; i++){
-				size_t *dst = new size_t(i);
-				subModelNames->insert(models[i].first, std::unique_ptr<size_t>(dst));
+				subModelNames->insert(models[i].first, makeIn<const size_t>(mArena, i));
 			}
 		}
 		
-		ret = new Model(modelName, srcLoc, srcType, colorTable, subModelNames);
+		mRootKey = boost::none;
+		mSharedRoot = nullptr;
+		std::shared_ptr<const Palette> palette = colorTable.snapshot();
+		if(mInterning && mLibrary != nullptr && srcType != ConfigT){
+			fingerprintModels(models, subModelNames.get(), mFingerprints);
+			if(mInternRoot && !isMPD && (mRootKey = internKey(palette.get(), ColourOverlay(), 0))){
+				boost::optional<const Model&> shared = mLibrary->findInterned(*mRootKey);
+				if(shared){
+					mSharedRoot = &*shared;
+					mFingerprints.clear();
+					mStream.clear();
+					return false;
+				}
+			}
+		}
+		mModels = &models;
 		
-		recordTo<true>(ret);
+		mColorTable = &colorTable;
+		mResult = mArena ? mArena->make<Model>(modelName, srcLoc, srcType, palette, subModelNames, subModels)
+						 : new Model(modelName, srcLoc, srcType, palette, subModelNames, subModels);
 		
+		recordTo<true>(mResult);
+		mCursor.reset(new ParseCursor(models));
+		return true;
+	}
+	
+	template<typename ErrF>	bool ModelBuilder<ErrF>::resume(){
+		if(!mCursor) return false; // Nothing to resume
+		LDPARSE_CONTINUE_PHASE(BuildPhase, &mResult->mSrcLoc); // Of the call that started it
+		mWaitingFor.clear();
+		const bool ok = mParser.resume(*mCursor);
+		if(mCursor->suspended()) return ok;
 		
-		if(!mParser.parseModels(models)){
-			delete ret;
+		Model * ret = mResult;
+		if(!ok){
+			if(!mArena) delete ret; // Otherwise it's the arena's to destroy
 			ret = nullptr;
-		} else {
-			/*if(ret->mSubModels){
-				(ret->mSubModels)->dump();
-				for(auto it = models.begin() + 1; it < models.end(); ++it){
-					std::cout << "Find? " << ((ret->mSubModels)->find(it->first) != boost::none) << std::endl;
-				}
-			}*/
 		}
 		
 		recordTo(nullptr);
-		
+		if(ret && ret->mSrcType == ConfigT) ret->mPalette = mColorTable->snapshot(); // Now including everything it defined
+		mColorTable = nullptr;
+		// Anything left pending never finished, because parsing stopped; it stays in the library's Arena, unshared
+		for(auto it = mPendingInterns.begin(); it != mPendingInterns.end(); ++it){
+			it->first->mSubModelNames.reset();
+			it->first->mSubModels.reset();
+		}
+		mPendingInterns.clear();
+		mUnshared.clear();
+		mFingerprints.clear();
+		mModels = nullptr;
+		mCursor.reset();
+		mStream.clear();
+		if(!ret) mRootKey = boost::none;
+		mResult = ret;
+		return ok;
+	}
+	
+	template<typename ErrF>	Model* ModelBuilder<ErrF>::result(){
+		if(suspended()) return nullptr;
+		Model * ret = mResult;
+		mResult = nullptr;
 		return ret;
 	}
 }
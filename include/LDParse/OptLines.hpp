@@ -0,0 +1,149 @@
+//
+//  OptLines.hpp
+//  LDParse
+//
+//  Created by Thomas Dickerson on 1/28/16.
+//  Copyright © 2016 StickFigure Graphic Productions. All rights reserved.
+//
+
+#ifndef OptLines_h
+#define OptLines_h
+
+#include "Color.hpp"
+#include "GeomKernels.hpp"
+#include "Parallel.hpp"
+
+namespace LDParse {
+
+	constexpr static const size_t OptLineChunkSize = 1 << 12; // Keep this a multiple of the SIMD width, so chunks stay aligned
+
+	/*
+	 * Conditional (type 5) lines, stored as one aligned array per coordinate: the two end points p0, p1, and the
+	 * two control points c0, c1. The line is drawn only when both control points fall on the same side of it on screen.
+	 */
+	struct OptLineBuffer {
+		enum { P0X, P0Y, P0Z, P1X, P1Y, P1Z, C0X, C0Y, C0Z, C1X, C1Y, C1Z, CoordCount };
+		AlignedVector<float> coords[CoordCount];
+		std::vector<uint32_t> colours;
+
+		size_t size() const { return colours.size(); }
+
+		void push_back(const Position &p0, const Position &p1, const Position &c0, const Position &c1, uint32_t colour){
+			const Position * points[] = {&p0, &p1, &c0, &c1};
+			for(size_t p = 0; p < 4; ++p){
+				coords[3 * p].push_back(std::get<0>(*points[p]));
+				coords[3 * p + 1].push_back(std::get<1>(*points[p]));
+				coords[3 * p + 2].push_back(std::get<2>(*points[p]));
+			}
+			colours.push_back(colour);
+		}
+
+		void push_back(const OptLine &l, uint32_t colour){
+			push_back(std::get<0>(std::get<0>(l)), std::get<1>(std::get<0>(l)), std::get<0>(std::get<1>(l)), std::get<1>(std::get<1>(l)), colour);
+		}
+
+		Position point(size_t i, size_t which) const {
+			return Position(coords[3 * which][i], coords[3 * which + 1][i], coords[3 * which + 2][i]);
+		}
+
+		// Appends [begin, end) of o, transformed by t. Colour 16 becomes colour.
+		void append(const OptLineBuffer &o, size_t begin, size_t end, const TransMatrix &t, uint32_t colour){
+			for(size_t i = begin; i < end; ++i){
+				push_back(applyTransform(t, o.point(i, 0)), applyTransform(t, o.point(i, 1)),
+						  applyTransform(t, o.point(i, 2)), applyTransform(t, o.point(i, 3)),
+						  o.colours[i] == MainColour ? colour : o.colours[i]);
+			}
+		}
+	};
+
+	namespace OptLineImpl {
+		// Screen-space position of a point, given the x, y and w rows of a row-major view-projection matrix
+		struct Projected { float x, y; bool front; };
+
+		inline Projected project(const float * vp, float x, float y, float z){
+			const float cx = vp[0] * x + vp[1] * y + vp[2] * z + vp[3];
+			const float cy = vp[4] * x + vp[5] * y + vp[6] * z + vp[7];
+			const float cw = vp[12] * x + vp[13] * y + vp[14] * z + vp[15];
+			return {cx / cw, cy / cw, cw > 0.f};
+		}
+
+		inline bool visible(const OptLineBuffer &lines, const float * vp, size_t i){
+			const AlignedVector<float> *c = lines.coords;
+			const Projected p0 = project(vp, c[OptLineBuffer::P0X][i], c[OptLineBuffer::P0Y][i], c[OptLineBuffer::P0Z][i]);
+			const Projected p1 = project(vp, c[OptLineBuffer::P1X][i], c[OptLineBuffer::P1Y][i], c[OptLineBuffer::P1Z][i]);
+			const Projected c0 = project(vp, c[OptLineBuffer::C0X][i], c[OptLineBuffer::C0Y][i], c[OptLineBuffer::C0Z][i]);
+			const Projected c1 = project(vp, c[OptLineBuffer::C1X][i], c[OptLineBuffer::C1Y][i], c[OptLineBuffer::C1Z][i]);
+			const float dx = p1.x - p0.x, dy = p1.y - p0.y;
+			const float s0 = dx * (c0.y - p0.y) - dy * (c0.x - p0.x);
+			const float s1 = dx * (c1.y - p0.y) - dy * (c1.x - p0.x);
+			return p0.front && p1.front && c0.front && c1.front && s0 * s1 > 0.f;
+		}
+
+#ifdef __SSE__
+		struct Projected4 { __m128 x, y, front; };
+
+		inline Projected4 project4(const __m128 * vp, const float * xs, const float * ys, const float * zs, size_t i){
+			const __m128 x = _mm_load_ps(xs + i), y = _mm_load_ps(ys + i), z = _mm_load_ps(zs + i);
+			const __m128 cx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vp[0], x), _mm_mul_ps(vp[1], y)), _mm_add_ps(_mm_mul_ps(vp[2], z), vp[3]));
+			const __m128 cy = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vp[4], x), _mm_mul_ps(vp[5], y)), _mm_add_ps(_mm_mul_ps(vp[6], z), vp[7]));
+			const __m128 cw = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vp[12], x), _mm_mul_ps(vp[13], y)), _mm_add_ps(_mm_mul_ps(vp[14], z), vp[15]));
+			return {_mm_div_ps(cx, cw), _mm_div_ps(cy, cw), _mm_cmpgt_ps(cw, _mm_setzero_ps())};
+		}
+#endif
+
+		// Appends the indices of the visible lines in [begin, end) to out. begin must be a multiple of 4.
+		inline void visibleRange(const OptLineBuffer &lines, const float * vp, size_t begin, size_t end, std::vector<uint32_t> &out){
+			size_t i = begin;
+#ifdef __SSE__
+			__m128 vpv[16];
+			for(size_t k = 0; k < 16; ++k) vpv[k] = _mm_set1_ps(vp[k]);
+			const AlignedVector<float> *c = lines.coords;
+			for(; i + 4 <= end; i += 4){
+				const Projected4 p0 = project4(vpv, c[OptLineBuffer::P0X].data(), c[OptLineBuffer::P0Y].data(), c[OptLineBuffer::P0Z].data(), i);
+				const Projected4 p1 = project4(vpv, c[OptLineBuffer::P1X].data(), c[OptLineBuffer::P1Y].data(), c[OptLineBuffer::P1Z].data(), i);
+				const Projected4 c0 = project4(vpv, c[OptLineBuffer::C0X].data(), c[OptLineBuffer::C0Y].data(), c[OptLineBuffer::C0Z].data(), i);
+				const Projected4 c1 = project4(vpv, c[OptLineBuffer::C1X].data(), c[OptLineBuffer::C1Y].data(), c[OptLineBuffer::C1Z].data(), i);
+				const __m128 dx = _mm_sub_ps(p1.x, p0.x), dy = _mm_sub_ps(p1.y, p0.y);
+				const __m128 s0 = _mm_sub_ps(_mm_mul_ps(dx, _mm_sub_ps(c0.y, p0.y)), _mm_mul_ps(dy, _mm_sub_ps(c0.x, p0.x)));
+				const __m128 s1 = _mm_sub_ps(_mm_mul_ps(dx, _mm_sub_ps(c1.y, p0.y)), _mm_mul_ps(dy, _mm_sub_ps(c1.x, p0.x)));
+				__m128 mask = _mm_cmpgt_ps(_mm_mul_ps(s0, s1), _mm_setzero_ps());
+				mask = _mm_and_ps(mask, _mm_and_ps(_mm_and_ps(p0.front, p1.front), _mm_and_ps(c0.front, c1.front)));
+				int bits = _mm_movemask_ps(mask);
+				while(bits){
+					const int lane = __builtin_ctz(bits);
+					out.push_back((uint32_t)(i + lane));
+					bits &= bits - 1;
+				}
+			}
+#endif
+			for(; i < end; ++i) if(visible(lines, vp, i)) out.push_back((uint32_t)i);
+		}
+	}
+
+	/*
+	 * Evaluates every conditional line against a view-projection matrix (row-major, so clip = viewProj * (x, y, z, 1))
+	 * and fills visible with the indices of those that should be drawn, in ascending order.
+	 * Chunks are evaluated in parallel, each into its own list, and stitched together at the end.
+	 */
+	inline void visibleOptLines(const OptLineBuffer &lines, const float viewProj[16], std::vector<uint32_t> &visible, size_t threads = 0){
+		visible.clear();
+		const size_t n = lines.size();
+		const size_t chunkCt = (n + OptLineChunkSize - 1) / OptLineChunkSize;
+		if(chunkCt <= 1){
+			OptLineImpl::visibleRange(lines, viewProj, 0, n, visible);
+			return;
+		}
+		std::vector<std::vector<uint32_t> > partial(chunkCt);
+		Parallel::forChunks(n, OptLineChunkSize, [&](size_t begin, size_t end){
+			std::vector<uint32_t> &out = partial[begin / OptLineChunkSize];
+			out.reserve(end - begin);
+			OptLineImpl::visibleRange(lines, viewProj, begin, end, out);
+		}, threads);
+		size_t total = 0;
+		for(auto it = partial.begin(); it != partial.end(); ++it) total += it->size();
+		visible.reserve(total);
+		for(auto it = partial.begin(); it != partial.end(); ++it) visible.insert(visible.end(), it->begin(), it->end());
+	}
+}
+
+#endif /* OptLines_h */
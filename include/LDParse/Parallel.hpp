@@ -0,0 +1,55 @@
+//
+//  Parallel.hpp
+//  LDParse
+//
+//  Created by Thomas Dickerson on 1/24/16.
+//  Copyright © 2016 StickFigure Graphic Productions. All rights reserved.
+//
+
+#ifndef Parallel_h
+#define Parallel_h
+
+#include <stddef.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace LDParse {
+	namespace Parallel {
+		inline size_t defaultThreadCount(){
+			const size_t hw = std::thread::hardware_concurrency();
+			return hw ? hw : 1;
+		}
+
+		/*
+		 * Splits [0, count) into chunks of at most chunkSize elements, and calls f(begin, end) on each.
+		 * Chunks are handed out dynamically to `threads` workers (0 means one per hardware thread),
+		 * one of which is the calling thread. f must be safe to call concurrently on disjoint ranges.
+		 */
+		template<typename F> void forChunks(size_t count, size_t chunkSize, F f, size_t threads = 0){
+			if(!count) return;
+			if(!chunkSize) chunkSize = count;
+			const size_t chunkCt = (count + chunkSize - 1) / chunkSize;
+			if(!threads) threads = defaultThreadCount();
+			threads = std::min(threads, chunkCt);
+
+			std::atomic<size_t> nextChunk(0);
+			auto worker = [&](){
+				size_t chunk;
+				while((chunk = nextChunk++) < chunkCt){
+					const size_t begin = chunk * chunkSize;
+					f(begin, std::min(begin + chunkSize, count));
+				}
+			};
+
+			std::vector<std::thread> pool;
+			pool.reserve(threads - 1);
+			for(size_t i = 1; i < threads; ++i) pool.push_back(std::thread(worker));
+			worker();
+			for(auto it = pool.begin(); it != pool.end(); ++it) it->join();
+		}
+	}
+}
+
+#endif /* Parallel_h */
@@ -22,7 +22,8 @@ namespace LDParse{
 		SwitchFile,
 		SkipNLines,
 		NoAction,
-		StopParsing
+		StopParsing,
+		SuspendOnDependency // Hands control back to whoever called resume(); v is theirs to interpret (see ParseCursor)
 	} ActionKind;
 	
 	struct Action {
@@ -32,6 +33,41 @@ namespace LDParse{
 		Action(ActionKind k, size_t v) : k(k), v(v) {}
 	};
 	
+	/*
+	 * How far a parse has got, so it can be put down and picked up again. Everything the lexer produced stays in the ModelStream,
+	 * which must outlive the cursor, so resuming never re-lexes; and handlers keep their own state (BFC included) in between.
+	 * When a handler returns SuspendOnDependency, the parse stops on that line, and the line is parsed again when it resumes,
+	 * so the handler gets another go at it once whatever it was waiting for is there.
+	 */
+	class ParseCursor {
+		template<typename, typename, typename, typename, typename, typename, typename, typename, typename> friend class Parser;
+	public:
+		typedef enum : uint8_t { Ready, Suspended, Finished } State;
+	private:
+		const ModelStream * mModels;
+		bool mStrict;
+		State mState;
+		bool mOk;
+		size_t mModel;
+		bool mInModel; // Otherwise mLine hasn't been set for mModel yet
+		LineStream::const_iterator mLine;
+		std::vector<bool> mCompleted;
+		std::vector<std::pair<size_t, LineStream::const_iterator> > mScanStack; // Files interrupted by a SwitchFile, innermost last
+		size_t mWaitingOn;
+	public:
+		explicit ParseCursor(const ModelStream &models, bool strict = false)
+		: mModels(&models), mStrict(strict), mState(Ready), mOk(true), mModel(0), mInModel(false), mCompleted(models.size(), false), mWaitingOn(0) {
+			mScanStack.reserve(models.size()); // This is the worst case scenario for a sane client and poor file construction
+		}
+
+		State state() const { return mState; }
+		bool suspended() const { return mState == Suspended; }
+		bool finished() const { return mState == Finished; }
+		// The v of the SuspendOnDependency that suspended it
+		size_t waitingOn() const { return mWaitingOn; }
+		const ModelStream& getModels() const { return *mModels; }
+	};
+	
 	namespace ExpectTokenStrings {
 		constexpr static const char strEOL[] = "EOL";
 		constexpr static const char strNUM[] = "number";
@@ -125,32 +161,62 @@ namespace LDParse{
 		expectMat(mErr, readMat)
 		{}
 		
+		// Parses the whole stream in one go. Handlers mustn't suspend, since there'd be nothing to resume it.
 		bool parseModels(const ModelStream &models, bool strict = false){
-			bool ret = true;
-			std::vector<bool> completed(models.size(), false);
-			std::vector<std::pair<ModelStream::const_iterator, LineStream::const_iterator> > scanStack;
-			scanStack.reserve(models.size()); // This is the worst case scenario for a sane client and poor file construction
-			scanStack.clear();
+			ParseCursor cursor(models, strict);
+			bool ret = resume(cursor);
+			if(cursor.suspended()){
+				mErr("Parsing was suspended, but can't be resumed", models[cursor.mModel].first, true);
+				ret = false;
+			}
+			return ret;
+		}
+		
+		/*
+		 * Parses from wherever cursor got to, until the stream is done, a handler says to stop, or one suspends.
+		 * Returns false if parsing failed (so far, if it's suspended). Resuming a finished cursor does nothing.
+		 */
+		bool resume(ParseCursor &cursor){
+			if(cursor.mState == ParseCursor::Finished) return cursor.mOk;
+			const ModelStream &models = *cursor.mModels;
+			LDPARSE_TIME_PHASE(ParsePhase, models.size() ? &models.front().first : nullptr);
+			const bool strict = cursor.mStrict;
+			bool &ret = cursor.mOk;
+			std::vector<bool> &completed = cursor.mCompleted;
+			std::vector<std::pair<size_t, LineStream::const_iterator> > &scanStack = cursor.mScanStack;
+			const bool wasSuspended = cursor.mState == ParseCursor::Suspended;
+			cursor.mState = ParseCursor::Ready;
 			
-			for (auto modelIt = models.begin(); modelIt != models.end() && ret; ++modelIt) {
-				if(completed[std::distance(models.begin(), modelIt)]){
-					continue;
+			auto modelIt = models.begin() + cursor.mModel;
+			auto lineIt = cursor.mLine;
+			// The line that's being parsed again, after a suspension or a SwitchFile, which was counted the first time
+			const LineStream::value_type * again = wasSuspended ? &*lineIt : nullptr;
+			for (; modelIt != models.end() && ret; ++modelIt, cursor.mInModel = false) {
+				if(!cursor.mInModel){
+					if(completed[std::distance(models.begin(), modelIt)]){
+						continue;
+					}
+					lineIt = modelIt->second.begin();
+					cursor.mInModel = true;
 				}
-				auto lineIt = modelIt->second.begin();
 				while(lineIt != modelIt->second.end() && ret){
 					Action nextAction = {NoAction, 0};
 					const std::string lineT = lineIt->first;
 					const TokenStream &line = lineIt->second;
+					if(&*lineIt != again){
+						LDPARSE_COUNT(Lines, 1);
+						LDPARSE_COUNT(Tokens, line.size());
+					}
 					if(line.size()){
 						auto token = line.begin();
 						const auto eol = line.end();
 						switch((token++)->k){
 							case Zero:
 								if(token != eol){
-									switch((token++)->k){
+									switch(token->k){
 										case File:{
 											std::string name;
-											if(ret &= expectIdent(token, eol, name)){
+											if(ret &= expectIdent(++token, eol, name)){
 												coalesceText(token, eol, name);
 												if(ret &= expectEOL(token, eol)) nextAction = mMPD(name);
 											}
@@ -159,11 +225,10 @@ namespace LDParse{
 										case NoFile:
 											if(strict){
 												nextAction = mMPD(boost::none);
-											} else {  // Garbage has already been filtered at this point.
-												break;
-											}
+											} // Otherwise garbage has already been filtered at this point.
+											break;
 										default:
-											if(ret) nextAction = mMeta(token, eol);
+											if(ret) nextAction = mMeta(token, eol); // Meta handlers get to see their own keyword
 									}
 								} else if(strict){
 									nextAction = mMeta(token, eol) /* nb token == eol, but the types are important */;
@@ -217,8 +282,15 @@ namespace LDParse{
 							case StopParsing:
 								ret = nextAction.v;
 								goto PARSING_MEGA_BREAK;
+							case SuspendOnDependency:
+								// Stay on this line, so it's parsed again when we resume
+								cursor.mModel = std::distance(models.begin(), modelIt);
+								cursor.mLine = lineIt;
+								cursor.mWaitingOn = nextAction.v;
+								cursor.mState = ParseCursor::Suspended;
+								return ret;
 							case SwitchFile:
-								scanStack.push_back(std::make_pair(modelIt, lineIt));
+								scanStack.push_back(std::make_pair(std::distance(models.begin(), modelIt), lineIt));
 								std::advance((modelIt = models.begin()), nextAction.v);
 								lineIt = modelIt->second.begin();
 								break;
@@ -232,7 +304,9 @@ namespace LDParse{
 							completed[std::distance(models.begin(), modelIt)] = true;
 							mEOF();
 							if(scanStack.size()){
-								std::tie(modelIt, lineIt) = scanStack.back();
+								modelIt = models.begin() + scanStack.back().first;
+								lineIt = scanStack.back().second;
+								again = &*lineIt;
 								scanStack.pop_back();
 								//++lineIt; // We want to repeat the last line before the SwitchFile Action. This is easier than implementing a general deferral mechanism
 							} else {
@@ -243,6 +317,7 @@ namespace LDParse{
 				}
 			}
 		PARSING_MEGA_BREAK:
+			cursor.mState = ParseCursor::Finished;
 			return ret;
 		}
 		
@@ -0,0 +1,90 @@
+//
+//  Rays.hpp
+//  LDParse
+//
+//  Created by Thomas Dickerson on 1/30/16.
+//  Copyright © 2016 StickFigure Graphic Productions. All rights reserved.
+//
+
+#ifndef Rays_h
+#define Rays_h
+
+#ifdef LDPARSE_WITH_EMBREE
+
+#include "Model.hpp"
+
+#include <embree2/rtcore.h>
+#include <embree2/rtcore_ray.h>
+
+#include <unordered_map>
+#include <vector>
+
+namespace LDParse {
+
+	constexpr static const size_t RayChunkSize = 1 << 10;
+	constexpr static const uint32_t NoHit = (uint32_t)-1;
+
+	struct Ray {
+		Position origin;
+		Position direction;
+		float tNear;
+		float tFar;
+
+		Ray(const Position &o, const Position &d, float near = 0.f, float far = std::numeric_limits<float>::infinity())
+		: origin(o), direction(d), tNear(near), tFar(far) {}
+	};
+
+	struct RayHit {
+		uint32_t instance; // Into the RayScene's instances, or NoHit
+		uint32_t triangle; // Into the part's own indices, in threes
+		float t;
+		float u, v; // Barycentric, with respect to the triangle's second and third corners
+		Position point;
+
+		bool hit() const { return instance != NoHit; }
+	};
+
+	/*
+	 * An Embree scene over a constructed Model. Every Model with faces of its own becomes one shared geometry, in its own frame,
+	 * and each place it's used beneath the root becomes an instance of that geometry, so the BVH is built over parts rather than
+	 * over the flattened triangles. Embree 2 only instances one level deep, so each instance carries its full transformation,
+	 * along with the path of child indices that led to it from the root (for picking).
+	 * Only front faces go in; Embree hits both sides anyway. The Model must outlive the scene.
+	 */
+	class RayScene {
+		RTCDevice mDevice;
+		RTCScene mScene;
+		std::unordered_map<const Model*, RTCScene> mParts;
+		std::vector<const Model*> mInstanceModels;
+		std::vector<TransMatrix> mInstanceTransforms;
+		std::vector<size_t> mPathOffsets; // Instance i's path is mPathData[mPathOffsets[i], mPathOffsets[i + 1])
+		std::vector<uint32_t> mPathData;
+
+		RTCScene partScene(const Model &model);
+		void addInstances(const Model &model, const TransMatrix &transform, std::vector<uint32_t> &path);
+	public:
+		explicit RayScene(const Model &root);
+		~RayScene();
+		RayScene(const RayScene &) = delete;
+		RayScene& operator=(const RayScene &) = delete;
+
+		bool ok() const { return mScene != nullptr; } // False if Embree couldn't be started
+
+		size_t instanceCount() const { return mInstanceModels.size(); }
+		const Model& instanceModel(size_t instance) const { return *mInstanceModels[instance]; }
+		const TransMatrix& instanceTransform(size_t instance) const { return mInstanceTransforms[instance]; }
+		// Indices into getChildren() at each level, from the root down to the instance. Empty for the root's own faces.
+		std::pair<const uint32_t*, const uint32_t*> instancePath(size_t instance) const {
+			return std::make_pair(mPathData.data() + mPathOffsets[instance], mPathData.data() + mPathOffsets[instance + 1]);
+		}
+
+		// Finds the nearest hit along each ray. Rays are traced in parallel, in chunks of RayChunkSize.
+		void intersect(const Ray *rays, size_t count, RayHit *hits, size_t threads = 0) const;
+		// Whether anything lies along each ray, which is all an ambient occlusion bake needs
+		void occluded(const Ray *rays, size_t count, bool *blocked, size_t threads = 0) const;
+	};
+}
+
+#endif /* LDPARSE_WITH_EMBREE */
+
+#endif /* Rays_h */
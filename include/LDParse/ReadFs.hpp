@@ -126,17 +126,22 @@ namespace LDParse {
 	template<typename ErrF> bool readMat(TokenStream::const_iterator &tokenIt, TransMatrix &m, const FailF<ErrF> &fail) {
 		const TokenStream::const_iterator start = tokenIt;
 		bool ret = true;
-		ret = readPosition(tokenIt, std::get<0>(m), fail)
-		&&readNumber(tokenIt, std::get<1>(m), fail)
-		&&readNumber(tokenIt, std::get<2>(m), fail)
-		&&readNumber(tokenIt, std::get<3>(m), fail)
-		&&readNumber(tokenIt, std::get<4>(m), fail)
-		&&readNumber(tokenIt, std::get<5>(m), fail)
-		&&readNumber(tokenIt, std::get<6>(m), fail)
-		&&readNumber(tokenIt, std::get<7>(m), fail)
-		&&readNumber(tokenIt, std::get<8>(m), fail)
-		&&readNumber(tokenIt, std::get<9>(m), fail);
-		if(!ret) fail(start, &ret);
+		Position t;
+		ret = readPosition(tokenIt, t, fail)
+		&&readNumber(tokenIt, m(0, 0), fail)
+		&&readNumber(tokenIt, m(0, 1), fail)
+		&&readNumber(tokenIt, m(0, 2), fail)
+		&&readNumber(tokenIt, m(1, 0), fail)
+		&&readNumber(tokenIt, m(1, 1), fail)
+		&&readNumber(tokenIt, m(1, 2), fail)
+		&&readNumber(tokenIt, m(2, 0), fail)
+		&&readNumber(tokenIt, m(2, 1), fail)
+		&&readNumber(tokenIt, m(2, 2), fail);
+		if(ret){
+			m(0, 3) = std::get<0>(t);
+			m(1, 3) = std::get<1>(t);
+			m(2, 3) = std::get<2>(t);
+		} else fail(start, &ret);
 		return ret;
 	}
 	
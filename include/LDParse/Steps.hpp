@@ -0,0 +1,64 @@
+//
+//  Steps.hpp
+//  LDParse
+//
+//  Created by Thomas Dickerson on 1/27/16.
+//  Copyright © 2016 StickFigure Graphic Productions. All rights reserved.
+//
+
+#ifndef Steps_h
+#define Steps_h
+
+#include "Model.hpp"
+
+#include <unordered_map>
+#include <vector>
+
+namespace LDParse {
+
+	typedef std::pair<size_t, size_t> Range;
+
+	// The parts of one Model's own data (not its children's) that are on show at some step
+	struct StepRanges {
+		Range indices;
+		Range bfIndices;
+		Range children;
+		Range optLines;
+		Range lineIndices;
+	};
+
+	/*
+	 * Numbers the building steps of a model the way instructions present them: each submodel's steps come just
+	 * before the step of its parent that first places it. Parts and primitives are never stepped through.
+	 * Everything here refers back into the Models, so nothing is copied, and the Models must outlive the index.
+	 */
+	class StepIndex {
+	public:
+		struct Entry {
+			const Model * model;
+			size_t localStep;
+		};
+	private:
+		std::vector<Entry> mSteps;
+		// For each stepped Model, the global step at which each of its local steps completes (ascending)
+		std::unordered_map<const Model*, std::vector<size_t> > mCompletions;
+
+		void visit(const Model &model);
+	public:
+		explicit StepIndex(const Model &root);
+
+		size_t size() const { return mSteps.size(); }
+		const Entry& operator[](size_t step) const { return mSteps[step]; }
+
+		// How many of model's own steps are complete once global step `step` is done. O(log steps).
+		size_t localStepsDone(const Model &model, size_t step) const;
+		// Everything of model's own that is visible once global step `step` is done, as prefixes of its arrays
+		StepRanges visible(const Model &model, size_t step) const;
+		// What global step `step` adds. Only one Model changes per step, so walking through the steps costs O(delta) per step.
+		StepRanges added(size_t step) const;
+
+		static StepRanges localStep(const Model &model, size_t localStep);
+	};
+}
+
+#endif /* Steps_h */
@@ -0,0 +1,67 @@
+//
+//  Stream.hpp
+//  LDParse
+//
+//  Created by Thomas Dickerson on 2/6/16.
+//  Copyright © 2016 StickFigure Graphic Productions. All rights reserved.
+//
+
+#ifndef Stream_h
+#define Stream_h
+
+#include "Model.hpp"
+
+#include <functional>
+
+namespace LDParse {
+
+	constexpr static const size_t DefaultStreamChunkVertices = 1 << 16;
+	constexpr static const size_t DefaultStreamChunkIndices = 1 << 18; // Faces, back faces and line ends together
+	constexpr static const size_t DefaultStreamPipelineDepth = 4;
+
+	/*
+	 * One piece of a flattened model. Indices refer to this chunk's own vertices, so every chunk stands alone,
+	 * and a chunk never splits a triangle or a line. Chunks come out in sequence, in the order flatten would emit their geometry.
+	 * Duplicate edge lines are dropped as flatten drops them, but only within a chunk, so memory use stays bounded.
+	 */
+	struct MeshChunk {
+		size_t mSequence;
+		LDMesh mMesh;
+		OptLineBuffer mOptLines; // Empty unless StreamOptions::mOptLines
+
+		size_t indexCount() const { return mMesh.indices.size() + mMesh.bfIndices.size() + mMesh.lineIndices.size(); }
+		void clear(); // Keeps every buffer's capacity
+	};
+
+	struct StreamOptions {
+		size_t mChunkVertices; // At most this many vertices per chunk; each conditional line counts as four
+		size_t mChunkIndices; // And at most this many indices. Neither can be less than four.
+		size_t mPipelineDepth; // Chunks in flight: one being filled, the rest waiting for (or in) the sink
+		uint32_t mColour; // What colour 16 means at the root
+		bool mOptLines;
+
+		StreamOptions() : mChunkVertices(DefaultStreamChunkVertices), mChunkIndices(DefaultStreamChunkIndices),
+			mPipelineDepth(DefaultStreamPipelineDepth), mColour(MainColour), mOptLines(false) {}
+	};
+
+	struct StreamStats {
+		size_t chunks;
+		size_t instances;
+		size_t vertices;
+		size_t triangles; // Including back faces
+		size_t lines;
+	};
+
+	typedef std::function<void(const MeshChunk &)> ChunkSinkF;
+
+	/*
+	 * Flattens model the way Model::flatten would, but hands the result to sink a chunk at a time rather than building one mesh.
+	 * Instances are transformed on a separate thread while sink runs on the calling thread, one chunk at a time, in sequence.
+	 * Only mPipelineDepth chunks ever exist, and each is recycled once sink returns, so memory use is bounded by the chunk
+	 * size times the pipeline depth however big the model is. A chunk is only valid until sink returns.
+	 * If sink throws, the transforming thread is stopped and the exception is rethrown here.
+	 */
+	StreamStats flattenStreaming(const Model &model, const ChunkSinkF &sink, const StreamOptions &options = StreamOptions());
+}
+
+#endif /* Stream_h */
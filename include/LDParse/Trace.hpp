@@ -0,0 +1,113 @@
+//
+//  Trace.hpp
+//  LDParse
+//
+//  Created by Thomas Dickerson on 1/31/16.
+//  Copyright © 2016 StickFigure Graphic Productions. All rights reserved.
+//
+
+#ifndef Trace_h
+#define Trace_h
+
+/*
+ * Counters and phase timers for the lexer, parser and builder. Everything here only exists when LDPARSE_INSTRUMENT is defined
+ * (the CMake option of the same name); otherwise the macros below expand to nothing, and there is nothing to pay for.
+ */
+#ifdef LDPARSE_INSTRUMENT
+
+#include <stddef.h>
+#include <stdint.h>
+#include <chrono>
+#include <ostream>
+#include <string>
+
+namespace LDParse {
+	namespace Trace {
+		typedef enum : uint8_t {
+			Lines = 0,
+			Tokens,
+			Includes,
+			CacheHits, // Includes satisfied by a submodel or the library's cache
+			CacheMisses, // Includes that had to be loaded
+			SwitchFiles, // Jumps to a submodel that hadn't been parsed yet
+			CounterCount
+		} Counter;
+
+		typedef enum : uint8_t {
+			LexPhase = 0, // Each line. Too fine-grained to trace, or to ask the kernel for CPU time, so only wall time is kept.
+			BoundaryPhase, // Splitting a file into its models
+			ParsePhase,
+			BuildPhase, // The whole of ModelBuilder::construct (or start, and every resume after it), parsing included
+			PhaseCount
+		} Phase;
+
+		struct Stats {
+			uint64_t mCounters[CounterCount];
+			uint64_t mPhaseNanos[PhaseCount]; // Wall time
+			uint64_t mPhaseCpuNanos[PhaseCount]; // CPU time of the thread that ran the phase
+			uint64_t mPhaseCalls[PhaseCount];
+		};
+
+		const char * counterName(Counter c);
+		const char * phaseName(Phase p);
+
+		void count(Counter c, uint64_t n);
+		void addPhase(Phase p, uint64_t nanos, uint64_t cpuNanos, bool newCall = true);
+		// How many timers for p are running on this thread, so one inside another (a dependency's build, say) isn't added twice
+		size_t& phaseDepth(Phase p);
+		uint64_t threadCpuNanos();
+		Stats snapshot();
+		void reset();
+
+		// Between these, timed phases (other than LexPhase) are also recorded as events, for writeChromeTrace
+		void startTrace();
+		void stopTrace();
+		bool tracing();
+		void recordEvent(Phase p, const std::string &detail, std::chrono::steady_clock::time_point begin, std::chrono::steady_clock::time_point end);
+		// Trace Event Format, as read by chrome://tracing and Perfetto. Counters are appended as of the time of writing.
+		bool writeChromeTrace(std::ostream &out);
+
+		/*
+		 * Times its own scope as part of p. Only the outermost timer for a phase on a thread adds to the totals, though nested ones
+		 * are still traced. One that isn't a new call only adds time, for work that carries on a call counted earlier (and isn't traced
+		 * at all inside another, since that already covers it).
+		 */
+		class ScopedTimer {
+			const Phase mPhase;
+			const std::string * const mDetail;
+			const bool mOutermost, mNewCall;
+			const std::chrono::steady_clock::time_point mBegin;
+			const uint64_t mCpuBegin;
+		public:
+			explicit ScopedTimer(Phase p, const std::string * detail = nullptr, bool newCall = true)
+			: mPhase(p), mDetail(detail), mOutermost(phaseDepth(p)++ == 0), mNewCall(newCall), mBegin(std::chrono::steady_clock::now()),
+			mCpuBegin(p == LexPhase || !mOutermost ? 0 : threadCpuNanos()) {}
+			~ScopedTimer(){
+				const std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+				--phaseDepth(mPhase);
+				if(mOutermost){
+					addPhase(mPhase, std::chrono::duration_cast<std::chrono::nanoseconds>(end - mBegin).count(), mPhase == LexPhase ? 0 : threadCpuNanos() - mCpuBegin, mNewCall);
+				}
+				if(mPhase != LexPhase && (mOutermost || mNewCall) && tracing()) recordEvent(mPhase, mDetail ? *mDetail : std::string(), mBegin, end);
+			}
+			ScopedTimer(const ScopedTimer &) = delete;
+			ScopedTimer& operator=(const ScopedTimer &) = delete;
+		};
+	}
+}
+
+#define LDPARSE_TRACE_CAT2(a, b) a ## b
+#define LDPARSE_TRACE_CAT(a, b) LDPARSE_TRACE_CAT2(a, b)
+#define LDPARSE_COUNT(counter, n) ::LDParse::Trace::count(::LDParse::Trace::counter, (n))
+#define LDPARSE_TIME_PHASE(phase, detail) ::LDParse::Trace::ScopedTimer LDPARSE_TRACE_CAT(ldparseTimer, __LINE__)(::LDParse::Trace::phase, (detail))
+#define LDPARSE_CONTINUE_PHASE(phase, detail) ::LDParse::Trace::ScopedTimer LDPARSE_TRACE_CAT(ldparseTimer, __LINE__)(::LDParse::Trace::phase, (detail), false)
+
+#else
+
+#define LDPARSE_COUNT(counter, n) ((void)0)
+#define LDPARSE_TIME_PHASE(phase, detail) ((void)0)
+#define LDPARSE_CONTINUE_PHASE(phase, detail) ((void)0)
+
+#endif /* LDPARSE_INSTRUMENT */
+
+#endif /* Trace_h */
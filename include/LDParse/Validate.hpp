@@ -0,0 +1,47 @@
+//
+//  Validate.hpp
+//  LDParse
+//
+//  Created by Thomas Dickerson on 2/11/16.
+//  Copyright © 2016 StickFigure Graphic Productions. All rights reserved.
+//
+
+#ifndef Validate_h
+#define Validate_h
+
+#include "Batch.hpp"
+
+#include <string>
+#include <vector>
+
+namespace LDParse {
+
+	struct ValidationResult {
+		std::string mPath;
+		std::vector<Diagnostic> mDiagnostics;
+		size_t mLines;
+		size_t mModels; // 1, unless it's an MPD
+		size_t mErrors; // Fatal diagnostics
+		size_t mWarnings;
+		bool mOk; // Whether ModelBuilder::construct would have got to the end of it
+	};
+
+	struct ValidateOptions {
+		size_t mThreads; // 0 for one per hardware thread
+
+		ValidateOptions() : mThreads(0) {}
+	};
+
+	/*
+	 * Checks files the way ModelBuilder::construct would, without building anything: every line goes through the same Lexer
+	 * and Parser (so the same Expect checks), and the handlers only keep track of what BFC certification and MPD structure need.
+	 * On top of what construct would report, an MPD that defines a submodel twice, or whose submodels include each other in
+	 * a cycle, is an error. If library is given, includes are looked up in its index, but nothing is read, built or cached;
+	 * the Library is only read from, so it can be shared with builders running at the same time.
+	 * Sources are checked in parallel, each by whichever worker is free next. Results are in the same order as sources.
+	 */
+	std::vector<ValidationResult> validateBatch(const std::vector<BatchSource> &sources, const Library * library = nullptr,
+												const ValidateOptions &options = ValidateOptions());
+}
+
+#endif /* Validate_h */
@@ -0,0 +1,85 @@
+//
+//  Watch.hpp
+//  LDParse
+//
+//  Created by Thomas Dickerson on 2/8/16.
+//  Copyright © 2016 StickFigure Graphic Productions. All rights reserved.
+//
+
+#ifndef Watch_h
+#define Watch_h
+
+#include "Batch.hpp"
+#include "Library.hpp"
+
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace LDParse {
+
+	// How a Watcher rebuilds what it invalidates. These should match whatever the Models were first built with.
+	struct WatchOptions {
+		bool mRebuild; // Otherwise invalidated Models are left for the next builder that needs them
+		boost::optional<float> mWeldEpsilon;
+		LODPolicy mLODPolicy; // Only its substitutes matter: each Model is rebuilt at the level it was cached at
+		bool mInterning;
+
+		WatchOptions() : mRebuild(true), mInterning(false) {}
+	};
+
+	// Everything one round of changes did
+	struct WatchEvent {
+		std::vector<std::string> mPaths; // Files that changed, appeared or went, once each
+		std::vector<std::string> mInvalidated; // Library keys (see Library::cacheKey)
+		std::vector<std::string> mRebuilt; // Of those, the ones that are cached again
+		std::vector<Diagnostic> mDiagnostics; // From rebuilding
+	};
+
+	typedef std::function<void(const WatchEvent &)> WatchListenerF;
+
+	/*
+	 * Keeps a Library's cache in step with the files it was built from. On Linux, when built with LDPARSE_WITH_INOTIFY, every
+	 * directory the Library has indexed is watched, and each change invalidates exactly the Models built from that file and
+	 * everything that includes them (see Library::invalidate); anything else stays cached, and stays valid. Files that appear or
+	 * go are reindexed, so shadowing between roots keeps working. With mRebuild, whatever was invalidated is built again straight away.
+	 * Either poll() from a loop of your own, or start() a thread to do it; the listener is called from whichever does, once per round.
+	 * Without inotify, changed() still does everything but notice.
+	 */
+	class Watcher {
+		Library &mLibrary;
+		WatchOptions mOptions;
+		WatchListenerF mListener;
+		int mFd; // -1 without inotify
+		int mWake[2]; // For stop(), so a thread blocked in poll() returns
+		std::unordered_map<int, Library::IndexedDirectory> mWatches; // Watch descriptor -> what its files are indexed as
+		std::thread mThread;
+		std::atomic<bool> mStopping;
+
+		void watch(const Library::IndexedDirectory &dir);
+		void rebuild(WatchEvent &event);
+	public:
+		Watcher(Library &library, const WatchOptions &options = WatchOptions());
+		~Watcher(); // Stops the thread, if it was started
+		Watcher(const Watcher &) = delete;
+		Watcher& operator=(const Watcher &) = delete;
+
+		// Watches every directory the library has indexed so far. False if there's no inotify to do it with.
+		bool watchLibrary();
+		bool available() const { return mFd >= 0; }
+		void setListener(const WatchListenerF &listener) { mListener = listener; }
+
+		// Handles whatever changes arrive within timeoutMs (-1 to wait for some). Returns how many files changed.
+		size_t poll(int timeoutMs);
+		void start();
+		void stop();
+
+		// For changes made some other way: invalidates (and maybe rebuilds) whatever was built from path, as if it had been rewritten
+		WatchEvent changed(const std::string &path);
+	};
+}
+
+#endif /* Watch_h */
@@ -0,0 +1,276 @@
+//
+//  Weld.hpp
+//  LDParse
+//
+//  Created by Thomas Dickerson on 1/24/16.
+//  Copyright © 2016 StickFigure Graphic Productions. All rights reserved.
+//
+
+#ifndef Weld_h
+#define Weld_h
+
+#include "Geom.hpp"
+#include "Parallel.hpp"
+
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace LDParse {
+
+	constexpr static const float DefaultWeldEpsilon = 1e-3f; // In LDU
+	constexpr static const size_t WeldChunkSize = 1 << 14;
+
+	struct WeldStats {
+		size_t verticesBefore;
+		size_t verticesAfter;
+		size_t degenerateDropped; // Triangles that collapsed to a line or a point, and were removed
+		size_t linesDropped; // Edge lines that collapsed, or duplicated another
+
+		WeldStats() : verticesBefore(0), verticesAfter(0), degenerateDropped(0), linesDropped(0) {}
+
+		// Fraction of vertices removed, in [0, 1)
+		double reduction() const { return verticesBefore ? 1.0 - (double)verticesAfter / verticesBefore : 0.0; }
+
+		WeldStats& operator+=(const WeldStats &o){
+			verticesBefore += o.verticesBefore;
+			verticesAfter += o.verticesAfter;
+			degenerateDropped += o.degenerateDropped;
+			linesDropped += o.linesDropped;
+			return *this;
+		}
+	};
+
+	// Ascending offsets into each index array (e.g. step boundaries), kept pointing at the same primitives as they are compacted
+	struct WeldMarks {
+		std::vector<size_t> indices;
+		std::vector<size_t> bfIndices;
+		std::vector<size_t> lineIndices;
+	};
+
+	namespace WeldImpl {
+		struct Cell {
+			int64_t x, y, z;
+			bool operator==(const Cell &o) const { return x == o.x && y == o.y && z == o.z; }
+		};
+
+		struct CellHash {
+			size_t operator()(const Cell &c) const {
+				// The usual large-prime spatial hash
+				return (size_t)((c.x * 73856093) ^ (c.y * 19349663) ^ (c.z * 83492791));
+			}
+		};
+
+		inline Cell gridCell(const Position &p, float invCell){
+			return {(int64_t)std::floor(std::get<0>(p) * invCell), (int64_t)std::floor(std::get<1>(p) * invCell), (int64_t)std::floor(std::get<2>(p) * invCell)};
+		}
+
+		// With no tolerance, we key on the exact bit patterns instead
+		inline Cell exactCell(const Position &p){
+			uint32_t x, y, z;
+			float fx = std::get<0>(p) + 0.0f, fy = std::get<1>(p) + 0.0f, fz = std::get<2>(p) + 0.0f; // Folds -0 onto +0
+			memcpy(&x, &fx, sizeof(x)); memcpy(&y, &fy, sizeof(y)); memcpy(&z, &fz, sizeof(z));
+			return {x, y, z};
+		}
+
+		inline float distance2(const Position &a, const Position &b){
+			const float dx = std::get<0>(a) - std::get<0>(b);
+			const float dy = std::get<1>(a) - std::get<1>(b);
+			const float dz = std::get<2>(a) - std::get<2>(b);
+			return dx * dx + dy * dy + dz * dz;
+		}
+
+		inline void remapIndices(std::vector<uint32_t> &indices, const std::vector<uint32_t> &remap, size_t threads){
+			Parallel::forChunks(indices.size(), WeldChunkSize, [&](size_t begin, size_t end){
+				for(size_t i = begin; i < end; ++i) indices[i] = remap[indices[i]];
+			}, threads);
+		}
+
+		// Compacts out primitives that keep() rejects, `arity` indices at a time. marks, if given, move along with them.
+		template<typename KeepF> size_t compact(std::vector<uint32_t> &indices, size_t arity, std::vector<size_t> *marks, KeepF keep){
+			size_t kept = 0;
+			const size_t primCt = indices.size() / arity;
+			auto markIt = marks ? marks->begin() : std::vector<size_t>::iterator();
+			for(size_t t = 0; t < primCt; ++t){
+				for(; marks && markIt != marks->end() && *markIt <= arity * t; ++markIt) *markIt = arity * kept;
+				if(keep(&indices[arity * t], t)){
+					for(size_t k = 0; k < arity; ++k) indices[arity * kept + k] = indices[arity * t + k];
+					++kept;
+				}
+			}
+			for(; marks && markIt != marks->end(); ++markIt) *markIt = arity * kept;
+			indices.resize(arity * kept);
+			return primCt - kept;
+		}
+
+		// Rounds to the nearest multiple of the cell size. LDraw coordinates are rarely finer than a thousandth of an LDU, so with
+		// the default tolerance they sit at the centres of cells, and the error that transformations pile up stays well inside them.
+		inline Cell nearestCell(const Position &p, float invCell){
+			return {(int64_t)std::llround(std::get<0>(p) * invCell), (int64_t)std::llround(std::get<1>(p) * invCell), (int64_t)std::llround(std::get<2>(p) * invCell)};
+		}
+
+		inline bool cellLess(const Cell &a, const Cell &b){
+			return a.x < b.x || (a.x == b.x && (a.y < b.y || (a.y == b.y && a.z < b.z)));
+		}
+
+		// Ends in a fixed order, so a line matches itself drawn backwards
+		struct EdgeKey {
+			Cell lo, hi;
+			bool operator==(const EdgeKey &o) const { return lo == o.lo && hi == o.hi; }
+		};
+
+		struct EdgeKeyHash {
+			size_t operator()(const EdgeKey &e) const {
+				const CellHash h;
+				return h(e.lo) * 0x9e3779b97f4a7c15ull ^ h(e.hi);
+			}
+		};
+
+		inline size_t dropDegenerate(std::vector<uint32_t> &indices, std::vector<size_t> *marks){
+			return compact(indices, 3, marks, [](const uint32_t *t, size_t){ return t[0] != t[1] && t[1] != t[2] && t[2] != t[0]; });
+		}
+	}
+
+	/*
+	 * Removes edge lines that collapsed to a point, or that join the same two vertices as an earlier line (in either direction),
+	 * as happens wherever a part draws an edge that one of its primitives already has. This goes by vertex index, so it only
+	 * sees duplicates within one mesh, once its vertices have been welded; weldVertices runs it whenever any merged.
+	 * Lines drawn by different models, or by different placements of one, are only matched up once flattened (see EdgeSet).
+	 */
+	template<typename ...AttrTypes> size_t dedupeLines(Mesh<AttrTypes...> &mesh, std::vector<size_t> *marks = nullptr){
+		std::unordered_set<uint64_t> seen;
+		seen.reserve(mesh.lineIndices.size() / 2);
+		std::vector<uint32_t> &colours = mesh.lineColours;
+		size_t keptColours = 0;
+		const size_t dropped = WeldImpl::compact(mesh.lineIndices, 2, marks, [&](const uint32_t *l, size_t lineNo){
+			const uint64_t lo = std::min(l[0], l[1]), hi = std::max(l[0], l[1]);
+			const bool keep = lo != hi && seen.insert((lo << 32) | hi).second;
+			if(keep) colours[keptColours++] = colours[lineNo];
+			return keep;
+		});
+		colours.resize(keptColours);
+		return dropped;
+	}
+
+	/*
+	 * Remembers edge lines by where their ends are, so a line can be recognised as one already drawn by another model,
+	 * or by another placement of the same one, whatever vertices either of them uses. Ends match to within about epsilon
+	 * (they're snapped to a grid of that size), or exactly if epsilon <= 0.
+	 */
+	class EdgeSet {
+		std::unordered_set<WeldImpl::EdgeKey, WeldImpl::EdgeKeyHash> mSeen;
+		float mInvCell;
+	public:
+		explicit EdgeSet(float epsilon = DefaultWeldEpsilon) : mInvCell(epsilon > 0 ? 1.f / epsilon : 0.f) {}
+
+		// True, and remembered, if a line from a to b hasn't been seen before in either direction and doesn't collapse to a point
+		bool insert(const Position &a, const Position &b){
+			using namespace WeldImpl;
+			const Cell ca = mInvCell > 0 ? nearestCell(a, mInvCell) : exactCell(a), cb = mInvCell > 0 ? nearestCell(b, mInvCell) : exactCell(b);
+			if(ca == cb) return false;
+			return mSeen.insert(cellLess(ca, cb) ? EdgeKey{ca, cb} : EdgeKey{cb, ca}).second;
+		}
+
+		void clear(){ mSeen.clear(); }
+		size_t size() const { return mSeen.size(); }
+	};
+
+	// Removes edge lines, from line firstLine on, that edges has already seen (see EdgeSet::insert); the rest are added to it
+	template<typename ...RestTypes> size_t dedupeLines(Mesh<Position, RestTypes...> &mesh, EdgeSet &edges, size_t firstLine = 0){
+		const std::vector<Position> &positions = std::get<0>(mesh.attributes);
+		std::vector<uint32_t> &indices = mesh.lineIndices;
+		std::vector<uint32_t> &colours = mesh.lineColours;
+		size_t kept = firstLine;
+		for(size_t l = firstLine; l < colours.size(); ++l){
+			if(!edges.insert(positions[indices[2 * l]], positions[indices[2 * l + 1]])) continue;
+			indices[2 * kept] = indices[2 * l];
+			indices[2 * kept + 1] = indices[2 * l + 1];
+			colours[kept++] = colours[l];
+		}
+		const size_t dropped = colours.size() - kept;
+		indices.resize(2 * kept);
+		colours.resize(kept);
+		return dropped;
+	}
+
+	/*
+	 * Merges vertices whose positions lie within epsilon of each other and agree on every other attribute.
+	 * Positions are bucketed into a hash grid with cells of size epsilon, so only the 27 surrounding cells are searched.
+	 * Bucketing and index remapping run in parallel over chunks; the merge itself is sequential so the result is deterministic
+	 * (the first vertex of each cluster survives, and survivors keep their relative order).
+	 * An epsilon <= 0 welds exact duplicates only.
+	 * Vertices used only by edge lines carry no attributes of their own that matter (lines have their own colours), so they
+	 * are merged last, into whatever face vertex is nearby. If any vertices merged, lines that now join the same two are dropped (see dedupeLines).
+	 */
+	template<typename ...RestTypes> WeldStats weldVertices(Mesh<Position, RestTypes...> &mesh, float epsilon = DefaultWeldEpsilon, size_t threads = 0,
+														   WeldMarks *marks = nullptr){
+		using namespace WeldImpl;
+		WeldStats stats;
+		const size_t vertexCt = mesh.vertexCount();
+		stats.verticesBefore = stats.verticesAfter = vertexCt;
+		if(vertexCt < 2) return stats;
+
+		const std::vector<Position> &positions = std::get<0>(mesh.attributes);
+		const bool exact = !(epsilon > 0);
+		const float invCell = exact ? 0.f : 1.f / epsilon;
+		const float eps2 = exact ? 0.f : epsilon * epsilon;
+		const int64_t reach = exact ? 0 : 1;
+
+		std::vector<Cell> cells(vertexCt);
+		Parallel::forChunks(vertexCt, WeldChunkSize, [&](size_t begin, size_t end){
+			for(size_t i = begin; i < end; ++i) cells[i] = exact ? exactCell(positions[i]) : gridCell(positions[i], invCell);
+		}, threads);
+
+		std::vector<bool> lineOnly(vertexCt, false);
+		for(auto it = mesh.lineIndices.begin(); it != mesh.lineIndices.end(); ++it) lineOnly[*it] = true;
+		for(auto it = mesh.indices.begin(); it != mesh.indices.end(); ++it) lineOnly[*it] = false;
+		for(auto it = mesh.bfIndices.begin(); it != mesh.bfIndices.end(); ++it) lineOnly[*it] = false;
+
+		std::unordered_map<Cell, std::vector<uint32_t>, CellHash> grid;
+		grid.reserve(vertexCt);
+		std::vector<uint32_t> remap(vertexCt);
+		std::vector<uint32_t> keep;
+		keep.reserve(vertexCt);
+
+		for(size_t pass = 0; pass < 2; ++pass) for(size_t i = 0; i < vertexCt; ++i){
+			if(lineOnly[i] != (pass == 1)) continue;
+			const Cell &home = cells[i];
+			bool found = false;
+			for(int64_t dx = -reach; dx <= reach && !found; ++dx){
+				for(int64_t dy = -reach; dy <= reach && !found; ++dy){
+					for(int64_t dz = -reach; dz <= reach && !found; ++dz){
+						auto cellIt = grid.find({home.x + dx, home.y + dy, home.z + dz});
+						if(cellIt == grid.end()) continue;
+						for(auto repIt = cellIt->second.begin(); repIt != cellIt->second.end(); ++repIt){
+							if(distance2(positions[*repIt], positions[i]) <= eps2 && (lineOnly[i] || mesh.sameTrailingAttributes(*repIt, i))){
+								remap[i] = remap[*repIt];
+								found = true;
+								break;
+							}
+						}
+					}
+				}
+			}
+			if(!found){
+				remap[i] = (uint32_t)keep.size();
+				keep.push_back((uint32_t)i);
+				grid[home].push_back((uint32_t)i);
+			}
+		}
+
+		stats.verticesAfter = keep.size();
+		if(stats.verticesAfter != vertexCt){
+			mesh.selectVertices(keep);
+			remapIndices(mesh.indices, remap, threads);
+			remapIndices(mesh.bfIndices, remap, threads);
+			remapIndices(mesh.lineIndices, remap, threads);
+			stats.degenerateDropped = dropDegenerate(mesh.indices, marks ? &marks->indices : nullptr)
+			+ dropDegenerate(mesh.bfIndices, marks ? &marks->bfIndices : nullptr);
+			stats.linesDropped = dedupeLines(mesh, marks ? &marks->lineIndices : nullptr);
+		}
+		return stats;
+	}
+}
+
+#endif /* Weld_h */